@@ -0,0 +1,521 @@
+#include "lyrics-background-cache.h"
+#include <plugin-support.h>
+#include <graphics/image-file.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/dstr.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// A background is any of these; sidecars are looked up in this order, images
+// first. Videos are always played as animations, never decoded as stills.
+static const char *const image_extensions[] = {".png", ".jpg", ".jpeg", ".webp", ".gif", ".bmp", ".apng"};
+static const char *const video_extensions[] = {".mp4", ".webm", ".mov", ".mkv", ".m4v"};
+
+struct image_entry {
+	uint64_t id = 0;
+	gs_image_file4_t *image = nullptr; // null while decoding
+	bool failed = false;
+	bool animated = false; // handed to a media source instead of decoded here
+	bool probed = false;
+	uint32_t cx = 0; // size of an animated image, 0 for videos
+	uint32_t cy = 0;
+	bool uploaded = false;
+	uint64_t bytes = 0;
+	uint64_t last_used = 0;
+};
+
+struct background_request {
+	std::string path;
+	bool song; // resolve a song's sidecar, otherwise decode an image
+};
+
+struct lyrics_background_cache {
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<background_request> requests;
+	bool stopping = false;
+	std::thread thread;
+
+	// Song path -> sidecar image path, empty if the song has none
+	std::unordered_map<std::string, std::string> sidecars;
+	// Image path -> decoded image; present from the moment it is requested
+	std::unordered_map<std::string, image_entry> images;
+	std::string default_path;
+	std::atomic<uint32_t> default_cx{0};
+	std::atomic<uint32_t> default_cy{0};
+
+	uint64_t budget = 256ull * 1024 * 1024;
+	uint64_t next_id = 1;
+	uint64_t tick = 1;
+
+	// Decoded images that were replaced or evicted, freed on the graphics thread
+	std::vector<gs_image_file4_t *> garbage;
+};
+
+static std::string find_with_extension(const fs::path &base, const char *const *extensions, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		std::error_code ec;
+		const fs::path candidate = fs::path(base).replace_extension(extensions[i]);
+		if (fs::is_regular_file(candidate, ec))
+			return candidate.generic_u8string();
+	}
+	return std::string();
+}
+
+// Same name as the song file, with an image or video extension
+static std::string find_sidecar(const std::string &song_path)
+{
+	const fs::path base = fs::u8path(song_path);
+	std::string sidecar = find_with_extension(base, image_extensions, std::size(image_extensions));
+	if (sidecar.empty())
+		sidecar = find_with_extension(base, video_extensions, std::size(video_extensions));
+	return sidecar;
+}
+
+const char *lyrics_background_file_filter(void)
+{
+	static const std::string filter = [] {
+		std::string patterns;
+		for (const char *extension : image_extensions)
+			patterns += std::string(patterns.empty() ? "*" : " *") + extension;
+		for (const char *extension : video_extensions)
+			patterns += std::string(" *") + extension;
+		return "Images and Videos (" + patterns + ");;All Files (*)";
+	}();
+	return filter.c_str();
+}
+
+static bool read_bytes(FILE *file, uint8_t *data, size_t size)
+{
+	return fread(data, 1, size, file) == size;
+}
+
+static bool skip_bytes(FILE *file, long size)
+{
+	return fseek(file, size, SEEK_CUR) == 0;
+}
+
+// Skips a run of GIF data sub-blocks, up to and including the terminator
+static bool skip_gif_sub_blocks(FILE *file)
+{
+	for (;;) {
+		uint8_t size;
+		if (!read_bytes(file, &size, 1))
+			return false;
+		if (!size)
+			return true;
+		if (!skip_bytes(file, size))
+			return false;
+	}
+}
+
+// Walks the block structure up to the second image without decoding anything
+static bool is_animated_gif(FILE *file, uint32_t *cx, uint32_t *cy)
+{
+	uint8_t header[13];
+	if (!read_bytes(file, header, sizeof(header)) || memcmp(header, "GIF8", 4) != 0)
+		return false;
+	*cx = header[6] | (header[7] << 8);
+	*cy = header[8] | (header[9] << 8);
+	if ((header[10] & 0x80) && !skip_bytes(file, 3L << ((header[10] & 0x07) + 1)))
+		return false;
+
+	int images = 0;
+	uint8_t block;
+	while (read_bytes(file, &block, 1)) {
+		if (block == 0x21) {
+			// Extension: label, then sub-blocks
+			if (!skip_bytes(file, 1) || !skip_gif_sub_blocks(file))
+				return false;
+		} else if (block == 0x2C) {
+			if (++images > 1)
+				return true;
+			uint8_t descriptor[9];
+			if (!read_bytes(file, descriptor, sizeof(descriptor)))
+				return false;
+			if ((descriptor[8] & 0x80) && !skip_bytes(file, 3L << ((descriptor[8] & 0x07) + 1)))
+				return false;
+			// LZW code size, then the image data sub-blocks
+			if (!skip_bytes(file, 1) || !skip_gif_sub_blocks(file))
+				return false;
+		} else {
+			break; // trailer or garbage
+		}
+	}
+	return false;
+}
+
+// APNG files carry an acTL chunk before the first IDAT
+static bool is_animated_png(FILE *file, uint32_t *cx, uint32_t *cy)
+{
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	uint8_t header[8];
+	if (!read_bytes(file, header, sizeof(header)) || memcmp(header, signature, sizeof(signature)) != 0)
+		return false;
+
+	uint8_t chunk[8];
+	while (read_bytes(file, chunk, sizeof(chunk))) {
+		const uint32_t length = ((uint32_t)chunk[0] << 24) | (chunk[1] << 16) | (chunk[2] << 8) | chunk[3];
+		if (memcmp(chunk + 4, "IHDR", 4) == 0) {
+			uint8_t size[8];
+			if (length < sizeof(size) || !read_bytes(file, size, sizeof(size)))
+				return false;
+			*cx = ((uint32_t)size[0] << 24) | (size[1] << 16) | (size[2] << 8) | size[3];
+			*cy = ((uint32_t)size[4] << 24) | (size[5] << 16) | (size[6] << 8) | size[7];
+			if (!skip_bytes(file, (long)length - (long)sizeof(size) + 4))
+				return false;
+			continue;
+		}
+		if (memcmp(chunk + 4, "acTL", 4) == 0)
+			return true;
+		if (memcmp(chunk + 4, "IDAT", 4) == 0)
+			return false;
+		if (!skip_bytes(file, (long)length + 4))
+			return false;
+	}
+	return false;
+}
+
+// Videos, multi-frame GIFs and APNGs play through a media source. The size
+// is only known for images; videos report theirs once playing.
+static bool probe_animation(const std::string &path, uint32_t *cx, uint32_t *cy)
+{
+	*cx = 0;
+	*cy = 0;
+
+	const std::string extension = fs::u8path(path).extension().u8string();
+	for (const char *video : video_extensions) {
+		if (astrcmpi(extension.c_str(), video) == 0)
+			return true;
+	}
+
+	FILE *file = os_fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	bool animated = is_animated_gif(file, cx, cy);
+	if (!animated) {
+		rewind(file);
+		animated = is_animated_png(file, cx, cy);
+	}
+	fclose(file);
+	return animated;
+}
+
+// Caller holds the mutex
+static void queue_decode(lyrics_background_cache *cache, const std::string &image_path)
+{
+	if (image_path.empty() || cache->images.count(image_path))
+		return;
+
+	image_entry &entry = cache->images[image_path];
+	entry.id = cache->next_id++;
+	cache->requests.push_back({image_path, false});
+	cache->cond.notify_one();
+}
+
+static void decode_image(lyrics_background_cache *cache, const std::string &path)
+{
+	uint32_t cx, cy;
+	if (probe_animation(path, &cx, &cy)) {
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		auto it = cache->images.find(path);
+		if (it == cache->images.end() || it->second.probed)
+			return;
+
+		it->second.animated = true;
+		it->second.probed = true;
+		it->second.cx = cx;
+		it->second.cy = cy;
+		if (path == cache->default_path) {
+			cache->default_cx = cx;
+			cache->default_cy = cy;
+		}
+		return;
+	}
+
+	gs_image_file4_t *image = new gs_image_file4_t();
+	gs_image_file4_init(image, path.c_str(), GS_IMAGE_ALPHA_PREMULTIPLY);
+
+	const gs_image_file *const decoded = &image->image3.image2.image;
+	if (!decoded->loaded)
+		plugin_log(LOG_WARNING, "Failed to load background image '%s'", path.c_str());
+
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	auto it = cache->images.find(path);
+	if (it == cache->images.end() || it->second.image) {
+		// Only the first decode of a path is kept
+		cache->garbage.push_back(image);
+		return;
+	}
+
+	it->second.image = image;
+	it->second.failed = !decoded->loaded;
+	it->second.probed = true;
+	if (path == cache->default_path && decoded->loaded) {
+		cache->default_cx = decoded->cx;
+		cache->default_cy = decoded->cy;
+	}
+}
+
+static void worker_thread(lyrics_background_cache *cache)
+{
+	os_set_thread_name("lyrics-backgrounds");
+
+	for (;;) {
+		background_request request;
+		{
+			std::unique_lock<std::mutex> lock(cache->mutex);
+			cache->cond.wait(lock, [cache] { return cache->stopping || !cache->requests.empty(); });
+			if (cache->stopping)
+				break;
+			request = std::move(cache->requests.front());
+			cache->requests.pop_front();
+		}
+
+		if (!request.song) {
+			decode_image(cache, request.path);
+			continue;
+		}
+
+		const std::string image_path = find_sidecar(request.path);
+
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		cache->sidecars[request.path] = image_path;
+		queue_decode(cache, image_path);
+	}
+}
+
+lyrics_background_cache *lyrics_background_cache_create(void)
+{
+	lyrics_background_cache *cache = new lyrics_background_cache();
+	cache->thread = std::thread(worker_thread, cache);
+	return cache;
+}
+
+void lyrics_background_cache_destroy(lyrics_background_cache *cache)
+{
+	if (!cache)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		cache->stopping = true;
+	}
+	cache->cond.notify_one();
+	cache->thread.join();
+
+	obs_enter_graphics();
+	for (auto &pair : cache->images) {
+		if (pair.second.image) {
+			gs_image_file4_free(pair.second.image);
+			delete pair.second.image;
+		}
+	}
+	for (gs_image_file4_t *image : cache->garbage) {
+		gs_image_file4_free(image);
+		delete image;
+	}
+	obs_leave_graphics();
+
+	delete cache;
+}
+
+void lyrics_background_cache_configure(lyrics_background_cache *cache, uint64_t budget_bytes)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	cache->budget = budget_bytes;
+}
+
+void lyrics_background_cache_set_default(lyrics_background_cache *cache, const char *path)
+{
+	const std::string default_path = path ? path : "";
+
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	if (cache->default_path == default_path)
+		return;
+
+	cache->default_path = default_path;
+	cache->default_cx = 0;
+	cache->default_cy = 0;
+
+	auto it = cache->images.find(default_path);
+	if (it != cache->images.end() && it->second.animated) {
+		cache->default_cx = it->second.cx;
+		cache->default_cy = it->second.cy;
+	} else if (it != cache->images.end() && it->second.image && !it->second.failed) {
+		const gs_image_file *const decoded = &it->second.image->image3.image2.image;
+		cache->default_cx = decoded->cx;
+		cache->default_cy = decoded->cy;
+	}
+
+	// Jump the queue; the default shows for every song without a sidecar
+	if (!default_path.empty() && it == cache->images.end()) {
+		image_entry &entry = cache->images[default_path];
+		entry.id = cache->next_id++;
+		cache->requests.push_front({default_path, false});
+		cache->cond.notify_one();
+	}
+}
+
+bool lyrics_background_cache_default_size(lyrics_background_cache *cache, uint32_t *cx, uint32_t *cy)
+{
+	*cx = cache->default_cx;
+	*cy = cache->default_cy;
+	return *cx > 0 && *cy > 0;
+}
+
+void lyrics_background_cache_request(lyrics_background_cache *cache, const std::string &song_path)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+
+	auto it = cache->sidecars.find(song_path);
+	if (it != cache->sidecars.end()) {
+		// Known; make sure an evicted image comes back
+		queue_decode(cache, it->second);
+		return;
+	}
+
+	for (const background_request &request : cache->requests) {
+		if (request.song && request.path == song_path)
+			return;
+	}
+	cache->requests.push_back({song_path, true});
+	cache->cond.notify_one();
+}
+
+void lyrics_background_cache_forget_missing(lyrics_background_cache *cache)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	for (auto it = cache->sidecars.begin(); it != cache->sidecars.end();) {
+		if (it->second.empty())
+			it = cache->sidecars.erase(it);
+		else
+			++it;
+	}
+}
+
+void lyrics_background_cache_tick(lyrics_background_cache *cache)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	cache->tick++;
+
+	// Nothing changes between decodes, so most frames end here
+	bool has_uploads = false;
+	for (const auto &pair : cache->images) {
+		const image_entry &entry = pair.second;
+		has_uploads = has_uploads || (entry.image && !entry.failed && !entry.uploaded);
+	}
+	if (!has_uploads && cache->garbage.empty())
+		return;
+
+	obs_enter_graphics();
+
+	for (auto &pair : cache->images) {
+		image_entry &entry = pair.second;
+		if (!entry.image || entry.failed || entry.uploaded)
+			continue;
+
+		gs_image_file4_init_texture(entry.image);
+		const gs_image_file *const decoded = &entry.image->image3.image2.image;
+		entry.uploaded = true;
+		entry.bytes = (uint64_t)decoded->cx * decoded->cy * 4;
+		entry.last_used = cache->tick;
+	}
+
+	// Evict least recently used textures over budget, but never one that
+	// was drawn in the last frame
+	uint64_t total = 0;
+	for (const auto &pair : cache->images)
+		total += pair.second.uploaded ? pair.second.bytes : 0;
+
+	while (total > cache->budget) {
+		auto victim = cache->images.end();
+		for (auto it = cache->images.begin(); it != cache->images.end(); ++it) {
+			if (it->second.uploaded && it->second.last_used + 1 < cache->tick &&
+			    (victim == cache->images.end() || it->second.last_used < victim->second.last_used))
+				victim = it;
+		}
+		if (victim == cache->images.end())
+			break;
+
+		total -= victim->second.bytes;
+		cache->garbage.push_back(victim->second.image);
+		cache->images.erase(victim);
+	}
+
+	for (gs_image_file4_t *image : cache->garbage) {
+		gs_image_file4_free(image);
+		delete image;
+	}
+	cache->garbage.clear();
+
+	obs_leave_graphics();
+}
+
+// Caller holds the mutex. Returns whether the image can be shown.
+static bool lookup_image(lyrics_background_cache *cache, const std::string &image_path,
+			 lyrics_background *background)
+{
+	auto it = cache->images.find(image_path);
+	if (it == cache->images.end()) {
+		// Evicted; decode it again
+		queue_decode(cache, image_path);
+		background->pending = true;
+		return false;
+	}
+
+	image_entry &entry = it->second;
+	if (entry.animated) {
+		background->id = entry.id;
+		background->animation = image_path;
+		return true;
+	}
+	if (!entry.uploaded) {
+		background->pending = !entry.failed;
+		return false;
+	}
+
+	entry.last_used = cache->tick;
+	background->id = entry.id;
+	background->texture = entry.image->image3.image2.image.texture;
+	return true;
+}
+
+void lyrics_background_cache_get(lyrics_background_cache *cache, const std::string &song_path,
+				 lyrics_background *background)
+{
+	*background = lyrics_background();
+
+	std::lock_guard<std::mutex> lock(cache->mutex);
+
+	if (!song_path.empty()) {
+		auto sidecar = cache->sidecars.find(song_path);
+		if (sidecar == cache->sidecars.end()) {
+			background->pending = true;
+			return;
+		}
+		// A sidecar that failed to load falls back to the default
+		if (!sidecar->second.empty() &&
+		    (lookup_image(cache, sidecar->second, background) || background->pending))
+			return;
+	}
+
+	if (!cache->default_path.empty()) {
+		lookup_image(cache, cache->default_path, background);
+		background->is_default = true;
+	}
+}
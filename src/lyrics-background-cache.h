@@ -0,0 +1,46 @@
+#pragma once
+
+#include <obs-module.h>
+#include <string>
+
+// Background images, decoded on a worker thread and uploaded from video_tick.
+// Every song can have its own background: an image next to the song file with
+// the same name (song.txt -> song.png/.jpg/...). Songs without one use the
+// default background from the source settings. Uploaded textures are kept in
+// an LRU cache bounded by a VRAM budget.
+//
+// Animated GIFs and PNGs and videos are only recognized here; the source plays
+// them with a media source, so still images never pay for animation.
+struct lyrics_background_cache;
+
+struct lyrics_background {
+	uint64_t id = 0;                 // identifies the background, 0 for none
+	gs_texture_t *texture = nullptr; // still image
+	std::string animation;           // animated image or video to play instead
+	bool is_default = false;         // the default background, not the song's own
+	bool pending = false;            // still being looked up or decoded
+};
+
+lyrics_background_cache *lyrics_background_cache_create(void);
+void lyrics_background_cache_destroy(lyrics_background_cache *cache);
+
+void lyrics_background_cache_configure(lyrics_background_cache *cache, uint64_t budget_bytes);
+// Starts decoding the default background; empty for none
+void lyrics_background_cache_set_default(lyrics_background_cache *cache, const char *path);
+// Size of the default background once decoded. Any thread.
+bool lyrics_background_cache_default_size(lyrics_background_cache *cache, uint32_t *cx, uint32_t *cy);
+
+// Looks for the song's sidecar image and decodes it in the background.
+// Requests are served in order, so request the current song before prefetching.
+void lyrics_background_cache_request(lyrics_background_cache *cache, const std::string &song_path);
+// Forgets songs that had no sidecar, so images added since are found
+void lyrics_background_cache_forget_missing(lyrics_background_cache *cache);
+
+// File dialog filter listing every image and video type a background can be
+const char *lyrics_background_file_filter(void);
+
+// Graphics thread only
+void lyrics_background_cache_tick(lyrics_background_cache *cache);
+// Background for a song, or the default one for an empty path
+void lyrics_background_cache_get(lyrics_background_cache *cache, const std::string &song_path,
+				 lyrics_background *background);
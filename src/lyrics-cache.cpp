@@ -0,0 +1,234 @@
+#include "lyrics-cache.h"
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+
+#define CACHE_FILE "parse-cache.bin"
+#define CACHE_MAGIC 0x4352594cu // "LYRC"
+#define CACHE_VERSION 5u
+
+struct lyrics_cache {
+	std::mutex mutex;
+	std::unordered_map<std::string, lyrics_cache_entry> entries;
+	bool opened = false;
+	bool dirty = false;
+};
+
+static lyrics_cache cache;
+
+uint64_t lyrics_cache_hash(const char *data, size_t size)
+{
+	// FNV-1a, 64-bit
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (uint8_t)data[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static bool read_u32(FILE *file, uint32_t &val)
+{
+	return fread(&val, sizeof(val), 1, file) == 1;
+}
+
+static bool read_u64(FILE *file, uint64_t &val)
+{
+	return fread(&val, sizeof(val), 1, file) == 1;
+}
+
+static bool read_string(FILE *file, std::string &str)
+{
+	uint32_t len;
+	if (!read_u32(file, len))
+		return false;
+	str.resize(len);
+	return len == 0 || fread(&str[0], 1, len, file) == len;
+}
+
+static bool read_times(FILE *file, std::vector<int64_t> &times)
+{
+	uint32_t count;
+	if (!read_u32(file, count))
+		return false;
+	times.resize(count);
+	return count == 0 || fread(times.data(), sizeof(int64_t), count, file) == count;
+}
+
+static bool read_words(FILE *file, std::vector<lyrics_word_time> &words)
+{
+	uint32_t count;
+	if (!read_u32(file, count))
+		return false;
+	words.resize(count);
+	return count == 0 || fread(words.data(), sizeof(lyrics_word_time), count, file) == count;
+}
+
+static void write_u32(FILE *file, uint32_t val)
+{
+	fwrite(&val, sizeof(val), 1, file);
+}
+
+static void write_u64(FILE *file, uint64_t val)
+{
+	fwrite(&val, sizeof(val), 1, file);
+}
+
+static void write_string(FILE *file, const std::string &str)
+{
+	write_u32(file, (uint32_t)str.size());
+	fwrite(str.data(), 1, str.size(), file);
+}
+
+static void write_times(FILE *file, const std::vector<int64_t> &times)
+{
+	write_u32(file, (uint32_t)times.size());
+	fwrite(times.data(), sizeof(int64_t), times.size(), file);
+}
+
+static void write_words(FILE *file, const std::vector<lyrics_word_time> &words)
+{
+	write_u32(file, (uint32_t)words.size());
+	fwrite(words.data(), sizeof(lyrics_word_time), words.size(), file);
+}
+
+static void open_cache()
+{
+	if (cache.opened)
+		return;
+	cache.opened = true;
+
+	char *path = obs_module_config_path(CACHE_FILE);
+	FILE *file = path ? os_fopen(path, "rb") : nullptr;
+	bfree(path);
+	if (!file)
+		return;
+
+	uint32_t magic = 0, version = 0, count = 0;
+	bool ok = read_u32(file, magic) && read_u32(file, version) && read_u32(file, count) && magic == CACHE_MAGIC &&
+		  version == CACHE_VERSION;
+
+	for (uint32_t i = 0; ok && i < count; i++) {
+		std::string entry_path;
+		lyrics_cache_entry entry;
+		uint64_t mtime;
+
+		ok = read_string(file, entry_path) && read_u64(file, entry.size) && read_u64(file, mtime) &&
+		     read_u64(file, entry.hash) && read_string(file, entry.text) && read_times(file, entry.times) &&
+		     read_words(file, entry.words);
+		entry.mtime = (int64_t)mtime;
+
+		if (ok)
+			cache.entries.emplace(std::move(entry_path), std::move(entry));
+	}
+
+	fclose(file);
+
+	if (!ok) {
+		plugin_log(LOG_WARNING, "Lyrics parse cache is corrupt or outdated, rebuilding");
+		cache.entries.clear();
+	}
+}
+
+bool lyrics_cache_find(const std::string &path, uint64_t size, int64_t mtime, std::string &text,
+		       std::vector<int64_t> &times, std::vector<lyrics_word_time> &words)
+{
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	open_cache();
+
+	auto it = cache.entries.find(path);
+	if (it == cache.entries.end() || it->second.size != size || it->second.mtime != mtime)
+		return false;
+
+	text = it->second.text;
+	times = it->second.times;
+	words = it->second.words;
+	return true;
+}
+
+bool lyrics_cache_find_hash(const std::string &path, uint64_t size, int64_t mtime, uint64_t hash, std::string &text,
+			    std::vector<int64_t> &times, std::vector<lyrics_word_time> &words)
+{
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	open_cache();
+
+	auto it = cache.entries.find(path);
+	if (it == cache.entries.end() || it->second.size != size || it->second.hash != hash)
+		return false;
+
+	// Same content under a new timestamp, remember the new fingerprint
+	it->second.mtime = mtime;
+	cache.dirty = true;
+
+	text = it->second.text;
+	times = it->second.times;
+	words = it->second.words;
+	return true;
+}
+
+void lyrics_cache_store(const std::string &path, lyrics_cache_entry entry)
+{
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	open_cache();
+
+	cache.entries[path] = std::move(entry);
+	cache.dirty = true;
+}
+
+void lyrics_cache_flush()
+{
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	if (!cache.dirty)
+		return;
+
+	// Drop entries for files that no longer exist so the index does not grow forever
+	for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+		if (os_file_exists(it->first.c_str()))
+			++it;
+		else
+			it = cache.entries.erase(it);
+	}
+
+	char *dir = obs_module_config_path("");
+	if (dir)
+		os_mkdirs(dir);
+	bfree(dir);
+
+	char *path = obs_module_config_path(CACHE_FILE);
+	char *temp_path = obs_module_config_path(CACHE_FILE ".tmp");
+	FILE *file = temp_path ? os_fopen(temp_path, "wb") : nullptr;
+	if (!file) {
+		plugin_log(LOG_WARNING, "Failed to write lyrics parse cache");
+		bfree(path);
+		bfree(temp_path);
+		return;
+	}
+
+	write_u32(file, CACHE_MAGIC);
+	write_u32(file, CACHE_VERSION);
+	write_u32(file, (uint32_t)cache.entries.size());
+	for (const auto &pair : cache.entries) {
+		const lyrics_cache_entry &entry = pair.second;
+		write_string(file, pair.first);
+		write_u64(file, entry.size);
+		write_u64(file, (uint64_t)entry.mtime);
+		write_u64(file, entry.hash);
+		write_string(file, entry.text);
+		write_times(file, entry.times);
+		write_words(file, entry.words);
+	}
+
+	const bool ok = ferror(file) == 0;
+	fclose(file);
+
+	if (ok && os_rename(temp_path, path) == 0)
+		cache.dirty = false;
+	else
+		os_unlink(temp_path);
+
+	bfree(path);
+	bfree(temp_path);
+}
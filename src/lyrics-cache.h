@@ -0,0 +1,33 @@
+#pragma once
+
+#include "lyrics-library.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk cache of parsed lyrics files, shared by every lyrics source in the
+// module. Entries are fingerprinted by path, size, modification time and a
+// content hash; a file whose size and mtime match is served without being read,
+// and a file that was merely touched is revalidated by its hash.
+struct lyrics_cache_entry {
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	uint64_t hash = 0;
+	// Trimmed, non-empty lines, each followed by a NUL
+	std::string text;
+	// Start time in ms of every line for timed (.lrc) files, otherwise empty
+	std::vector<int64_t> times;
+	// Word times of enhanced LRC files, otherwise empty
+	std::vector<lyrics_word_time> words;
+};
+
+uint64_t lyrics_cache_hash(const char *data, size_t size);
+
+bool lyrics_cache_find(const std::string &path, uint64_t size, int64_t mtime, std::string &text,
+		       std::vector<int64_t> &times, std::vector<lyrics_word_time> &words);
+bool lyrics_cache_find_hash(const std::string &path, uint64_t size, int64_t mtime, uint64_t hash, std::string &text,
+			    std::vector<int64_t> &times, std::vector<lyrics_word_time> &words);
+void lyrics_cache_store(const std::string &path, lyrics_cache_entry entry);
+
+// Writes the cache index back to the plugin config dir if anything changed
+void lyrics_cache_flush();
@@ -0,0 +1,93 @@
+#include "lyrics-commands.h"
+#include <util/platform.h>
+
+// Vyukov's intrusive MPSC queue. Producers only touch head, the consumer only
+// touches tail; the stub node keeps the list non-empty so neither side ever
+// has to look at the other's end.
+struct lyrics_command_queue {
+	std::atomic<lyrics_command *> head;
+	lyrics_command *tail;
+	lyrics_command stub;
+
+	lyrics_command_queue() : head(&stub), tail(&stub) {}
+};
+
+lyrics_command_queue *lyrics_command_queue_create(void)
+{
+	return new lyrics_command_queue();
+}
+
+void lyrics_command_queue_destroy(lyrics_command_queue *queue)
+{
+	if (!queue)
+		return;
+
+	while (lyrics_command *command = lyrics_command_pop(queue))
+		delete command;
+	delete queue;
+}
+
+static void link_node(lyrics_command_queue *queue, lyrics_command *node)
+{
+	node->next.store(nullptr, std::memory_order_relaxed);
+	lyrics_command *prev = queue->head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+}
+
+void lyrics_command_push(lyrics_command_queue *queue, lyrics_command *command)
+{
+	if (!command->issued_ns)
+		command->issued_ns = os_gettime_ns();
+	link_node(queue, command);
+}
+
+void lyrics_command_push_batch(lyrics_command_queue *queue, lyrics_command *const *commands, size_t count)
+{
+	if (!count)
+		return;
+
+	const uint64_t now = os_gettime_ns();
+	for (size_t i = 0; i < count; i++) {
+		if (!commands[i]->issued_ns)
+			commands[i]->issued_ns = now;
+		commands[i]->next.store(i + 1 < count ? commands[i + 1] : nullptr, std::memory_order_relaxed);
+	}
+
+	// Same as link_node, but the chain goes in with a single exchange
+	lyrics_command *prev = queue->head.exchange(commands[count - 1], std::memory_order_acq_rel);
+	prev->next.store(commands[0], std::memory_order_release);
+}
+
+lyrics_command *lyrics_command_pop(lyrics_command_queue *queue)
+{
+	lyrics_command *tail = queue->tail;
+	lyrics_command *next = tail->next.load(std::memory_order_acquire);
+
+	if (tail == &queue->stub) {
+		if (!next)
+			return nullptr;
+		queue->tail = next;
+		tail = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+
+	if (next) {
+		queue->tail = next;
+		return tail;
+	}
+
+	// tail is the last linked node, unless a push has swapped head but not
+	// linked its node yet
+	if (tail != queue->head.load(std::memory_order_acquire))
+		return nullptr;
+
+	// Put the stub behind tail so tail can be handed out
+	link_node(queue, &queue->stub);
+
+	next = tail->next.load(std::memory_order_acquire);
+	if (next) {
+		queue->tail = next;
+		return tail;
+	}
+	return nullptr;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Navigation requests from hotkeys, proc handlers, media controls and linked
+// sources. They are queued and applied by video_tick, the only thread that
+// moves the position, so none of the callers ever waits on it.
+enum lyrics_command_type {
+	LYRICS_COMMAND_NEXT,
+	LYRICS_COMMAND_PREVIOUS,
+	LYRICS_COMMAND_GOTO,          // song, line
+	LYRICS_COMMAND_GOTO_LINE,     // line of the current song
+	LYRICS_COMMAND_GOTO_ABSOLUTE, // line counted across the whole library
+	LYRICS_COMMAND_TOGGLE,        // flip visibility
+	LYRICS_COMMAND_SHOW,          // visible
+	LYRICS_COMMAND_RESTART,       // first line of the library, visible
+	LYRICS_COMMAND_STOP,          // first line of the library, hidden
+	LYRICS_COMMAND_FOLLOW,        // path (or song), line, visible from a linked source
+};
+
+struct lyrics_command {
+	lyrics_command_type type = LYRICS_COMMAND_NEXT;
+	int song = 0;
+	int line = 0;
+	bool visible = true;
+	std::string path;
+	uint64_t issued_ns = 0; // start of the navigation latency measurement
+
+	std::atomic<lyrics_command *> next{nullptr};
+};
+
+// Intrusive multi-producer, single-consumer queue. Pushing is wait-free (one
+// exchange); popping never blocks, it returns null while a producer is
+// half-way through a push and that command is picked up on the next call.
+struct lyrics_command_queue;
+
+lyrics_command_queue *lyrics_command_queue_create(void);
+// Frees commands that were never popped
+void lyrics_command_queue_destroy(lyrics_command_queue *queue);
+
+// Takes ownership of command; stamps issued_ns if it is unset
+void lyrics_command_push(lyrics_command_queue *queue, lyrics_command *command);
+// Pushes commands as one unit: they become visible to the consumer together,
+// so a batch is normally applied within a single frame
+void lyrics_command_push_batch(lyrics_command_queue *queue, lyrics_command *const *commands, size_t count);
+// Consumer only; the caller deletes the returned command
+lyrics_command *lyrics_command_pop(lyrics_command_queue *queue);
@@ -0,0 +1,474 @@
+#include "lyrics-encoding.h"
+#include <util/c99defs.h>
+#include <QString>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LYRICS_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define LYRICS_NEON
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Bytes of the start of a file looked at to tell UTF-16 without BOM apart
+#define DETECT_BYTES 4096
+#define DROP ((char32_t)-1)
+
+// Windows-1252 0x80-0x9F; the rest of the upper half is Latin-1
+static const char16_t cp1252_high[32] = {
+	0x20AC, 0xFFFD, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160,
+	0x2039, 0x0152, 0xFFFD, 0x017D, 0xFFFD, 0xFFFD, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022,
+	0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0xFFFD, 0x017E, 0x0178,
+};
+
+static inline unsigned first_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (unsigned)index;
+#else
+	return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+static inline bool plain_byte(uint8_t c)
+{
+	return c < 0x80 && c != '\r' && c != 0;
+}
+
+// Length of the run of bytes that pass through unchanged in UTF-8 and
+// Windows-1252: ASCII other than NUL and CR
+static size_t ascii_run(const uint8_t *p, const uint8_t *end)
+{
+	const uint8_t *const start = p;
+
+#if defined(LYRICS_SSE2)
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i zero = _mm_setzero_si128();
+	while (end - p >= 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)p);
+		const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, zero));
+		// High bit set for non-ASCII bytes and for the specials
+		const unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(v, special));
+		if (mask)
+			return (size_t)(p - start) + first_bit(mask);
+		p += 16;
+	}
+#elif defined(LYRICS_NEON)
+	const uint8x16_t high = vdupq_n_u8(0x80);
+	const uint8x16_t cr = vdupq_n_u8('\r');
+	const uint8x16_t zero = vdupq_n_u8(0);
+	while (end - p >= 16) {
+		const uint8x16_t v = vld1q_u8(p);
+		const uint8x16_t special =
+			vorrq_u8(vcgeq_u8(v, high), vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, zero)));
+		if (vmaxvq_u8(special))
+			break;
+		p += 16;
+	}
+#endif
+
+	while (p < end && plain_byte(*p))
+		p++;
+	return (size_t)(p - start);
+}
+
+// Output that grows as needed; size is what was written so far
+struct output {
+	std::string &buffer;
+	size_t size = 0;
+
+	explicit output(std::string &target) : buffer(target) {}
+
+	char *reserve(size_t more)
+	{
+		if (size + more > buffer.size())
+			buffer.resize(std::max(buffer.size() * 2, size + more));
+		return &buffer[size];
+	}
+
+	void put(const uint8_t *data, size_t length)
+	{
+		memcpy(reserve(length), data, length);
+		size += length;
+	}
+
+	void put(char32_t cp)
+	{
+		char *out = reserve(4);
+		if (cp < 0x80) {
+			out[0] = (char)cp;
+			size += 1;
+		} else if (cp < 0x800) {
+			out[0] = (char)(0xC0 | (cp >> 6));
+			out[1] = (char)(0x80 | (cp & 0x3F));
+			size += 2;
+		} else if (cp < 0x10000) {
+			out[0] = (char)(0xE0 | (cp >> 12));
+			out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+			out[2] = (char)(0x80 | (cp & 0x3F));
+			size += 3;
+		} else {
+			out[0] = (char)(0xF0 | (cp >> 18));
+			out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+			out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+			out[3] = (char)(0x80 | (cp & 0x3F));
+			size += 4;
+		}
+	}
+};
+
+// What a codepoint becomes in the library: itself, another one, or DROP
+static char32_t normalize(char32_t cp)
+{
+	if (cp < 0x80)
+		return cp == 0 ? DROP : cp;
+
+	switch (cp) {
+	case 0x00A0: // no-break space
+	case 0x1680:
+	case 0x202F:
+	case 0x205F:
+	case 0x3000:
+		return ' ';
+	case 0x200B: // zero width space
+	case 0x2060: // word joiner
+	case 0xFEFF: // BOM inside the text, from concatenated files
+		return DROP;
+	case 0x0085:
+	case 0x2028:
+	case 0x2029:
+		return '\n';
+	case 0x2018:
+	case 0x2019:
+	case 0x201A:
+	case 0x201B:
+		return '\'';
+	case 0x201C:
+	case 0x201D:
+	case 0x201E:
+	case 0x201F:
+		return '"';
+	}
+	if (cp >= 0x2000 && cp <= 0x200A)
+		return ' ';
+	return cp;
+}
+
+// Conservative NFC quick check: false only for codepoints that never change
+// or combine under NFC. Everything below U+0300 is in that set, so Latin-1
+// text never takes the slow path.
+static bool may_need_nfc(char32_t cp)
+{
+	if (cp < 0x0300)
+		return false;
+	return (cp <= 0x036F) || cp == 0x0374 || cp == 0x037E || cp == 0x0387 || (cp >= 0x0483 && cp <= 0x0489) ||
+	       (cp >= 0x0591 && cp <= 0x05C7) || (cp >= 0x0610 && cp <= 0x061A) || (cp >= 0x064B && cp <= 0x065F) ||
+	       cp == 0x0670 || (cp >= 0x06D6 && cp <= 0x06ED) || (cp >= 0x0900 && cp <= 0x0DFF) ||
+	       (cp >= 0x0F00 && cp <= 0x0FFF) || (cp >= 0x1000 && cp <= 0x109F) || (cp >= 0x1100 && cp <= 0x11FF) ||
+	       (cp >= 0x1AB0 && cp <= 0x1AFF) || (cp >= 0x1B00 && cp <= 0x1B7F) || (cp >= 0x1DC0 && cp <= 0x1DFF) ||
+	       (cp >= 0x1F00 && cp <= 0x1FFF) || (cp >= 0x20D0 && cp <= 0x20FF) || cp == 0x2126 || cp == 0x212A ||
+	       cp == 0x212B || cp == 0x2ADC || (cp >= 0x302A && cp <= 0x302F) || cp == 0x3099 || cp == 0x309A ||
+	       (cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0xFB1D && cp <= 0xFB4F) || (cp >= 0xFE20 && cp <= 0xFE2F) ||
+	       (cp >= 0x1D15E && cp <= 0x1D1C0) || (cp >= 0x2F800 && cp <= 0x2FA1F);
+}
+
+// Decodes one multi-byte UTF-8 sequence, rejecting overlong forms, surrogates
+// and codepoints past U+10FFFF. Returns its length, 0 if invalid.
+static size_t decode_utf8(const uint8_t *p, const uint8_t *end, char32_t *cp)
+{
+	const uint8_t c = p[0];
+	size_t length;
+	char32_t value;
+	uint8_t lo = 0x80, hi = 0xBF;
+
+	if (c >= 0xC2 && c <= 0xDF) {
+		length = 2;
+		value = c & 0x1F;
+	} else if (c >= 0xE0 && c <= 0xEF) {
+		length = 3;
+		value = c & 0x0F;
+		if (c == 0xE0)
+			lo = 0xA0;
+		else if (c == 0xED)
+			hi = 0x9F;
+	} else if (c >= 0xF0 && c <= 0xF4) {
+		length = 4;
+		value = c & 0x07;
+		if (c == 0xF0)
+			lo = 0x90;
+		else if (c == 0xF4)
+			hi = 0x8F;
+	} else {
+		return 0;
+	}
+
+	if ((size_t)(end - p) < length || p[1] < lo || p[1] > hi)
+		return 0;
+	value = (value << 6) | (p[1] & 0x3F);
+	for (size_t i = 2; i < length; i++) {
+		if ((p[i] & 0xC0) != 0x80)
+			return 0;
+		value = (value << 6) | (p[i] & 0x3F);
+	}
+
+	*cp = value;
+	return length;
+}
+
+static inline char32_t cp1252(uint8_t c)
+{
+	return c >= 0x80 && c < 0xA0 ? (char32_t)cp1252_high[c - 0x80] : (char32_t)c;
+}
+
+lyrics_encoding lyrics_encoding_detect(const char *data, size_t size, size_t *bom_size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	*bom_size = 0;
+
+	if (size >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF) {
+		*bom_size = 3;
+		return LYRICS_ENCODING_UTF8;
+	}
+	if (size >= 2 && p[0] == 0xFF && p[1] == 0xFE) {
+		*bom_size = 2;
+		return LYRICS_ENCODING_UTF16LE;
+	}
+	if (size >= 2 && p[0] == 0xFE && p[1] == 0xFF) {
+		*bom_size = 2;
+		return LYRICS_ENCODING_UTF16BE;
+	}
+
+	// Mostly-ASCII UTF-16 has a zero in every other byte
+	const size_t sample = std::min(size, (size_t)DETECT_BYTES) & ~(size_t)1;
+	size_t even_zeros = 0, odd_zeros = 0;
+	for (size_t i = 0; i < sample; i += 2) {
+		even_zeros += p[i] == 0;
+		odd_zeros += p[i + 1] == 0;
+	}
+	const size_t units = sample / 2;
+	if (units >= 8) {
+		if (odd_zeros * 5 >= units * 2 && even_zeros * 20 < units)
+			return LYRICS_ENCODING_UTF16LE;
+		if (even_zeros * 5 >= units * 2 && odd_zeros * 20 < units)
+			return LYRICS_ENCODING_UTF16BE;
+	}
+	return LYRICS_ENCODING_UTF8;
+}
+
+struct decode_state {
+	output out;
+	bool copying = false; // false while the text is still identical to the input
+	bool needs_nfc = false;
+
+	explicit decode_state(std::string &scratch) : out(scratch) {}
+};
+
+// Windows-1252, and UTF-8 files that turned out not to be UTF-8
+static void decode_cp1252(const uint8_t *p, const uint8_t *end, decode_state &state)
+{
+	state.copying = true;
+	state.out.reserve((size_t)(end - p));
+	while (p < end) {
+		const size_t run = ascii_run(p, end);
+		state.out.put(p, run);
+		p += run;
+		if (p >= end)
+			break;
+
+		const uint8_t c = *p++;
+		if (c == '\r') {
+			state.out.put(p < end && *p == '\n' ? U'\r' : U'\n');
+			continue;
+		}
+		const char32_t mapped = normalize(cp1252(c));
+		if (mapped != DROP)
+			state.out.put(mapped);
+	}
+}
+
+// Copies nothing until the first change; up to there the input is the output
+static bool decode_utf8_text(const uint8_t *start, const uint8_t *end, bool had_bom, decode_state &state)
+{
+	const uint8_t *p = start;
+	const uint8_t *pending = start; // first byte not yet copied
+	bool multibyte = false;
+
+	auto replace = [&](size_t length, char32_t with) {
+		if (!state.copying)
+			state.out.reserve((size_t)(end - start));
+		state.copying = true;
+		state.out.put(pending, (size_t)(p - pending));
+		if (with != DROP)
+			state.out.put(with);
+		p += length;
+		pending = p;
+	};
+
+	while (p < end) {
+		p += ascii_run(p, end);
+		if (p >= end)
+			break;
+
+		const uint8_t c = *p;
+		if (c == '\r') {
+			if (p + 1 < end && p[1] == '\n')
+				p++;
+			else
+				replace(1, '\n');
+			continue;
+		}
+		if (c == 0) {
+			replace(1, DROP);
+			continue;
+		}
+
+		char32_t cp;
+		const size_t length = decode_utf8(p, end, &cp);
+		if (!length) {
+			// No valid sequence before the first invalid one: not UTF-8
+			if (!multibyte && !had_bom)
+				return false;
+			// A stray Windows-1252 byte in an otherwise UTF-8 file
+			replace(1, normalize(cp1252(c)));
+			continue;
+		}
+
+		multibyte = true;
+		state.needs_nfc = state.needs_nfc || may_need_nfc(cp);
+		const char32_t mapped = normalize(cp);
+		if (mapped == cp)
+			p += length;
+		else
+			replace(length, mapped);
+	}
+
+	if (state.copying)
+		state.out.put(pending, (size_t)(end - pending));
+	return true;
+}
+
+// Eight UTF-16 units at a time while they are plain ASCII
+static size_t utf16_ascii_run(const uint8_t *p, const uint8_t *end, bool big_endian, output &out)
+{
+	const uint8_t *const start = p;
+
+#if defined(LYRICS_SSE2)
+	const __m128i non_ascii = _mm_set1_epi16((short)0xFF80);
+	const __m128i cr = _mm_set1_epi16('\r');
+	const __m128i zero = _mm_setzero_si128();
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		if (big_endian)
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		const __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(v, non_ascii), zero);
+		const __m128i special = _mm_or_si128(_mm_cmpeq_epi16(v, cr), _mm_cmpeq_epi16(v, zero));
+		if (_mm_movemask_epi8(_mm_andnot_si128(special, ascii)) != 0xFFFF)
+			break;
+		_mm_storel_epi64((__m128i *)out.reserve(8), _mm_packus_epi16(v, v));
+		out.size += 8;
+		p += 16;
+	}
+#elif defined(LYRICS_NEON)
+	const uint16x8_t non_ascii = vdupq_n_u16(0xFF80);
+	const uint16x8_t cr = vdupq_n_u16('\r');
+	const uint16x8_t zero = vdupq_n_u16(0);
+	while (end - p >= 16) {
+		uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(p));
+		if (big_endian)
+			v = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v)));
+		const uint16x8_t bad =
+			vorrq_u16(vtstq_u16(v, non_ascii), vorrq_u16(vceqq_u16(v, cr), vceqq_u16(v, zero)));
+		if (vmaxvq_u16(bad))
+			break;
+		vst1_u8((uint8_t *)out.reserve(8), vmovn_u16(v));
+		out.size += 8;
+		p += 16;
+	}
+#else
+	UNUSED_PARAMETER(end);
+	UNUSED_PARAMETER(big_endian);
+	UNUSED_PARAMETER(out);
+#endif
+
+	return (size_t)(p - start);
+}
+
+static void decode_utf16(const uint8_t *p, const uint8_t *end, bool big_endian, decode_state &state)
+{
+	state.copying = true;
+	state.out.reserve((size_t)(end - p));
+
+	auto unit = [big_endian](const uint8_t *q) -> char32_t {
+		return big_endian ? (char32_t)(q[0] << 8 | q[1]) : (char32_t)(q[1] << 8 | q[0]);
+	};
+
+	while (end - p >= 2) {
+		p += utf16_ascii_run(p, end, big_endian, state.out);
+		if (end - p < 2)
+			break;
+
+		char32_t cp = unit(p);
+		p += 2;
+		if (cp >= 0xD800 && cp <= 0xDBFF) {
+			const char32_t low = end - p >= 2 ? unit(p) : 0;
+			if (low >= 0xDC00 && low <= 0xDFFF) {
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				p += 2;
+			} else {
+				cp = 0xFFFD;
+			}
+		} else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+			cp = 0xFFFD;
+		} else if (cp == '\r') {
+			if (!(end - p >= 2 && unit(p) == '\n'))
+				cp = '\n';
+		}
+
+		state.needs_nfc = state.needs_nfc || may_need_nfc(cp);
+		const char32_t mapped = normalize(cp);
+		if (mapped != DROP)
+			state.out.put(mapped);
+	}
+}
+
+const char *lyrics_encoding_decode(const char *data, size_t size, std::string &scratch, size_t *out_size)
+{
+	size_t bom_size;
+	const lyrics_encoding encoding = lyrics_encoding_detect(data, size, &bom_size);
+	const uint8_t *const start = (const uint8_t *)data + bom_size;
+	const uint8_t *const end = (const uint8_t *)data + size;
+
+	scratch.clear();
+	decode_state state(scratch);
+	if (encoding == LYRICS_ENCODING_UTF16LE || encoding == LYRICS_ENCODING_UTF16BE) {
+		decode_utf16(start, end, encoding == LYRICS_ENCODING_UTF16BE, state);
+	} else if (!decode_utf8_text(start, end, bom_size != 0, state)) {
+		state.out.size = 0;
+		state.needs_nfc = false;
+		decode_cp1252(start, end, state);
+	}
+
+	const char *text = state.copying ? scratch.data() : (const char *)start;
+	size_t length = state.copying ? state.out.size : (size_t)(end - start);
+
+	// Combining marks, Hangul jamo and the like: compose the whole text
+	if (state.needs_nfc) {
+		const QByteArray composed =
+			QString::fromUtf8(text, (qsizetype)length).normalized(QString::NormalizationForm_C).toUtf8();
+		scratch.assign(composed.constData(), (size_t)composed.size());
+		text = scratch.data();
+		length = scratch.size();
+	}
+
+	*out_size = length;
+	return text;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+// Turns a lyrics file of whatever encoding into the normalized UTF-8 the
+// parsers expect, in one pass over the bytes:
+// - UTF-8 with or without BOM, UTF-16 LE/BE (BOM or zero-byte pattern) and
+//   Windows-1252, which is assumed for files that are not valid UTF-8
+// - non-breaking and other Unicode spaces become ' ', zero-width spaces and
+//   stray BOMs are dropped, Unicode line separators and lone CRs become '\n'
+// - curly quotes become straight ones
+// - text that may not be in NFC is composed
+// ASCII runs are scanned 16 bytes at a time with SSE2 or NEON where available.
+enum lyrics_encoding {
+	LYRICS_ENCODING_UTF8,
+	LYRICS_ENCODING_UTF16LE,
+	LYRICS_ENCODING_UTF16BE,
+	LYRICS_ENCODING_WINDOWS_1252,
+};
+
+// Encoding from the BOM, or guessed from the content. bom_size is the number
+// of bytes to skip. Windows-1252 is only detected while decoding.
+lyrics_encoding lyrics_encoding_detect(const char *data, size_t size, size_t *bom_size);
+
+// Returns the normalized text and sets out_size: data itself, past any BOM,
+// when nothing needed to change (the common case, no copy), otherwise the
+// contents of scratch.
+const char *lyrics_encoding_decode(const char *data, size_t size, std::string &scratch, size_t *out_size);
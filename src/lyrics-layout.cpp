@@ -0,0 +1,603 @@
+#include "lyrics-layout.h"
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <QFont>
+#include <QRawFont>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Advances are measured once at this pixel size and scaled linearly
+#define REFERENCE_SIZE 64
+// Codepoints below this (Latin, Greek, Cyrillic) are measured up front
+#define TABLE_SIZE 0x500
+// Shrinking stops here; anything that still does not fit is clipped
+#define MIN_FONT_SIZE 8
+// Pages of the last line of a timed song have no next timestamp to share
+#define LAST_PAGE_MS 2000
+
+struct lyrics_font_metrics {
+	float advances[TABLE_SIZE]; // at REFERENCE_SIZE
+	float line_height;
+
+	// Codepoints outside the table are measured on first use
+	std::mutex mutex;
+	QRawFont font;
+	std::unordered_map<char32_t, float> extra;
+
+	float advance(char32_t codepoint);
+};
+
+// Fonts in use by some layouter; metrics go away with the last one using them
+static std::mutex fonts_mutex;
+static std::map<std::pair<std::string, int>, std::weak_ptr<lyrics_font_metrics>> fonts;
+
+// Paginated libraries in use by some source, so sources that share a parsed
+// library and lay it out the same way share the pages too
+struct pages_entry {
+	std::weak_ptr<const lyrics_library> parsed;
+	lyrics_layout_spec spec;
+	std::weak_ptr<const lyrics_library> pages;
+};
+
+static std::mutex pages_mutex;
+static std::vector<pages_entry> pages_cache;
+
+static void measure_codepoints(const QRawFont &font, const char32_t *codepoints, size_t count, float *advances)
+{
+	if (!font.isValid()) {
+		std::fill(advances, advances + count, REFERENCE_SIZE * 0.5f);
+		return;
+	}
+
+	const QList<quint32> glyphs = font.glyphIndexesForString(QString::fromUcs4(codepoints, (qsizetype)count));
+	const QList<QPointF> glyph_advances = font.advancesForGlyphIndexes(glyphs);
+	if ((size_t)glyph_advances.size() == count) {
+		for (size_t i = 0; i < count; i++)
+			advances[i] = (float)glyph_advances[i].x();
+		return;
+	}
+
+	// Not one glyph per codepoint; measure them one at a time
+	for (size_t i = 0; i < count; i++) {
+		float width = 0.0f;
+		const QList<quint32> glyph = font.glyphIndexesForString(QString::fromUcs4(codepoints + i, 1));
+		for (const QPointF &advance : font.advancesForGlyphIndexes(glyph))
+			width += (float)advance.x();
+		advances[i] = width;
+	}
+}
+
+float lyrics_font_metrics::advance(char32_t codepoint)
+{
+	if (codepoint < TABLE_SIZE)
+		return advances[codepoint];
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = extra.find(codepoint);
+	if (it != extra.end())
+		return it->second;
+
+	float width;
+	measure_codepoints(font, &codepoint, 1, &width);
+	extra.emplace(codepoint, width);
+	return width;
+}
+
+static std::shared_ptr<lyrics_font_metrics> get_font_metrics(const std::string &face, int weight)
+{
+	std::lock_guard<std::mutex> lock(fonts_mutex);
+	std::weak_ptr<lyrics_font_metrics> &slot = fonts[{face, weight}];
+	if (std::shared_ptr<lyrics_font_metrics> metrics = slot.lock())
+		return metrics;
+
+	std::shared_ptr<lyrics_font_metrics> metrics = std::make_shared<lyrics_font_metrics>();
+	QFont font(QString::fromStdString(face));
+	font.setPixelSize(REFERENCE_SIZE);
+	font.setWeight((QFont::Weight)weight);
+	metrics->font = QRawFont::fromFont(font);
+
+	if (metrics->font.isValid()) {
+		metrics->line_height =
+			(float)(metrics->font.ascent() + metrics->font.descent() + metrics->font.leading());
+	} else {
+		plugin_log(LOG_WARNING, "Font '%s' not found, line layout uses estimated widths", face.c_str());
+		metrics->line_height = REFERENCE_SIZE * 1.2f;
+	}
+
+	char32_t codepoints[TABLE_SIZE - 0x20];
+	for (char32_t i = 0; i < TABLE_SIZE - 0x20; i++)
+		codepoints[i] = i + 0x20;
+	std::fill(metrics->advances, metrics->advances + 0x20, 0.0f);
+	measure_codepoints(metrics->font, codepoints, TABLE_SIZE - 0x20, metrics->advances + 0x20);
+
+	slot = metrics;
+	return metrics;
+}
+
+char32_t lyrics_layout_next_codepoint(const uint8_t *&p, const uint8_t *end)
+{
+	const uint8_t lead = *p++;
+	if (lead < 0x80)
+		return lead;
+
+	char32_t codepoint;
+	int continuation;
+	if ((lead & 0xE0) == 0xC0) {
+		codepoint = lead & 0x1F;
+		continuation = 1;
+	} else if ((lead & 0xF0) == 0xE0) {
+		codepoint = lead & 0x0F;
+		continuation = 2;
+	} else if ((lead & 0xF8) == 0xF0) {
+		codepoint = lead & 0x07;
+		continuation = 3;
+	} else {
+		return 0xFFFD;
+	}
+
+	while (continuation-- > 0 && p < end && (*p & 0xC0) == 0x80)
+		codepoint = codepoint << 6 | (*p++ & 0x3F);
+	return codepoint;
+}
+
+static void measure_line(lyrics_font_metrics &metrics, const char *text, uint32_t length,
+			 std::vector<lyrics_layout_glyph> &glyphs)
+{
+	glyphs.clear();
+
+	const uint8_t *const begin = (const uint8_t *)text;
+	const uint8_t *const end = begin + length;
+	for (const uint8_t *p = begin; p < end;) {
+		const uint32_t offset = (uint32_t)(p - begin);
+		const char32_t codepoint = lyrics_layout_next_codepoint(p, end);
+		const bool space = codepoint == ' ' || codepoint == '\t';
+		glyphs.push_back({offset, codepoint, metrics.advance(codepoint), space});
+	}
+}
+
+void lyrics_layout_wrap(const std::vector<lyrics_layout_glyph> &glyphs, float max_width,
+			std::vector<lyrics_layout_row> &rows)
+{
+	rows.clear();
+
+	bool row_open = false;
+	lyrics_layout_row row = {0, 0, 0.0f};
+
+	uint32_t i = 0;
+	const uint32_t count = (uint32_t)glyphs.size();
+	while (i < count) {
+		float space = 0.0f;
+		while (i < count && glyphs[i].space)
+			space += glyphs[i++].advance;
+		if (i == count)
+			break;
+
+		uint32_t word_end = i;
+		float word = 0.0f;
+		while (word_end < count && !glyphs[word_end].space)
+			word += glyphs[word_end++].advance;
+
+		if (row_open && row.width + space + word <= max_width) {
+			row.width += space + word;
+		} else {
+			if (row_open)
+				rows.push_back(row);
+			row_open = true;
+			row.begin = i;
+			row.width = 0.0f;
+
+			for (uint32_t k = i; k < word_end; k++) {
+				if (row.width > 0.0f && row.width + glyphs[k].advance > max_width) {
+					row.end = k;
+					rows.push_back(row);
+					row.begin = k;
+					row.width = 0.0f;
+				}
+				row.width += glyphs[k].advance;
+			}
+		}
+
+		row.end = word_end;
+		i = word_end;
+	}
+
+	if (row_open)
+		rows.push_back(row);
+}
+
+struct layout_box {
+	float width;  // in pixels, inside the outline
+	float height;
+	float line_height; // at REFERENCE_SIZE
+};
+
+// Rows of text that fit the box height at size
+static size_t rows_per_box(const layout_box &box, int size)
+{
+	return (size_t)std::floor(box.height * REFERENCE_SIZE / (box.line_height * (float)size));
+}
+
+static bool fits(const layout_box &box, const std::vector<lyrics_layout_glyph> &glyphs, int size,
+		 std::vector<lyrics_layout_row> &rows)
+{
+	lyrics_layout_wrap(glyphs, box.width * REFERENCE_SIZE / (float)size, rows);
+	return rows.size() <= rows_per_box(box, size);
+}
+
+// Largest size up to the configured one at which the line fits
+static int fit_size(const layout_box &box, const std::vector<lyrics_layout_glyph> &glyphs, int size,
+		    std::vector<lyrics_layout_row> &rows)
+{
+	if (fits(box, glyphs, size, rows))
+		return size;
+
+	int best = MIN_FONT_SIZE;
+	int low = MIN_FONT_SIZE + 1;
+	int high = size - 1;
+	while (low <= high) {
+		const int mid = (low + high) / 2;
+		if (fits(box, glyphs, mid, rows)) {
+			best = mid;
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return best;
+}
+
+static bool cancelled(const std::atomic<bool> *cancel)
+{
+	return cancel && *cancel;
+}
+
+// Sizes of the lines of parsed that need a smaller font, left empty when none
+// do. Returns false as soon as cancel is set.
+static bool shrink_lines(const lyrics_library &parsed, lyrics_font_metrics &metrics, const layout_box &box, int size,
+			 const std::atomic<bool> *cancel, std::vector<uint16_t> &sizes, size_t &changed)
+{
+	std::vector<lyrics_layout_glyph> glyphs;
+	std::vector<lyrics_layout_row> rows;
+
+	for (const lyrics_song &song : parsed.songs) {
+		if (cancelled(cancel))
+			return false;
+
+		for (size_t i = song.first_line; i < song.first_line + song.line_count; i++) {
+			const lyrics_line_span &span = parsed.lines[i];
+			measure_line(metrics, parsed.arena.data() + span.offset, span.length, glyphs);
+			const int line_size = fit_size(box, glyphs, size, rows);
+			if (line_size != size) {
+				sizes.resize(parsed.lines.size(), 0);
+				sizes[i] = (uint16_t)line_size;
+				changed++;
+			}
+		}
+	}
+	return true;
+}
+
+// Null as soon as cancel is set
+static std::shared_ptr<const lyrics_library> paginate_library(const std::shared_ptr<const lyrics_library> &parsed,
+							      lyrics_font_metrics &metrics, const layout_box &box,
+							      int size, const std::atomic<bool> *cancel,
+							      size_t &changed)
+{
+	std::shared_ptr<lyrics_library> library = std::make_shared<lyrics_library>();
+	library->catalog = parsed->catalog;
+	library->load_time_ns = parsed->load_time_ns;
+
+	const size_t per_page = std::max(rows_per_box(box, size), (size_t)1);
+	std::vector<lyrics_layout_glyph> glyphs;
+	std::vector<lyrics_layout_row> rows;
+	std::string text;
+	std::vector<int64_t> times;
+	std::vector<lyrics_word_time> words;
+
+	for (size_t s = 0; s < parsed->songs.size(); s++) {
+		if (cancelled(cancel))
+			return nullptr;
+
+		const lyrics_song &song = parsed->songs[s];
+		const bool timed = parsed->song_timed(s);
+		text.clear();
+		times.clear();
+		words.clear();
+		uint32_t page_line = 0; // line of the new song
+
+		for (uint32_t l = 0; l < song.line_count; l++) {
+			const char *line = parsed->line_text(s, l);
+			const uint32_t length = parsed->lines[song.first_line + l].length;
+			size_t word_count;
+			const lyrics_word_time *line_words =
+				lyrics_library_line_words(*parsed, (int)s, (int)l, &word_count);
+			measure_line(metrics, line, length, glyphs);
+			fits(box, glyphs, size, rows);
+
+			if (rows.size() <= per_page) {
+				text.append(line, length);
+				text.push_back('\0');
+				if (timed)
+					times.push_back(parsed->song_times(s)[l]);
+				for (size_t w = 0; w < word_count; w++)
+					words.push_back({page_line, line_words[w].offset, line_words[w].time});
+				page_line++;
+				continue;
+			}
+
+			// Pages of a timed line share its time until the next line, except
+			// that a page of timed words turns when its first word is sung
+			const size_t pages = (rows.size() + per_page - 1) / per_page;
+			const int64_t start = timed ? parsed->song_times(s)[l] : 0;
+			const int64_t next = timed && l + 1 < song.line_count ? parsed->song_times(s)[l + 1]
+									     : start + LAST_PAGE_MS * (int64_t)pages;
+			size_t w = 0;
+			for (size_t page = 0; page < pages; page++) {
+				const lyrics_layout_row &first = rows[page * per_page];
+				const lyrics_layout_row &last = rows[std::min((page + 1) * per_page, rows.size()) - 1];
+				const uint32_t begin = glyphs[first.begin].offset;
+				const uint32_t end = last.end < glyphs.size() ? glyphs[last.end].offset : length;
+				text.append(line + begin, end - begin);
+				text.push_back('\0');
+
+				// Words in the spaces between pages go to the next page, a closing tag to the last
+				const size_t page_word = words.size();
+				for (; w < word_count && (line_words[w].offset < end || page + 1 == pages); w++) {
+					const uint32_t offset = std::max(line_words[w].offset, begin) - begin;
+					words.push_back({page_line, std::min(offset, end - begin), line_words[w].time});
+				}
+
+				if (timed) {
+					int64_t time = start + (next - start) * (int64_t)page / (int64_t)pages;
+					if (page > 0 && page_word < words.size())
+						time = std::max(words[page_word].time, times.back());
+					times.push_back(time);
+				}
+				page_line++;
+			}
+			changed++;
+		}
+
+		lyrics_library_add_song(*library, text.data(), text.size(), timed ? times.data() : nullptr,
+					words.data(), words.size(), song.name, song.path);
+	}
+
+	if (!changed)
+		return parsed;
+
+	library->search = lyrics_search_build(*library, parsed.get());
+	return library;
+}
+
+// Pages of parsed laid out with spec if another source has them, dropping
+// entries whose pages are gone
+static std::shared_ptr<const lyrics_library> find_pages(const std::shared_ptr<const lyrics_library> &parsed,
+							const lyrics_layout_spec &spec)
+{
+	std::lock_guard<std::mutex> lock(pages_mutex);
+	std::shared_ptr<const lyrics_library> found;
+	auto expired = std::remove_if(pages_cache.begin(), pages_cache.end(), [&](const pages_entry &entry) {
+		std::shared_ptr<const lyrics_library> pages = entry.pages.lock();
+		if (pages && !found && entry.spec == spec && entry.parsed.lock() == parsed)
+			found = std::move(pages);
+		return entry.pages.expired();
+	});
+	pages_cache.erase(expired, pages_cache.end());
+	return found;
+}
+
+static void add_pages(const std::shared_ptr<const lyrics_library> &parsed, const lyrics_layout_spec &spec,
+		      const std::shared_ptr<const lyrics_library> &pages)
+{
+	std::lock_guard<std::mutex> lock(pages_mutex);
+	pages_cache.push_back({parsed, spec, pages});
+}
+
+std::shared_ptr<const lyrics_layout> lyrics_layout_apply(const std::shared_ptr<const lyrics_library> &parsed,
+							 const lyrics_layout_spec &spec,
+							 const std::atomic<bool> *cancel)
+{
+	std::shared_ptr<lyrics_layout> layout = std::make_shared<lyrics_layout>();
+	layout->library = parsed;
+	if (spec.mode == LYRICS_FIT_NONE || spec.size <= 0 || spec.width <= 0 || spec.height <= 0)
+		return layout;
+
+	if (spec.mode == LYRICS_FIT_PAGINATE) {
+		if (std::shared_ptr<const lyrics_library> pages = find_pages(parsed, spec)) {
+			layout->library = std::move(pages);
+			return layout;
+		}
+	}
+
+	const uint64_t start = os_gettime_ns();
+	const std::shared_ptr<lyrics_font_metrics> metrics = get_font_metrics(spec.face, spec.weight);
+
+	// The outline grows every glyph on both sides
+	layout_box box;
+	box.width = (float)std::max(spec.width - 2 * spec.outline, 1);
+	box.height = (float)std::max(spec.height - 2 * spec.outline, 1);
+	box.line_height = metrics->line_height;
+
+	size_t changed = 0;
+	if (spec.mode == LYRICS_FIT_SHRINK) {
+		if (!shrink_lines(*parsed, *metrics, box, spec.size, cancel, layout->line_sizes, changed))
+			return nullptr;
+	} else {
+		layout->library = paginate_library(parsed, *metrics, box, spec.size, cancel, changed);
+		if (!layout->library)
+			return nullptr;
+		add_pages(parsed, spec, layout->library);
+	}
+
+	const double elapsed_ms = (double)(os_gettime_ns() - start) / 1000000.0;
+	plugin_log(LOG_INFO, "Laid out %zu lines in %.2f ms: %zu %s", parsed->lines.size(), elapsed_ms, changed,
+		   spec.mode == LYRICS_FIT_SHRINK ? "shrunk to fit" : "split into pages");
+	return layout;
+}
+
+void lyrics_layout_set_font_size(obs_data_t *settings, obs_data_t *style, int size)
+{
+	obs_data_t *font = obs_data_get_obj(style, "font");
+	obs_data_t *sized = obs_data_create();
+	if (font)
+		obs_data_apply(sized, font);
+	obs_data_set_int(sized, "size", size);
+	obs_data_set_obj(settings, "font", sized);
+	obs_data_release(sized);
+	obs_data_release(font);
+}
+
+struct lyrics_layouter {
+	lyrics_layout_done_t done;
+	void *param;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::shared_ptr<const lyrics_library> parsed;
+	lyrics_layout_spec spec;
+	bool has_pending = false;
+	bool stopping = false;
+	std::thread thread;
+
+	// Set along with has_pending and when stopping; the layout in flight is
+	// stale then, and gives up at its next song
+	std::atomic<bool> cancel{false};
+	std::atomic<bool> finished{false};
+	// Held while done runs, so once destroy took it no callback can follow
+	std::mutex callback_mutex;
+};
+
+static void layout_thread(lyrics_layouter *layouter)
+{
+	os_set_thread_name("lyrics-layout");
+
+	for (;;) {
+		std::shared_ptr<const lyrics_library> parsed;
+		lyrics_layout_spec spec;
+		{
+			std::unique_lock<std::mutex> lock(layouter->mutex);
+			layouter->cond.wait(lock, [layouter] { return layouter->stopping || layouter->has_pending; });
+			if (layouter->stopping)
+				break;
+
+			parsed = layouter->parsed;
+			spec = layouter->spec;
+			layouter->has_pending = false;
+			layouter->cancel = false;
+		}
+
+		if (!parsed)
+			continue;
+
+		std::shared_ptr<const lyrics_layout> layout = lyrics_layout_apply(parsed, spec, &layouter->cancel);
+		if (!layout)
+			continue;
+
+		// Skip publishing a layout that a newer request has already made stale
+		{
+			std::lock_guard<std::mutex> lock(layouter->mutex);
+			if (layouter->stopping)
+				break;
+			if (layouter->has_pending)
+				continue;
+		}
+
+		std::lock_guard<std::mutex> lock(layouter->callback_mutex);
+		if (layouter->cancel)
+			continue;
+		layouter->done(layouter->param, std::move(layout));
+	}
+
+	layouter->finished = true;
+}
+
+// Stopped layouters whose threads may still be finishing a layout. They are
+// joined once finished, by the next destroy, or at module unload.
+static std::mutex retired_mutex;
+static std::vector<lyrics_layouter *> retired;
+
+static void reap(bool wait)
+{
+	std::vector<lyrics_layouter *> done;
+	{
+		std::lock_guard<std::mutex> lock(retired_mutex);
+		auto keep = std::partition(retired.begin(), retired.end(),
+					   [wait](lyrics_layouter *layouter) { return !wait && !layouter->finished; });
+		done.assign(keep, retired.end());
+		retired.erase(keep, retired.end());
+	}
+
+	for (lyrics_layouter *layouter : done) {
+		layouter->thread.join();
+		delete layouter;
+	}
+}
+
+lyrics_layouter *lyrics_layouter_create(lyrics_layout_done_t done, void *param)
+{
+	lyrics_layouter *layouter = new lyrics_layouter();
+	layouter->done = done;
+	layouter->param = param;
+	layouter->thread = std::thread(layout_thread, layouter);
+	return layouter;
+}
+
+void lyrics_layouter_destroy(lyrics_layouter *layouter)
+{
+	if (!layouter)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(layouter->mutex);
+		layouter->stopping = true;
+		layouter->cancel = true;
+	}
+	layouter->cond.notify_one();
+
+	// Waits for a callback that is running, never for a layout
+	{
+		std::lock_guard<std::mutex> lock(layouter->callback_mutex);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(retired_mutex);
+		retired.push_back(layouter);
+	}
+	reap(false);
+}
+
+void lyrics_layouter_free_all(void)
+{
+	reap(true);
+}
+
+void lyrics_layouter_set_library(lyrics_layouter *layouter, std::shared_ptr<const lyrics_library> parsed)
+{
+	{
+		std::lock_guard<std::mutex> lock(layouter->mutex);
+		layouter->parsed = std::move(parsed);
+		layouter->has_pending = true;
+		layouter->cancel = true;
+	}
+	layouter->cond.notify_one();
+}
+
+void lyrics_layouter_set_spec(lyrics_layouter *layouter, const lyrics_layout_spec &spec)
+{
+	{
+		std::lock_guard<std::mutex> lock(layouter->mutex);
+		if (layouter->spec == spec)
+			return;
+		layouter->spec = spec;
+		layouter->has_pending = true;
+		layouter->cancel = true;
+	}
+	layouter->cond.notify_one();
+}
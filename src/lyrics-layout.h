@@ -0,0 +1,96 @@
+#pragma once
+
+#include "lyrics-library.h"
+#include <obs-module.h>
+
+// What happens to lines that do not fit the text box
+enum lyrics_fit_mode {
+	LYRICS_FIT_NONE,     // left to the text source, which clips them
+	LYRICS_FIT_SHRINK,   // shown at the largest font size that fits
+	LYRICS_FIT_PAGINATE, // split into several slides
+};
+
+// Everything the layout depends on. Without a fit mode the rest is ignored.
+struct lyrics_layout_spec {
+	int mode = LYRICS_FIT_NONE;
+	std::string face;
+	int weight = 400;
+	int size = 0;
+	int width = 0;
+	int height = 0;
+	int outline = 0; // outline size in pixels, 0 without outline
+
+	bool operator==(const lyrics_layout_spec &other) const
+	{
+		return mode == other.mode && face == other.face && weight == other.weight && size == other.size &&
+		       width == other.width && height == other.height && outline == other.outline;
+	}
+	bool operator!=(const lyrics_layout_spec &other) const { return !(*this == other); }
+};
+
+// One codepoint of a line, with its advance at whatever size it was measured
+struct lyrics_layout_glyph {
+	uint32_t offset; // of its first byte in the line
+	char32_t codepoint;
+	float advance;
+	bool space;
+};
+
+// Glyphs [begin, end) of one wrapped row, without the spaces around it
+struct lyrics_layout_row {
+	uint32_t begin;
+	uint32_t end;
+	float width;
+};
+
+// Decodes one codepoint of UTF-8 and advances p, U+FFFD for a bad lead byte
+char32_t lyrics_layout_next_codepoint(const uint8_t *&p, const uint8_t *end);
+
+// Greedy word wrap, as the text source wraps: rows break at spaces, and inside
+// a word only when the word alone is wider than max_width
+void lyrics_layout_wrap(const std::vector<lyrics_layout_glyph> &glyphs, float max_width,
+			std::vector<lyrics_layout_row> &rows);
+
+// A library as one source lays it out. Shrinking keeps the shared parsed
+// library and only adds the line sizes; pagination swaps in a library whose
+// lines are the pages, shared by every source paginating the same songs into
+// the same box.
+struct lyrics_layout {
+	std::shared_ptr<const lyrics_library> library;
+	// Font size of every line shrunk to fit the text box, 0 for the configured
+	// size. Empty unless some line was shrunk.
+	std::vector<uint16_t> line_sizes;
+
+	uint16_t line_size(size_t song, size_t line) const
+	{
+		return line_sizes.empty() ? 0 : line_sizes[library->songs[song].first_line + line];
+	}
+};
+
+// Lays out every line of parsed, measured with a glyph advance table cached per
+// font. The library is parsed itself unless lines were split into pages.
+// Returns null as soon as cancel (if given) is set; it is checked per song.
+std::shared_ptr<const lyrics_layout> lyrics_layout_apply(const std::shared_ptr<const lyrics_library> &parsed,
+							 const lyrics_layout_spec &spec,
+							 const std::atomic<bool> *cancel);
+
+// Sets the font of style in settings at another size, for lines shrunk to fit
+void lyrics_layout_set_font_size(obs_data_t *settings, obs_data_t *style, int size);
+
+// Background layout thread for one source. It lays out the latest parsed
+// library with the latest spec whenever either changes; a request that
+// arrives during a layout cancels it, and several are coalesced. The callback
+// runs on the layout thread.
+typedef void (*lyrics_layout_done_t)(void *param, std::shared_ptr<const lyrics_layout> layout);
+
+struct lyrics_layouter;
+
+lyrics_layouter *lyrics_layouter_create(lyrics_layout_done_t done, void *param);
+// Returns without waiting for a layout in flight, which is abandoned; the done
+// callback is never called once this returns. The thread is joined later.
+void lyrics_layouter_destroy(lyrics_layouter *layouter);
+void lyrics_layouter_set_library(lyrics_layouter *layouter, std::shared_ptr<const lyrics_library> parsed);
+// Does nothing if spec is unchanged
+void lyrics_layouter_set_spec(lyrics_layouter *layouter, const lyrics_layout_spec &spec);
+// Joins the threads of every destroyed layouter; module unload only
+void lyrics_layouter_free_all(void);
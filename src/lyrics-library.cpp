@@ -0,0 +1,879 @@
+#include "lyrics-library.h"
+#include "lyrics-cache.h"
+#include "lyrics-encoding.h"
+#include "lyrics-mapped-file.h"
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+struct load_stats {
+	std::atomic<size_t> hits{0};
+	std::atomic<size_t> misses{0};
+};
+
+struct file_entry {
+	std::string path; // normalized, '/' separated
+	uint64_t size;
+	int64_t mtime;
+};
+
+struct parsed_song {
+	std::string text;
+	std::vector<int64_t> times; // empty unless timed
+	std::vector<lyrics_word_time> words;
+};
+
+static inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+size_t lyrics_parse_buffer(const char *data, size_t size, std::string &out)
+{
+	const char *pos = data;
+	const char *end = data + size;
+	size_t count = 0;
+
+	// Skip UTF-8 byte order mark
+	if (size >= 3 && (uint8_t)pos[0] == 0xEF && (uint8_t)pos[1] == 0xBB && (uint8_t)pos[2] == 0xBF)
+		pos += 3;
+
+	while (pos < end) {
+		const char *line_end = (const char *)memchr(pos, '\n', (size_t)(end - pos));
+		if (!line_end)
+			line_end = end;
+
+		const char *first = pos;
+		const char *last = line_end;
+		while (first < last && is_space(*first))
+			first++;
+		while (last > first && is_space(last[-1]))
+			last--;
+
+		if (first != last) {
+			out.append(first, (size_t)(last - first));
+			out.push_back('\0');
+			count++;
+		}
+
+		pos = line_end + 1;
+	}
+
+	return count;
+}
+
+// Parses "[mm:ss]", "[mm:ss.xx]" or "[mm:ss:xx]" into milliseconds
+static bool parse_timestamp(const char *pos, const char *end, int64_t &ms)
+{
+	int64_t minutes = 0, seconds = 0, fraction = 0, scale = 1;
+	const char *start = pos;
+
+	while (pos < end && *pos >= '0' && *pos <= '9')
+		minutes = minutes * 10 + (*pos++ - '0');
+	if (pos == start || pos == end || *pos++ != ':')
+		return false;
+
+	start = pos;
+	while (pos < end && *pos >= '0' && *pos <= '9')
+		seconds = seconds * 10 + (*pos++ - '0');
+	if (pos == start)
+		return false;
+
+	if (pos < end && (*pos == '.' || *pos == ':')) {
+		pos++;
+		for (; pos < end && *pos >= '0' && *pos <= '9' && scale < 1000; pos++) {
+			fraction = fraction * 10 + (*pos - '0');
+			scale *= 10;
+		}
+	}
+	if (pos != end)
+		return false;
+
+	ms = (minutes * 60 + seconds) * 1000 + fraction * 1000 / scale;
+	return true;
+}
+
+// Word times relative to the first timestamp of their line, so every repeat
+// of a line keeps the same pace
+struct line_word {
+	uint32_t offset;
+	int64_t delta;
+};
+
+// Cuts enhanced LRC word tags (<mm:ss.xx>) out of a line into text, recording
+// where each word starts. Returns false if the line has none.
+static bool strip_word_tags(const char *first, const char *last, int64_t line_time, std::string &text,
+			    std::vector<line_word> &words)
+{
+	const size_t first_word = words.size();
+	const size_t start = text.size();
+	const char *copied = first;
+
+	for (const char *pos = first; pos < last;) {
+		const char *open = (const char *)memchr(pos, '<', (size_t)(last - pos));
+		if (!open)
+			break;
+		const char *close = (const char *)memchr(open, '>', (size_t)(last - open));
+		int64_t ms;
+		if (!close || !parse_timestamp(open + 1, close, ms)) {
+			pos = open + 1;
+			continue;
+		}
+
+		text.append(copied, (size_t)(open - copied));
+		words.push_back({(uint32_t)(text.size() - start), ms - line_time});
+		copied = pos = close + 1;
+	}
+
+	if (words.size() == first_word)
+		return false;
+	text.append(copied, (size_t)(last - copied));
+
+	// Spaces next to the tags were inside the trimmed line
+	size_t lead = 0;
+	while (start + lead < text.size() && is_space(text[start + lead]))
+		lead++;
+	text.erase(start, lead);
+	while (text.size() > start && is_space(text.back()))
+		text.pop_back();
+
+	const uint32_t length = (uint32_t)(text.size() - start);
+	for (size_t i = first_word; i < words.size(); i++)
+		words[i].offset = std::min(words[i].offset - std::min(words[i].offset, (uint32_t)lead), length);
+	return true;
+}
+
+size_t lyrics_parse_lrc(const char *data, size_t size, std::string &out, std::vector<int64_t> &times,
+			std::vector<lyrics_word_time> &words)
+{
+	struct timed_line {
+		int64_t time;
+		const char *text; // null for text in stripped
+		size_t offset;    // of the text in stripped
+		size_t length;
+		size_t first_word; // in line_words
+		size_t word_count;
+	};
+
+	const char *pos = data;
+	const char *end = data + size;
+	std::vector<timed_line> timed;
+	std::vector<line_word> line_words;
+	std::string stripped; // lines without their word tags
+	int64_t offset = 0;
+
+	if (size >= 3 && (uint8_t)pos[0] == 0xEF && (uint8_t)pos[1] == 0xBB && (uint8_t)pos[2] == 0xBF)
+		pos += 3;
+
+	while (pos < end) {
+		const char *line_end = (const char *)memchr(pos, '\n', (size_t)(end - pos));
+		if (!line_end)
+			line_end = end;
+
+		const char *first = pos;
+		const char *last = line_end;
+		while (first < last && is_space(*first))
+			first++;
+		while (last > first && is_space(last[-1]))
+			last--;
+
+		// Leading tags: timestamps for this line, or metadata such as [offset:+250]
+		const size_t line_start = timed.size();
+		while (first < last && *first == '[') {
+			const char *close = (const char *)memchr(first, ']', (size_t)(last - first));
+			if (!close)
+				break;
+
+			int64_t ms;
+			if (parse_timestamp(first + 1, close, ms)) {
+				timed.push_back({ms, nullptr, 0, 0, 0, 0});
+			} else if (close - first > 8 && strncmp(first + 1, "offset:", 7) == 0) {
+				offset = strtoll(first + 8, nullptr, 10);
+			}
+
+			first = close + 1;
+			while (first < last && is_space(*first))
+				first++;
+		}
+
+		pos = line_end + 1;
+		if (line_start == timed.size())
+			continue;
+
+		const size_t first_word = line_words.size();
+		const size_t stripped_start = stripped.size();
+		const bool has_words = strip_word_tags(first, last, timed[line_start].time, stripped, line_words);
+		for (size_t i = line_start; i < timed.size(); i++) {
+			timed[i].text = has_words ? nullptr : first;
+			timed[i].offset = stripped_start;
+			timed[i].length = has_words ? stripped.size() - stripped_start : (size_t)(last - first);
+			timed[i].first_word = first_word;
+			timed[i].word_count = line_words.size() - first_word;
+		}
+	}
+
+	if (timed.empty())
+		return lyrics_parse_buffer(data, size, out);
+
+	// A line may carry several timestamps and appear anywhere in the file
+	std::stable_sort(timed.begin(), timed.end(),
+			 [](const timed_line &a, const timed_line &b) { return a.time < b.time; });
+
+	for (size_t i = 0; i < timed.size(); i++) {
+		const timed_line &line = timed[i];
+		out.append(line.text ? line.text : stripped.data() + line.offset, line.length);
+		out.push_back('\0');
+		// A positive offset shows lyrics earlier
+		times.push_back(std::max<int64_t>(line.time - offset, 0));
+
+		for (size_t w = line.first_word; w < line.first_word + line.word_count; w++) {
+			const line_word &word = line_words[w];
+			const int64_t delta = std::max<int64_t>(line.time + word.delta - offset, 0);
+			words.push_back({(uint32_t)i, word.offset, delta});
+		}
+	}
+
+	return timed.size();
+}
+
+static bool is_lrc_file(const std::string &path)
+{
+	const size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos || path.size() - dot != 4)
+		return false;
+	return (path[dot + 1] | 0x20) == 'l' && (path[dot + 2] | 0x20) == 'r' && (path[dot + 3] | 0x20) == 'c';
+}
+
+void lyrics_library_add_song(lyrics_library &library, const char *text, size_t size, const int64_t *times,
+			     const lyrics_word_time *words, size_t word_count, std::string name, std::string path)
+{
+	if (!size)
+		return;
+
+	const uint32_t base = (uint32_t)library.arena.size();
+	library.arena.append(text, size);
+
+	lyrics_song song;
+	song.name = std::move(name);
+	song.path = std::move(path);
+	song.first_line = (uint32_t)library.lines.size();
+
+	uint32_t offset = 0;
+	while (offset < size) {
+		const uint32_t length = (uint32_t)strlen(text + offset);
+		library.lines.push_back({base + offset, length});
+		library.line_songs.push_back((uint32_t)library.songs.size());
+		offset += length + 1;
+	}
+
+	song.line_count = (uint32_t)library.lines.size() - song.first_line;
+	if (times) {
+		song.first_time = (int32_t)library.times.size();
+		library.times.insert(library.times.end(), times, times + song.line_count);
+	}
+	if (words && word_count) {
+		song.first_word = (uint32_t)library.words.size();
+		song.word_count = (uint32_t)word_count;
+		library.words.insert(library.words.end(), words, words + word_count);
+	}
+	library.songs.push_back(std::move(song));
+}
+
+static bool read_song_text(const file_entry &file_info, load_stats &stats, parsed_song &song)
+{
+	if (lyrics_cache_find(file_info.path, file_info.size, file_info.mtime, song.text, song.times, song.words)) {
+		stats.hits++;
+		return true;
+	}
+
+	lyrics_mapped_file file;
+	if (!lyrics_mapped_file_open(&file, file_info.path.c_str()))
+		return false;
+
+	const uint64_t hash = lyrics_cache_hash(file.data, file.size);
+
+	if (lyrics_cache_find_hash(file_info.path, file_info.size, file_info.mtime, hash, song.text, song.times,
+				   song.words)) {
+		stats.hits++;
+	} else {
+		stats.misses++;
+
+		// Whatever the file's encoding, the parsers see normalized UTF-8
+		std::string decoded;
+		size_t size;
+		const char *text = lyrics_encoding_decode(file.data, file.size, decoded, &size);
+		if (is_lrc_file(file_info.path))
+			lyrics_parse_lrc(text, size, song.text, song.times, song.words);
+		else
+			lyrics_parse_buffer(text, size, song.text);
+
+		lyrics_cache_entry entry;
+		entry.size = file_info.size;
+		entry.mtime = file_info.mtime;
+		entry.hash = hash;
+		entry.text = song.text;
+		entry.times = song.times;
+		entry.words = song.words;
+		lyrics_cache_store(file_info.path, std::move(entry));
+	}
+
+	lyrics_mapped_file_close(&file);
+	return true;
+}
+
+static void log_load(const char *what, const lyrics_library &library, const load_stats &stats, size_t threads)
+{
+	const double elapsed_ms = (double)library.load_time_ns / 1000000.0;
+	plugin_log(LOG_INFO,
+		   "%s %zu songs, %zu lines (%zu KiB text) in %.2f ms on %zu threads "
+		   "(parse cache: %zu hits, %zu misses)",
+		   what, library.songs.size(), library.lines.size(), library.arena.size() / 1024, elapsed_ms, threads,
+		   stats.hits.load(), stats.misses.load());
+}
+
+static std::string normalize_path(const fs::path &path)
+{
+	return path.lexically_normal().generic_u8string();
+}
+
+// Song title: the file name up to its first dot
+static std::string song_name(const std::string &path)
+{
+	const size_t slash = path.find_last_of('/');
+	const size_t start = slash == std::string::npos ? 0 : slash + 1;
+	const size_t dot = path.find('.', start);
+	return path.substr(start, dot == std::string::npos ? std::string::npos : dot - start);
+}
+
+static inline char lower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+static bool equal_ci(const std::string &a, const std::string &b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (lower(a[i]) != lower(b[i]))
+			return false;
+	}
+	return true;
+}
+
+// Case-insensitive path order, so folder listings are stable across platforms
+static bool path_less(const std::string &a, const std::string &b)
+{
+	const size_t n = std::min(a.size(), b.size());
+	for (size_t i = 0; i < n; i++) {
+		const char ca = lower(a[i]), cb = lower(b[i]);
+		if (ca != cb)
+			return (unsigned char)ca < (unsigned char)cb;
+	}
+	return a.size() != b.size() ? a.size() < b.size() : a < b;
+}
+
+// '*' and '?' wildcards, ASCII case-insensitive
+static bool wildcard_match(const char *pattern, const char *name)
+{
+	const char *star = nullptr;
+	const char *resume = nullptr;
+
+	while (*name) {
+		if (*pattern == '*') {
+			star = pattern++;
+			resume = name;
+		} else if (*pattern == '?' || (*pattern && lower(*pattern) == lower(*name))) {
+			pattern++;
+			name++;
+		} else if (star) {
+			pattern = star + 1;
+			name = ++resume;
+		} else {
+			return false;
+		}
+	}
+
+	while (*pattern == '*')
+		pattern++;
+	return !*pattern;
+}
+
+static std::vector<std::string> split_patterns(const std::string &patterns)
+{
+	std::vector<std::string> result;
+	std::string current;
+	for (char c : patterns) {
+		if (c == ';' || c == ',' || c == ' ' || c == '\t') {
+			if (!current.empty())
+				result.push_back(std::move(current));
+			current.clear();
+		} else {
+			current.push_back(c);
+		}
+	}
+	if (!current.empty())
+		result.push_back(std::move(current));
+	if (result.empty())
+		result.push_back("*.txt");
+	return result;
+}
+
+static bool matches_patterns(const std::vector<std::string> &patterns, const std::string &file_name)
+{
+	for (const std::string &pattern : patterns) {
+		if (wildcard_match(pattern.c_str(), file_name.c_str()))
+			return true;
+	}
+	return false;
+}
+
+static bool stat_file(const fs::path &path, file_entry &entry)
+{
+	std::error_code ec;
+	if (!fs::is_regular_file(path, ec))
+		return false;
+
+	entry.size = (uint64_t)fs::file_size(path, ec);
+	if (ec)
+		return false;
+	entry.mtime = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+	if (ec)
+		return false;
+
+	entry.path = normalize_path(path);
+	return true;
+}
+
+static size_t worker_count(size_t jobs)
+{
+	const int cores = os_get_logical_cores();
+	return std::max<size_t>(1, std::min<size_t>(jobs, cores > 0 ? (size_t)cores : 1));
+}
+
+// Runs fn(i) for every i in [0, count) on a pool sized to the core count
+template<typename Fn> static size_t parallel_for(size_t count, Fn fn)
+{
+	const size_t threads = worker_count(count);
+	std::atomic<size_t> next{0};
+
+	auto worker = [&]() {
+		for (size_t i = next++; i < count; i = next++)
+			fn(i);
+	};
+
+	std::vector<std::thread> pool;
+	for (size_t i = 1; i < threads; i++)
+		pool.emplace_back(worker);
+	worker();
+	for (std::thread &thread : pool)
+		thread.join();
+
+	return threads;
+}
+
+// Walks the folder (and optionally its subfolders) on a pool of threads,
+// returning every matching file sorted by path
+static std::vector<file_entry> scan_folder(const lyrics_library_spec &spec, const std::atomic<bool> *cancel)
+{
+	const std::vector<std::string> patterns = split_patterns(spec.patterns);
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<fs::path> dirs{fs::u8path(spec.folder)};
+	std::vector<file_entry> files;
+	size_t busy = 0;
+
+	auto worker = [&]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			cond.wait(lock, [&] { return !dirs.empty() || busy == 0; });
+			if (dirs.empty() || (cancel && *cancel))
+				return;
+
+			fs::path dir = std::move(dirs.back());
+			dirs.pop_back();
+			busy++;
+			lock.unlock();
+
+			std::vector<fs::path> found_dirs;
+			std::vector<file_entry> found_files;
+			// Incremented by hand, as the range-for form throws on errors;
+			// symlinked folders are not followed, like the watcher does not
+			std::error_code ec;
+			const fs::directory_options options = fs::directory_options::skip_permission_denied;
+			for (fs::directory_iterator it(dir, options, ec), end; !ec && it != end; it.increment(ec)) {
+				const fs::directory_entry &entry = *it;
+				std::error_code entry_ec;
+				if (entry.is_directory(entry_ec)) {
+					if (spec.recursive && !entry.is_symlink(entry_ec))
+						found_dirs.push_back(entry.path());
+					continue;
+				}
+
+				file_entry file;
+				if (matches_patterns(patterns, entry.path().filename().u8string()) &&
+				    stat_file(entry.path(), file))
+					found_files.push_back(std::move(file));
+			}
+
+			lock.lock();
+			busy--;
+			dirs.insert(dirs.end(), found_dirs.begin(), found_dirs.end());
+			files.insert(files.end(), std::make_move_iterator(found_files.begin()),
+				     std::make_move_iterator(found_files.end()));
+			cond.notify_all();
+		}
+	};
+
+	std::vector<std::thread> pool;
+	const size_t threads = spec.recursive ? worker_count(SIZE_MAX) : 1;
+	for (size_t i = 1; i < threads; i++)
+		pool.emplace_back(worker);
+	worker();
+	for (std::thread &thread : pool)
+		thread.join();
+
+	std::sort(files.begin(), files.end(),
+		  [](const file_entry &a, const file_entry &b) { return path_less(a.path, b.path); });
+	return files;
+}
+
+// Lists every song file of the spec, whether or not it gets parsed
+static void fill_catalog(lyrics_library &library, const std::vector<file_entry> &files)
+{
+	library.catalog.reserve(files.size());
+	for (const file_entry &file : files)
+		library.catalog.push_back({song_name(file.path), file.path});
+}
+
+// Resolves setlist IDs against the catalog: a song name, or a path relative to
+// the folder. A song may appear more than once; unknown IDs are skipped.
+static std::vector<file_entry> select_setlist(const std::vector<file_entry> &files,
+					      const std::vector<lyrics_catalog_entry> &catalog,
+					      const std::vector<std::string> &setlist)
+{
+	std::vector<file_entry> selected;
+	selected.reserve(setlist.size());
+	for (const std::string &id : setlist) {
+		const std::string suffix = "/" + normalize_path(fs::u8path(id));
+		size_t i = 0;
+		while (i < catalog.size() && !equal_ci(catalog[i].name, id) &&
+		       !(catalog[i].path.size() >= suffix.size() &&
+			 equal_ci(catalog[i].path.substr(catalog[i].path.size() - suffix.size()), suffix)))
+			i++;
+
+		if (i < catalog.size())
+			selected.push_back(files[i]);
+		else
+			plugin_log(LOG_WARNING, "Setlist song '%s' not found", id.c_str());
+	}
+	return selected;
+}
+
+// Reads and parses every file on the worker pool, then appends the songs in
+// the order of files so the result does not depend on thread scheduling
+static size_t load_files(lyrics_library &library, const std::vector<file_entry> &files, load_stats &stats,
+			 const std::atomic<bool> *cancel)
+{
+	std::vector<parsed_song> songs(files.size());
+	const size_t threads = parallel_for(files.size(), [&](size_t i) {
+		if (!cancel || !*cancel)
+			read_song_text(files[i], stats, songs[i]);
+	});
+	if (cancel && *cancel)
+		return threads;
+
+	size_t arena_size = 0;
+	for (const parsed_song &song : songs)
+		arena_size += song.text.size();
+	library.arena.reserve(arena_size);
+
+	for (size_t i = 0; i < files.size(); i++) {
+		const parsed_song &song = songs[i];
+		lyrics_library_add_song(library, song.text.data(), song.text.size(),
+					song.times.empty() ? nullptr : song.times.data(), song.words.data(),
+					song.words.size(), song_name(files[i].path), files[i].path);
+	}
+
+	return threads;
+}
+
+std::shared_ptr<const lyrics_library> lyrics_library_load(const lyrics_library_spec &spec,
+							  const std::atomic<bool> *cancel)
+{
+	auto library = std::make_shared<lyrics_library>();
+	const uint64_t start = os_gettime_ns();
+	load_stats stats;
+
+	std::vector<file_entry> files;
+	if (spec.use_folder && !spec.folder.empty()) {
+		files = scan_folder(spec, cancel);
+	} else if (!spec.use_folder) {
+		// Explicit file lists keep the order they were given in
+		for (const std::string &filepath : spec.files) {
+			file_entry file;
+			if (stat_file(fs::u8path(filepath), file))
+				files.push_back(std::move(file));
+		}
+	}
+
+	// Every file is indexed by name, but with a setlist only its songs are read
+	fill_catalog(*library, files);
+	if (!spec.setlist.empty())
+		files = select_setlist(files, library->catalog, spec.setlist);
+
+	const size_t threads = load_files(*library, files, stats, cancel);
+	if (cancel && *cancel) {
+		if (stats.misses)
+			lyrics_cache_flush();
+		return nullptr;
+	}
+
+	if (stats.misses)
+		lyrics_cache_flush();
+
+	library->search = lyrics_search_build(*library, nullptr);
+
+	library->load_time_ns = os_gettime_ns() - start;
+	log_load("Loaded", *library, stats, threads);
+	if (!spec.setlist.empty())
+		plugin_log(LOG_INFO, "Setlist: %zu songs parsed, %zu indexed by name", library->songs.size(),
+			   library->catalog.size());
+	return library;
+}
+
+std::shared_ptr<const lyrics_library> lyrics_library_update(const lyrics_library &base, const lyrics_library_spec &spec,
+							    const std::vector<std::string> &changed)
+{
+	struct song_source {
+		std::string name;
+		std::string path;
+		const char *text = nullptr; // null for freshly parsed songs
+		size_t size = 0;
+		const int64_t *times = nullptr;
+		const lyrics_word_time *words = nullptr;
+		size_t word_count = 0;
+		parsed_song parsed;
+	};
+
+	const uint64_t start = os_gettime_ns();
+	load_stats stats;
+
+	const std::vector<std::string> patterns = split_patterns(spec.patterns);
+	const std::string root = normalize_path(fs::u8path(spec.folder) / "");
+
+	// Folders that appeared are expanded into their files, folders that
+	// disappeared drop every song below them
+	std::set<std::string> changed_paths;
+	std::vector<std::string> changed_dirs;
+	for (const std::string &path : changed) {
+		const fs::path changed_path = fs::u8path(path);
+		changed_paths.insert(normalize_path(changed_path));
+		changed_dirs.push_back(normalize_path(changed_path) + "/");
+
+		std::error_code ec;
+		if (spec.recursive && fs::is_directory(changed_path, ec)) {
+			const fs::directory_options options = fs::directory_options::skip_permission_denied;
+			for (fs::recursive_directory_iterator it(changed_path, options, ec), end; !ec && it != end;
+			     it.increment(ec))
+				changed_paths.insert(normalize_path(it->path()));
+		}
+	}
+
+	auto is_changed = [&](const std::string &path) {
+		if (changed_paths.count(path))
+			return true;
+		for (const std::string &dir : changed_dirs) {
+			if (path.compare(0, dir.size(), dir) == 0)
+				return true;
+		}
+		return false;
+	};
+
+	// Only files the folder scan would have picked up
+	auto is_library_file = [&](const std::string &path) {
+		if (path.compare(0, root.size(), root) != 0)
+			return false;
+		const std::string relative = path.substr(root.size());
+		const size_t slash = relative.find_last_of('/');
+		if (slash != std::string::npos && !spec.recursive)
+			return false;
+		return matches_patterns(patterns, slash == std::string::npos ? relative : relative.substr(slash + 1));
+	};
+
+	// Setlist order does not follow the folder, and a new file may resolve a
+	// missing entry, so rescan; only the setlist songs are parsed again, mostly
+	// from the parse cache
+	if (!spec.setlist.empty()) {
+		const bool affected =
+			std::any_of(changed_paths.begin(), changed_paths.end(), is_library_file) ||
+			std::any_of(base.catalog.begin(), base.catalog.end(),
+				    [&](const lyrics_catalog_entry &entry) { return is_changed(entry.path); });
+		return affected ? lyrics_library_load(spec, nullptr) : nullptr;
+	}
+
+	// Unchanged songs are copied from the old arena, changed files are re-read
+	std::vector<song_source> sources;
+	bool modified = false;
+	for (const lyrics_song &song : base.songs) {
+		if (is_changed(song.path)) {
+			modified = true;
+			continue;
+		}
+
+		const lyrics_line_span &first = base.lines[song.first_line];
+		const lyrics_line_span &last = base.lines[song.first_line + song.line_count - 1];
+
+		song_source source;
+		source.name = song.name;
+		source.path = song.path;
+		source.text = base.arena.data() + first.offset;
+		source.size = last.offset + last.length + 1 - first.offset;
+		source.times = song.first_time >= 0 ? base.times.data() + song.first_time : nullptr;
+		source.words = base.words.data() + song.first_word;
+		source.word_count = song.word_count;
+		sources.push_back(std::move(source));
+	}
+
+	for (const std::string &path : changed_paths) {
+		if (!is_library_file(path))
+			continue;
+
+		file_entry file;
+		song_source source;
+		if (!stat_file(fs::u8path(path), file) || !read_song_text(file, stats, source.parsed))
+			continue;
+
+		source.name = song_name(path);
+		source.path = path;
+		sources.push_back(std::move(source));
+		modified = true;
+	}
+
+	if (!modified)
+		return nullptr;
+
+	// Same order as a full folder scan
+	std::stable_sort(sources.begin(), sources.end(),
+			 [](const song_source &a, const song_source &b) { return path_less(a.path, b.path); });
+
+	auto library = std::make_shared<lyrics_library>();
+	library->arena.reserve(base.arena.size());
+	for (song_source &source : sources) {
+		// Point into parsed text only now; sorting moved it around
+		if (!source.text) {
+			source.text = source.parsed.text.data();
+			source.size = source.parsed.text.size();
+			source.times = source.parsed.times.empty() ? nullptr : source.parsed.times.data();
+			source.words = source.parsed.words.data();
+			source.word_count = source.parsed.words.size();
+		}
+		library->catalog.push_back({source.name, source.path});
+		lyrics_library_add_song(*library, source.text, source.size, source.times, source.words,
+					source.word_count, std::move(source.name), std::move(source.path));
+	}
+
+	if (stats.misses)
+		lyrics_cache_flush();
+
+	library->search = lyrics_search_build(*library, &base);
+
+	library->load_time_ns = os_gettime_ns() - start;
+	log_load("Updated", *library, stats, 1);
+	return library;
+}
+
+int lyrics_library_find_song(const lyrics_library &library, const std::string &path)
+{
+	for (size_t i = 0; i < library.songs.size(); i++) {
+		if (library.songs[i].path == path)
+			return (int)i;
+	}
+	return -1;
+}
+
+int lyrics_library_find_song_id(const lyrics_library &library, const std::string &id)
+{
+	for (size_t i = 0; i < library.songs.size(); i++) {
+		if (equal_ci(library.songs[i].name, id) || equal_ci(library.songs[i].path, id))
+			return (int)i;
+	}
+	return -1;
+}
+
+bool lyrics_library_next(const lyrics_library &library, int &song, int &line)
+{
+	if (library.songs.empty())
+		return false;
+	if (song < 0 || song >= (int)library.songs.size()) {
+		song = 0;
+		line = -1;
+	}
+
+	line++;
+	if (line >= (int)library.songs[song].line_count) {
+		line = 0;
+		song++;
+		if (song >= (int)library.songs.size())
+			song = 0;
+	}
+	return true;
+}
+
+bool lyrics_library_previous(const lyrics_library &library, int &song, int &line)
+{
+	if (library.songs.empty())
+		return false;
+	if (song < 0 || song >= (int)library.songs.size()) {
+		song = 0;
+		line = 0;
+	}
+
+	line--;
+	if (line < 0) {
+		song--;
+		if (song < 0)
+			song = (int)library.songs.size() - 1;
+		line = (int)library.songs[song].line_count - 1;
+	}
+	return true;
+}
+
+int lyrics_library_line_at(const lyrics_library &library, int song, int64_t time_ms)
+{
+	if (song < 0 || song >= (int)library.songs.size() || !library.song_timed(song))
+		return -1;
+
+	const int64_t *times = library.song_times(song);
+	const int64_t *end = times + library.songs[song].line_count;
+	const int64_t *next = std::upper_bound(times, end, time_ms);
+	return next == times ? 0 : (int)(next - times) - 1;
+}
+
+const lyrics_word_time *lyrics_library_line_words(const lyrics_library &library, int song, int line, size_t *count)
+{
+	*count = 0;
+	if (song < 0 || song >= (int)library.songs.size() || !library.songs[song].word_count)
+		return nullptr;
+
+	const lyrics_song &info = library.songs[song];
+	const lyrics_word_time *first = library.words.data() + info.first_word;
+	const lyrics_word_time *last = first + info.word_count;
+	auto by_line = [](const lyrics_word_time &a, const lyrics_word_time &b) {
+		return a.line < b.line;
+	};
+	auto range = std::equal_range(first, last, lyrics_word_time{(uint32_t)line, 0, 0}, by_line);
+	*count = (size_t)(range.second - range.first);
+	return *count ? range.first : nullptr;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "lyrics-search.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Which files make up a library. Two specs that compare equal load the same songs,
+// so settings changes that leave the spec untouched never trigger a reload.
+struct lyrics_library_spec {
+	bool use_folder = false;
+	std::string folder;
+	bool recursive = false;
+	std::string patterns; // file name wildcards separated by ';', e.g. "*.txt;*.lrc"
+	std::vector<std::string> files;
+	// Song IDs (file name without extension, or a path relative to the folder)
+	// in play order. When set, only these songs are parsed and they replace the
+	// folder order; the rest of the folder is indexed by name only.
+	std::vector<std::string> setlist;
+
+	bool operator==(const lyrics_library_spec &other) const
+	{
+		return use_folder == other.use_folder && folder == other.folder && recursive == other.recursive &&
+		       patterns == other.patterns && files == other.files && setlist == other.setlist;
+	}
+	bool operator!=(const lyrics_library_spec &other) const { return !(*this == other); }
+};
+
+// Location of one line inside the library arena
+struct lyrics_line_span {
+	uint32_t offset;
+	uint32_t length;
+};
+
+// Start of a sung word in an enhanced LRC line, from a <mm:ss.xx> tag
+struct lyrics_word_time {
+	uint32_t line;   // line of the song
+	uint32_t offset; // byte offset of the word in the line text; the line length for a closing tag
+	int64_t time;    // ms
+};
+
+struct lyrics_song {
+	std::string name;
+	std::string path;
+	uint32_t first_line;
+	uint32_t line_count;
+	int32_t first_time = -1; // index of the song's first line in lyrics_library::times, -1 if untimed
+	uint32_t first_word = 0; // index of the song's first word in lyrics_library::words
+	uint32_t word_count = 0;
+};
+
+// A song file that was found, whether or not its body was parsed
+struct lyrics_catalog_entry {
+	std::string name;
+	std::string path;
+};
+
+// Parsed songs. All line text lives in a single UTF-8 arena, every line
+// followed by a NUL so it can be handed out as a C string without copying.
+// A library is never modified once published; reloads build a new one.
+struct lyrics_library {
+	std::string arena;
+	std::vector<lyrics_line_span> lines;
+	// Song of every line. With songs[].first_line (the prefix sums of the line
+	// counts) this maps absolute line numbers to song/line both ways in O(1).
+	std::vector<uint32_t> line_songs;
+	std::vector<lyrics_song> songs;
+	// Every song file of the spec in folder order; songs holds the parsed subset
+	std::vector<lyrics_catalog_entry> catalog;
+	std::shared_ptr<const lyrics_search_index> search;
+	// Start times in ms for the lines of timed (.lrc) songs, ascending per song
+	std::vector<int64_t> times;
+	// Word start times of enhanced LRC songs, ordered by line, then offset
+	std::vector<lyrics_word_time> words;
+	uint64_t load_time_ns = 0;
+
+	const char *line_text(size_t song, size_t line) const
+	{
+		return arena.data() + lines[songs[song].first_line + line].offset;
+	}
+	bool song_timed(size_t song) const { return songs[song].first_time >= 0; }
+	const int64_t *song_times(size_t song) const { return times.data() + songs[song].first_time; }
+};
+
+// Appends the trimmed, non-empty lines of a UTF-8 buffer to out, each followed by a NUL
+size_t lyrics_parse_buffer(const char *data, size_t size, std::string &out);
+
+// Parses LRC ([mm:ss.xx]text) into lines sorted by time, with their start times
+// in times. Lines with several timestamps are repeated, [offset:] is applied,
+// and timed lines may be empty to clear the screen. A file without timestamps
+// is parsed as plain text, leaving times empty. Enhanced LRC word tags
+// ([mm:ss]<mm:ss>word <mm:ss>word) are cut from the text and go to words.
+size_t lyrics_parse_lrc(const char *data, size_t size, std::string &out, std::vector<int64_t> &times,
+			std::vector<lyrics_word_time> &words);
+
+// Appends the lines of a NUL-separated block to the library as a new song,
+// along with one start time per line when the song is timed and its word times
+void lyrics_library_add_song(lyrics_library &library, const char *text, size_t size, const int64_t *times,
+			     const lyrics_word_time *words, size_t word_count, std::string name, std::string path);
+
+// Scans the files of spec and parses them, or with a setlist only the songs
+// it names, in setlist order. Returns null as soon as cancel (if given) is set.
+std::shared_ptr<const lyrics_library> lyrics_library_load(const lyrics_library_spec &spec,
+							  const std::atomic<bool> *cancel);
+
+// Builds a new library from base, re-reading only the given files of the
+// watched folder described by spec. Paths that no longer exist are dropped, new
+// files are added in order. With a setlist the folder is rescanned instead, since
+// an added file can fill a missing setlist entry. Returns null if none of the paths affect the library.
+std::shared_ptr<const lyrics_library> lyrics_library_update(const lyrics_library &base, const lyrics_library_spec &spec,
+							    const std::vector<std::string> &changed);
+int lyrics_library_find_song(const lyrics_library &library, const std::string &path);
+// Song by ID as used in setlists: its name or path, ignoring ASCII case
+int lyrics_library_find_song_id(const lyrics_library &library, const std::string &id);
+
+// Step one line forward or back, crossing into the next/previous song and wrapping
+// around the library. Return false if the library is empty.
+bool lyrics_library_next(const lyrics_library &library, int &song, int &line);
+bool lyrics_library_previous(const lyrics_library &library, int &song, int &line);
+
+// Line of a timed song showing at time_ms: a binary search over its start
+// times. Before the first timestamp this is line 0. Returns -1 for untimed songs.
+int lyrics_library_line_at(const lyrics_library &library, int song, int64_t time_ms);
+
+// Word times of one line, null with count 0 for lines without any
+const lyrics_word_time *lyrics_library_line_words(const lyrics_library &library, int song, int line, size_t *count);
@@ -0,0 +1,270 @@
+#include "lyrics-line-cache.h"
+#include "lyrics-layout.h"
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// text_ft2_source keeps a 2048x2048 A8 glyph atlas per instance, which dwarfs
+// the per-line vertex buffer, so that is what each cached line costs in VRAM.
+#define TEXT_SOURCE_VRAM_ESTIMATE (2048ull * 2048ull)
+
+// Rasterizing happens during the text source's deferred update on the graphics
+// thread, so prefetching is spread out to keep each frame cheap.
+#define UPDATES_PER_TICK 1
+
+struct cache_entry {
+	obs_source_t *source = nullptr;
+	uint64_t library_generation = 0;
+	uint64_t style_hash = 0;
+	int song = -1;
+	int line = -1;
+	uint64_t issued_tick = 0;
+	uint64_t last_used = 0;
+};
+
+struct lyrics_line_cache {
+	std::mutex mutex;
+	std::vector<cache_entry> entries;
+	size_t max_entries = 0;
+	int prefetch = 0;
+
+	obs_data_t *style = nullptr;
+	uint64_t style_hash = 0;
+	std::shared_ptr<const lyrics_layout> layout;
+	uint64_t library_generation = 1;
+
+	// Positions to keep cached, most important first
+	std::vector<std::pair<int, int>> wanted;
+	int song = 0;
+	int line = 0;
+
+	uint64_t tick = 2;
+};
+
+static inline bool entry_matches(const lyrics_line_cache *cache, const cache_entry &entry, int song, int line)
+{
+	return entry.source && entry.song == song && entry.line == line &&
+	       entry.library_generation == cache->library_generation && entry.style_hash == cache->style_hash;
+}
+
+// The deferred update is applied when the text source is ticked, which may be
+// before or after our own tick in the same frame, so wait one full frame.
+static inline bool entry_ready(const lyrics_line_cache *cache, const cache_entry &entry)
+{
+	return cache->tick >= entry.issued_tick + 2;
+}
+
+static cache_entry *find_entry(lyrics_line_cache *cache, int song, int line)
+{
+	for (cache_entry &entry : cache->entries) {
+		if (entry_matches(cache, entry, song, line))
+			return &entry;
+	}
+	return nullptr;
+}
+
+static bool is_wanted(const lyrics_line_cache *cache, const cache_entry &entry)
+{
+	for (const auto &pos : cache->wanted) {
+		if (entry_matches(cache, entry, pos.first, pos.second))
+			return true;
+	}
+	return false;
+}
+
+static void rebuild_wanted(lyrics_line_cache *cache)
+{
+	cache->wanted.clear();
+
+	if (!cache->layout || cache->layout->library->songs.empty() || !cache->max_entries)
+		return;
+
+	const lyrics_library &library = *cache->layout->library;
+	if (cache->song < 0 || cache->song >= (int)library.songs.size() || cache->line < 0 ||
+	    cache->line >= (int)library.songs[cache->song].line_count)
+		return;
+
+	cache->wanted.emplace_back(cache->song, cache->line);
+
+	int next_song = cache->song, next_line = cache->line;
+	int prev_song = cache->song, prev_line = cache->line;
+	const size_t limit = std::min(cache->max_entries, (size_t)library.lines.size());
+
+	for (int i = 0; i < cache->prefetch && cache->wanted.size() < limit; i++) {
+		lyrics_library_next(library, next_song, next_line);
+		cache->wanted.emplace_back(next_song, next_line);
+
+		if (cache->wanted.size() >= limit)
+			break;
+
+		lyrics_library_previous(library, prev_song, prev_line);
+		cache->wanted.emplace_back(prev_song, prev_line);
+	}
+}
+
+// Picks an entry to hold a new line: an unused one, a fresh one within the
+// budget, or the least recently used entry outside the wanted window.
+static cache_entry *claim_entry(lyrics_line_cache *cache)
+{
+	cache_entry *victim = nullptr;
+
+	for (cache_entry &entry : cache->entries) {
+		if (entry.library_generation != cache->library_generation || entry.style_hash != cache->style_hash)
+			return &entry;
+		if (is_wanted(cache, entry))
+			continue;
+		if (!victim || entry.last_used < victim->last_used)
+			victim = &entry;
+	}
+
+	if (cache->entries.size() < cache->max_entries) {
+		cache->entries.emplace_back();
+		return &cache->entries.back();
+	}
+
+	return victim;
+}
+
+static void issue_update(lyrics_line_cache *cache, cache_entry &entry, int song, int line)
+{
+	obs_data_t *settings = obs_data_create();
+	obs_data_apply(settings, cache->style);
+	obs_data_set_string(settings, "text", cache->layout->library->line_text(song, line));
+	const int font_size = cache->layout->line_size(song, line);
+	if (font_size)
+		lyrics_layout_set_font_size(settings, cache->style, font_size);
+
+	if (entry.source)
+		obs_source_update(entry.source, settings);
+	else
+		entry.source = obs_source_create_private("text_ft2_source", "lyrics_line_cache", settings);
+
+	obs_data_release(settings);
+
+	entry.library_generation = cache->library_generation;
+	entry.style_hash = cache->style_hash;
+	entry.song = song;
+	entry.line = line;
+	entry.issued_tick = cache->tick;
+	entry.last_used = cache->tick;
+}
+
+lyrics_line_cache *lyrics_line_cache_create(void)
+{
+	return new lyrics_line_cache();
+}
+
+void lyrics_line_cache_destroy(lyrics_line_cache *cache)
+{
+	if (!cache)
+		return;
+
+	for (cache_entry &entry : cache->entries)
+		obs_source_release(entry.source);
+	obs_data_release(cache->style);
+	delete cache;
+}
+
+void lyrics_line_cache_configure(lyrics_line_cache *cache, uint64_t budget_bytes, int prefetch)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	cache->max_entries = (size_t)(budget_bytes / TEXT_SOURCE_VRAM_ESTIMATE);
+	cache->prefetch = prefetch;
+	rebuild_wanted(cache);
+}
+
+void lyrics_line_cache_set_style(lyrics_line_cache *cache, obs_data_t *style, uint64_t style_hash)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	if (cache->style == style && cache->style_hash == style_hash)
+		return;
+
+	obs_data_addref(style);
+	obs_data_release(cache->style);
+	cache->style = style;
+	cache->style_hash = style_hash;
+	rebuild_wanted(cache);
+}
+
+void lyrics_line_cache_set_layout(lyrics_line_cache *cache, std::shared_ptr<const lyrics_layout> layout)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	cache->layout = std::move(layout);
+	cache->library_generation++;
+	rebuild_wanted(cache);
+}
+
+void lyrics_line_cache_set_position(lyrics_line_cache *cache, int song, int line)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	if (cache->song == song && cache->line == line)
+		return;
+
+	cache->song = song;
+	cache->line = line;
+	rebuild_wanted(cache);
+}
+
+bool lyrics_line_cache_ready(lyrics_line_cache *cache, int song, int line)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	cache_entry *entry = find_entry(cache, song, line);
+	return entry && entry_ready(cache, *entry);
+}
+
+void lyrics_line_cache_tick(lyrics_line_cache *cache)
+{
+	std::vector<obs_source_t *> released;
+
+	{
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		cache->tick++;
+
+		// Shrink to a lowered budget, dropping the least useful entries first
+		while (cache->entries.size() > cache->max_entries) {
+			size_t victim = 0;
+			for (size_t i = 1; i < cache->entries.size(); i++) {
+				if (cache->entries[i].last_used < cache->entries[victim].last_used)
+					victim = i;
+			}
+			released.push_back(cache->entries[victim].source);
+			cache->entries.erase(cache->entries.begin() + victim);
+		}
+
+		int updates = 0;
+		if (cache->style && cache->layout) {
+			for (const auto &pos : cache->wanted) {
+				cache_entry *entry = find_entry(cache, pos.first, pos.second);
+				if (entry) {
+					entry->last_used = cache->tick;
+					continue;
+				}
+				if (updates == UPDATES_PER_TICK)
+					continue;
+
+				entry = claim_entry(cache);
+				if (!entry)
+					break;
+
+				issue_update(cache, *entry, pos.first, pos.second);
+				updates++;
+			}
+		}
+	}
+
+	for (obs_source_t *source : released)
+		obs_source_release(source);
+}
+
+bool lyrics_line_cache_render(lyrics_line_cache *cache, int song, int line)
+{
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	cache_entry *entry = find_entry(cache, song, line);
+	if (!entry || !entry_ready(cache, *entry))
+		return false;
+
+	entry->last_used = cache->tick;
+	obs_source_video_render(entry->source);
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "lyrics-layout.h"
+#include <obs-module.h>
+
+// Pool of private text sources that each hold one already-rasterized line.
+// Lines around the current position are prefetched from video_tick, so that
+// stepping to a neighbouring line only changes which source gets rendered.
+// Entries are keyed by (song, line, style hash) and dropped wholesale when the
+// style or the layout changes.
+struct lyrics_line_cache;
+
+lyrics_line_cache *lyrics_line_cache_create(void);
+void lyrics_line_cache_destroy(lyrics_line_cache *cache);
+
+void lyrics_line_cache_configure(lyrics_line_cache *cache, uint64_t budget_bytes, int prefetch);
+void lyrics_line_cache_set_style(lyrics_line_cache *cache, obs_data_t *style, uint64_t style_hash);
+void lyrics_line_cache_set_layout(lyrics_line_cache *cache, std::shared_ptr<const lyrics_layout> layout);
+void lyrics_line_cache_set_position(lyrics_line_cache *cache, int song, int line);
+
+bool lyrics_line_cache_ready(lyrics_line_cache *cache, int song, int line);
+
+// Graphics thread only
+void lyrics_line_cache_tick(lyrics_line_cache *cache);
+bool lyrics_line_cache_render(lyrics_line_cache *cache, int song, int line);
@@ -0,0 +1,195 @@
+#include "lyrics-loader.h"
+#include "lyrics-watcher.h"
+#include <obs-module.h>
+#include <util/threading.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct lyrics_loader {
+	lyrics_loader_done_t done;
+	void *param;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	lyrics_library_spec pending;
+	bool has_pending = false;
+	std::vector<std::string> changed;
+	bool stopping = false;
+	std::thread thread;
+
+	// Set when stopping; a load in flight checks it and gives up early
+	std::atomic<bool> cancelled{false};
+	std::atomic<bool> finished{false};
+	// Held while done runs, so once destroy took it no callback can follow
+	std::mutex callback_mutex;
+
+	// Loader thread only
+	std::shared_ptr<const lyrics_library> library;
+	lyrics_watcher *watcher = nullptr;
+	std::string watched_folder;
+	bool watched_recursive = false;
+	lyrics_library_spec spec;
+};
+
+static void folder_changed(void *param, const std::vector<std::string> &paths)
+{
+	lyrics_loader *loader = (lyrics_loader *)param;
+
+	{
+		std::lock_guard<std::mutex> lock(loader->mutex);
+		loader->changed.insert(loader->changed.end(), paths.begin(), paths.end());
+	}
+	loader->cond.notify_one();
+}
+
+static void update_watcher(lyrics_loader *loader, const lyrics_library_spec &spec)
+{
+	const std::string folder = spec.use_folder ? spec.folder : std::string();
+	if (loader->watcher && loader->watched_folder == folder && loader->watched_recursive == spec.recursive)
+		return;
+
+	lyrics_watcher_destroy(loader->watcher);
+	loader->watcher = nullptr;
+	loader->watched_folder = folder;
+	loader->watched_recursive = spec.recursive;
+
+	if (!folder.empty())
+		loader->watcher = lyrics_watcher_create(folder, spec.recursive, folder_changed, loader);
+}
+
+static void loader_thread(lyrics_loader *loader)
+{
+	os_set_thread_name("lyrics-loader");
+
+	for (;;) {
+		lyrics_library_spec spec;
+		std::vector<std::string> changed;
+		bool full_load;
+		{
+			std::unique_lock<std::mutex> lock(loader->mutex);
+			loader->cond.wait(lock, [loader] {
+				return loader->stopping || loader->has_pending || !loader->changed.empty();
+			});
+			if (loader->stopping)
+				break;
+
+			full_load = loader->has_pending;
+			if (full_load) {
+				spec = std::move(loader->pending);
+				loader->has_pending = false;
+			}
+
+			// A full load picks up every change anyway
+			changed.swap(loader->changed);
+		}
+
+		std::shared_ptr<const lyrics_library> library;
+		if (full_load) {
+			update_watcher(loader, spec);
+			library = lyrics_library_load(spec, &loader->cancelled);
+			loader->spec = std::move(spec);
+		} else if (loader->library && loader->watcher) {
+			// The watcher reports its folder itself when it lost track
+			const bool rescan =
+				std::find(changed.begin(), changed.end(), loader->watched_folder) != changed.end();
+			if (rescan)
+				library = lyrics_library_load(loader->spec, &loader->cancelled);
+			else
+				library = lyrics_library_update(*loader->library, loader->spec, changed);
+		}
+
+		if (!library)
+			continue;
+
+		loader->library = library;
+
+		// Skip publishing a library that a newer request has already made stale
+		{
+			std::lock_guard<std::mutex> lock(loader->mutex);
+			if (loader->has_pending)
+				continue;
+		}
+
+		std::lock_guard<std::mutex> lock(loader->callback_mutex);
+		if (loader->cancelled)
+			break;
+		loader->done(loader->param, std::move(library));
+	}
+
+	lyrics_watcher_destroy(loader->watcher);
+	loader->watcher = nullptr;
+	loader->finished = true;
+}
+
+// Stopped loaders whose threads may still be finishing a load. They are
+// joined once finished, by the next destroy, or at module unload.
+static std::mutex retired_mutex;
+static std::vector<lyrics_loader *> retired;
+
+static void reap(bool wait)
+{
+	std::vector<lyrics_loader *> done;
+	{
+		std::lock_guard<std::mutex> lock(retired_mutex);
+		auto keep = std::partition(retired.begin(), retired.end(),
+					   [wait](lyrics_loader *loader) { return !wait && !loader->finished; });
+		done.assign(keep, retired.end());
+		retired.erase(keep, retired.end());
+	}
+
+	for (lyrics_loader *loader : done) {
+		loader->thread.join();
+		delete loader;
+	}
+}
+
+lyrics_loader *lyrics_loader_create(lyrics_loader_done_t done, void *param)
+{
+	lyrics_loader *loader = new lyrics_loader();
+	loader->done = done;
+	loader->param = param;
+	loader->thread = std::thread(loader_thread, loader);
+	return loader;
+}
+
+void lyrics_loader_destroy(lyrics_loader *loader)
+{
+	if (!loader)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(loader->mutex);
+		loader->stopping = true;
+		loader->cancelled = true;
+	}
+	loader->cond.notify_one();
+
+	// Waits for a callback that is running, never for a load
+	{
+		std::lock_guard<std::mutex> lock(loader->callback_mutex);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(retired_mutex);
+		retired.push_back(loader);
+	}
+	reap(false);
+}
+
+void lyrics_loader_free_all(void)
+{
+	reap(true);
+}
+
+void lyrics_loader_request(lyrics_loader *loader, const lyrics_library_spec &spec)
+{
+	{
+		std::lock_guard<std::mutex> lock(loader->mutex);
+		loader->pending = spec;
+		loader->has_pending = true;
+	}
+	loader->cond.notify_one();
+}
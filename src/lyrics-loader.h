@@ -0,0 +1,21 @@
+#pragma once
+
+#include "lyrics-library.h"
+
+// Background library loader. Requests are coalesced: if several arrive while a
+// load is running, only the most recent one is loaded next. The completion
+// callback runs on the loader thread.
+//
+// While a folder library is loaded the folder is watched, and files that are
+// added, removed or edited are merged into the library incrementally.
+typedef void (*lyrics_loader_done_t)(void *param, std::shared_ptr<const lyrics_library> library);
+
+struct lyrics_loader;
+
+lyrics_loader *lyrics_loader_create(lyrics_loader_done_t done, void *param);
+// Returns without waiting for a load in flight, which is abandoned; the done
+// callback is never called once this returns. The thread is joined later.
+void lyrics_loader_destroy(lyrics_loader *loader);
+void lyrics_loader_request(lyrics_loader *loader, const lyrics_library_spec &spec);
+// Joins the threads of every destroyed loader; module unload only
+void lyrics_loader_free_all(void);
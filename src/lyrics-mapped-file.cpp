@@ -0,0 +1,130 @@
+#include "lyrics-mapped-file.h"
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Lyrics files are a few KiB; anything this large is not one
+#define MAX_READ_SIZE (64ll * 1024 * 1024)
+#endif
+
+#ifdef _WIN32
+bool lyrics_mapped_file_open(lyrics_mapped_file *file, const char *path)
+{
+	*file = lyrics_mapped_file();
+
+	wchar_t *wpath = nullptr;
+	if (!os_utf8_to_wcs_ptr(path, 0, &wpath))
+		return false;
+
+	HANDLE handle = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+				    FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	bfree(wpath);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size)) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	if (size.QuadPart == 0) {
+		CloseHandle(handle);
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file->data = (const char *)view;
+	file->size = (size_t)size.QuadPart;
+	file->file = handle;
+	file->mapping = mapping;
+	return true;
+}
+
+void lyrics_mapped_file_close(lyrics_mapped_file *file)
+{
+	if (file->data)
+		UnmapViewOfFile(file->data);
+	if (file->mapping)
+		CloseHandle(file->mapping);
+	if (file->file)
+		CloseHandle(file->file);
+	*file = lyrics_mapped_file();
+}
+#else
+bool lyrics_mapped_file_open(lyrics_mapped_file *file, const char *path)
+{
+	*file = lyrics_mapped_file();
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	if (st.st_size > MAX_READ_SIZE) {
+		plugin_log(LOG_WARNING, "Skipping '%s': %lld bytes is too large for a lyrics file", path,
+			   (long long)st.st_size);
+		close(fd);
+		return false;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return true;
+	}
+
+	// A file that shrinks while it is read just ends early
+	char *buffer = (char *)bmalloc((size_t)st.st_size);
+	size_t size = 0;
+	while (size < (size_t)st.st_size) {
+		const ssize_t count = pread(fd, buffer + size, (size_t)st.st_size - size, (off_t)size);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0)
+			break;
+		size += (size_t)count;
+	}
+	close(fd);
+
+	if (!size) {
+		bfree(buffer);
+		return true;
+	}
+
+	file->data = buffer;
+	file->size = size;
+	file->buffer = buffer;
+	return true;
+}
+
+void lyrics_mapped_file_close(lyrics_mapped_file *file)
+{
+	bfree(file->buffer);
+	*file = lyrics_mapped_file();
+}
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only view of a whole file. Empty files give a null pointer with a size
+// of zero. On Windows the file is mapped: a mapped file cannot be truncated
+// there. Elsewhere it is read into memory, because song folders are rewritten
+// in place by editors and sync tools, and touching a mapping of a file that
+// was truncated under it raises SIGBUS.
+struct lyrics_mapped_file {
+	const char *data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void *file = nullptr;
+	void *mapping = nullptr;
+#else
+	char *buffer = nullptr;
+#endif
+};
+
+bool lyrics_mapped_file_open(lyrics_mapped_file *file, const char *path);
+void lyrics_mapped_file_close(lyrics_mapped_file *file);
@@ -0,0 +1,132 @@
+#include "lyrics-registry.h"
+#include <plugin-support.h>
+#include <obs-module.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct registry_entry;
+
+struct lyrics_registry_handle {
+	registry_entry *entry;
+	lyrics_loader_done_t done;
+	void *param;
+};
+
+struct registry_entry {
+	lyrics_library_spec spec;
+	lyrics_loader *loader = nullptr;
+
+	// Guards library and handles; held while callbacks run so a handle
+	// cannot be released in the middle of its own callback
+	std::mutex mutex;
+	std::shared_ptr<const lyrics_library> library;
+	std::vector<lyrics_registry_handle *> handles;
+};
+
+static std::mutex registry_mutex;
+static std::vector<registry_entry *> entries;
+
+static std::mutex link_mutex;
+static std::map<void *, std::string> link_groups;
+
+static void entry_loaded(void *param, std::shared_ptr<const lyrics_library> library)
+{
+	registry_entry *entry = (registry_entry *)param;
+
+	std::lock_guard<std::mutex> lock(entry->mutex);
+	entry->library = library;
+	for (lyrics_registry_handle *handle : entry->handles)
+		handle->done(handle->param, library);
+}
+
+lyrics_registry_handle *lyrics_registry_acquire(const lyrics_library_spec &spec, lyrics_loader_done_t done,
+						void *param)
+{
+	lyrics_registry_handle *handle = new lyrics_registry_handle();
+	handle->done = done;
+	handle->param = param;
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+
+	auto it = std::find_if(entries.begin(), entries.end(),
+			       [&spec](const registry_entry *entry) { return entry->spec == spec; });
+	registry_entry *entry;
+	if (it != entries.end()) {
+		entry = *it;
+	} else {
+		entry = new registry_entry();
+		entry->spec = spec;
+		entry->loader = lyrics_loader_create(entry_loaded, entry);
+		lyrics_loader_request(entry->loader, spec);
+		entries.push_back(entry);
+	}
+
+	handle->entry = entry;
+
+	std::lock_guard<std::mutex> entry_lock(entry->mutex);
+	entry->handles.push_back(handle);
+	if (entry->library)
+		done(param, entry->library);
+
+	plugin_log(LOG_DEBUG, "Library shared by %zu sources", entry->handles.size());
+	return handle;
+}
+
+void lyrics_registry_release(lyrics_registry_handle *handle)
+{
+	if (!handle)
+		return;
+
+	registry_entry *entry = handle->entry;
+	bool last;
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		{
+			std::lock_guard<std::mutex> entry_lock(entry->mutex);
+			entry->handles.erase(std::find(entry->handles.begin(), entry->handles.end(), handle));
+			last = entry->handles.empty();
+		}
+		if (last)
+			entries.erase(std::find(entries.begin(), entries.end(), entry));
+	}
+	delete handle;
+
+	// Stopping the loader waits for a callback that is running (never for a
+	// load), so no locks are held here
+	if (last) {
+		lyrics_loader_destroy(entry->loader);
+		delete entry;
+	}
+}
+
+void lyrics_registry_link(void *source, const char *group)
+{
+	std::lock_guard<std::mutex> lock(link_mutex);
+	if (group && *group)
+		link_groups[source] = group;
+	else
+		link_groups.erase(source);
+}
+
+void lyrics_registry_unlink(void *source)
+{
+	std::lock_guard<std::mutex> lock(link_mutex);
+	link_groups.erase(source);
+}
+
+void lyrics_registry_for_each_linked(void *source, lyrics_registry_linked_t fn, void *param)
+{
+	std::lock_guard<std::mutex> lock(link_mutex);
+
+	auto self = link_groups.find(source);
+	if (self == link_groups.end())
+		return;
+
+	for (const auto &pair : link_groups) {
+		if (pair.first != source && pair.second == self->second)
+			fn(pair.first, param);
+	}
+}
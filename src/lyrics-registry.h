@@ -0,0 +1,25 @@
+#pragma once
+
+#include "lyrics-loader.h"
+
+// Module-wide registry of loaded libraries, keyed by library spec. Sources
+// showing the same folder or file list share one loader, one folder watcher
+// and one parsed library; the entry is dropped when its last handle goes.
+//
+// The done callback runs with the current library right away if it is
+// already loaded, and afterwards on the loader thread for every reload.
+struct lyrics_registry_handle;
+
+lyrics_registry_handle *lyrics_registry_acquire(const lyrics_library_spec &spec, lyrics_loader_done_t done,
+						void *param);
+void lyrics_registry_release(lyrics_registry_handle *handle);
+
+// Link groups: sources that joined the same non-empty group name follow each
+// other's navigation. A source belongs to at most one group.
+typedef void (*lyrics_registry_linked_t)(void *source, void *param);
+
+void lyrics_registry_link(void *source, const char *group);
+void lyrics_registry_unlink(void *source);
+// Calls fn for every other member of source's group; members cannot leave
+// while this runs
+void lyrics_registry_for_each_linked(void *source, lyrics_registry_linked_t fn, void *param);
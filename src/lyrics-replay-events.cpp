@@ -0,0 +1,43 @@
+#include "lyrics-replay-events.h"
+#include "lyrics-source.h"
+#include <cstring>
+
+bool lyrics_replay_play_event(obs_source_t *source, const char *op, obs_data_t *args)
+{
+	void *data = obs_obj_get_data(source);
+
+	if (strcmp(op, "next") == 0) {
+		lyrics_source_next(data);
+	} else if (strcmp(op, "previous") == 0) {
+		lyrics_source_previous(data);
+	} else if (strcmp(op, "toggle") == 0) {
+		lyrics_source_toggle_text(data);
+	} else if (strcmp(op, "play_pause") == 0) {
+		lyrics_source_media_play_pause(data, args && obs_data_get_bool(args, "pause"));
+	} else if (strcmp(op, "restart") == 0) {
+		lyrics_source_media_restart(data);
+	} else if (strcmp(op, "stop") == 0) {
+		lyrics_source_media_stop(data);
+	} else if (strcmp(op, "set_time") == 0) {
+		lyrics_source_media_set_time(data, args ? obs_data_get_int(args, "ms") : 0);
+	} else if (strcmp(op, "update") == 0) {
+		if (args)
+			obs_source_update(source, args);
+	} else if (args) {
+		// Controller procs: goto, goto_song, goto_line, goto_absolute, batch
+		calldata_t cd = {0};
+		if (strcmp(op, "batch") == 0) {
+			calldata_set_string(&cd, "commands", obs_data_get_string(args, "commands"));
+		} else {
+			calldata_set_int(&cd, "song", obs_data_get_int(args, "song"));
+			calldata_set_string(&cd, "name", obs_data_get_string(args, "name"));
+			calldata_set_int(&cd, "line", obs_data_get_int(args, "line"));
+		}
+		const bool known = proc_handler_call(obs_source_get_proc_handler(source), op, &cd);
+		calldata_free(&cd);
+		return known;
+	} else {
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <obs-module.h>
+
+// Applies one event of a recorded timeline (see lyrics-replay.cpp for the
+// format) to a lyrics source, the way the operator's hotkey, controller,
+// media controls or properties window did. Shared by the in-OBS replay and lyrics-replay-check.
+// Returns false for an operation it does not know.
+bool lyrics_replay_play_event(obs_source_t *source, const char *op, obs_data_t *args);
@@ -0,0 +1,391 @@
+#include "lyrics-replay.h"
+#include "lyrics-replay-events.h"
+#include "lyrics-source.h"
+#include "lyrics-stats.h"
+#include <obs-module.h>
+#include <obs-frontend-api.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <graphics/vec4.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A timeline is one recording: the settings every touched source had when it
+// was first touched, then each operator action with its time.
+//
+//   {"sources": [{"name": "Lyrics", "settings": {...}}],
+//    "events": [{"t_us": 1520000, "source": 0, "op": "next"},
+//               {"t_us": 1610000, "source": 0, "op": "update", "args": {...}},
+//               {"t_us": 2000000, "source": 0, "op": "goto_song", "args": {"name": "Amazing Grace"}},
+//               {"t_us": 2400000, "source": 0, "op": "set_time", "args": {"ms": 30000}}]}
+//
+// Replay recreates the sources privately, shows them so they load, and plays
+// the events back at their original times while rendering the sources
+// off-screen every frame. Latency comes from the sources' own statistics
+// (command to the first frame that can show the line); the render path is
+// timed here.
+
+#define LOAD_TIMEOUT_MS 10000
+#define SETTLE_MS 500
+
+static std::atomic<bool> replaying{false};
+static std::thread thread;
+
+static std::atomic<bool> recording{false};
+static std::mutex record_mutex;
+static uint64_t record_start_ns = 0;
+static std::vector<std::string> record_names;
+static obs_data_array_t *record_sources = nullptr;
+static obs_data_array_t *record_events = nullptr;
+
+static obs_data_t *copy_data(obs_data_t *data)
+{
+	obs_data_t *copy = obs_data_create();
+	obs_data_apply(copy, data);
+	return copy;
+}
+
+bool lyrics_replay_recording(void)
+{
+	return recording;
+}
+
+void lyrics_replay_record(obs_source_t *source, const char *op, obs_data_t *args)
+{
+	if (!recording)
+		return;
+
+	const uint64_t now = os_gettime_ns();
+	const char *name = obs_source_get_name(source);
+	if (!name)
+		return;
+
+	std::lock_guard<std::mutex> lock(record_mutex);
+	if (!record_events)
+		return;
+
+	const size_t index = std::find(record_names.begin(), record_names.end(), name) - record_names.begin();
+	if (index == record_names.size()) {
+		record_names.push_back(name);
+
+		obs_data_t *entry = obs_data_create();
+		obs_data_set_string(entry, "name", name);
+		obs_data_t *settings = obs_source_get_settings(source);
+		obs_data_t *snapshot = copy_data(settings);
+		obs_data_set_obj(entry, "settings", snapshot);
+		obs_data_release(snapshot);
+		obs_data_release(settings);
+		obs_data_array_push_back(record_sources, entry);
+		obs_data_release(entry);
+
+		// The snapshot already has these settings
+		if (strcmp(op, "update") == 0)
+			return;
+	}
+
+	obs_data_t *event = obs_data_create();
+	obs_data_set_int(event, "t_us", (long long)((now - record_start_ns) / 1000));
+	obs_data_set_int(event, "source", (long long)index);
+	obs_data_set_string(event, "op", op);
+	if (args) {
+		obs_data_t *copy = copy_data(args);
+		obs_data_set_obj(event, "args", copy);
+		obs_data_release(copy);
+	}
+	obs_data_array_push_back(record_events, event);
+	obs_data_release(event);
+}
+
+static std::string replay_folder()
+{
+	char *path = obs_module_config_path("replay");
+	const std::string folder = path ? path : "";
+	bfree(path);
+	return folder;
+}
+
+static void start_recording()
+{
+	std::lock_guard<std::mutex> lock(record_mutex);
+	record_names.clear();
+	record_sources = obs_data_array_create();
+	record_events = obs_data_array_create();
+	record_start_ns = os_gettime_ns();
+	recording = true;
+	plugin_log(LOG_INFO, "Lyrics replay: recording operator timeline");
+}
+
+static void stop_recording()
+{
+	obs_data_t *timeline = obs_data_create();
+	size_t event_count;
+	{
+		std::lock_guard<std::mutex> lock(record_mutex);
+		recording = false;
+		event_count = obs_data_array_count(record_events);
+		obs_data_set_array(timeline, "sources", record_sources);
+		obs_data_set_array(timeline, "events", record_events);
+		obs_data_array_release(record_sources);
+		obs_data_array_release(record_events);
+		record_sources = nullptr;
+		record_events = nullptr;
+	}
+
+	const std::string folder = replay_folder();
+	os_mkdirs(folder.c_str());
+	const std::string path = folder + "/timeline-" + std::to_string(os_gettime_ns() / 1000000000) + ".json";
+	if (obs_data_save_json(timeline, path.c_str()))
+		plugin_log(LOG_INFO, "Lyrics replay: recorded %zu events to %s", event_count, path.c_str());
+	else
+		plugin_log(LOG_WARNING, "Lyrics replay: %s could not be written", path.c_str());
+	obs_data_release(timeline);
+}
+
+// Graphics thread only while the render callback is installed
+struct replay_render {
+	std::vector<obs_source_t *> sources;
+	gs_texrender_t *target = nullptr;
+	std::vector<uint64_t> render_ns;
+	uint64_t last_frame_ns = 0;
+	uint64_t max_frame_gap_ns = 0;
+};
+
+// Draws every replayed source off-screen, timing each one; the gap between
+// frames also catches stalls in video_tick
+static void render_sources(void *param, uint32_t cx, uint32_t cy)
+{
+	UNUSED_PARAMETER(cx);
+	UNUSED_PARAMETER(cy);
+	replay_render *render = (replay_render *)param;
+
+	const uint64_t frame_ns = os_gettime_ns();
+	if (render->last_frame_ns)
+		render->max_frame_gap_ns = std::max(render->max_frame_gap_ns, frame_ns - render->last_frame_ns);
+	render->last_frame_ns = frame_ns;
+
+	if (!render->target)
+		render->target = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	gs_texrender_reset(render->target);
+	if (!gs_texrender_begin(render->target, 640, 360))
+		return;
+
+	struct vec4 clear_color;
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	gs_ortho(0.0f, 1920.0f, 0.0f, 1080.0f, -100.0f, 100.0f);
+	for (obs_source_t *source : render->sources) {
+		const uint64_t start = os_gettime_ns();
+		obs_source_video_render(source);
+		render->render_ns.push_back(os_gettime_ns() - start);
+	}
+	gs_texrender_end(render->target);
+}
+
+static obs_data_t *replay_timeline(const char *path)
+{
+	obs_data_t *timeline = obs_data_create_from_json_file(path);
+	if (!timeline) {
+		plugin_log(LOG_WARNING, "Lyrics replay: %s is not a timeline", path);
+		return nullptr;
+	}
+
+	obs_data_array_t *sources = obs_data_get_array(timeline, "sources");
+	obs_data_array_t *events = obs_data_get_array(timeline, "events");
+	const size_t source_count = sources ? obs_data_array_count(sources) : 0;
+	const size_t event_count = events ? obs_data_array_count(events) : 0;
+
+	// Private copies, shown so they load like they would on air
+	replay_render render;
+	for (size_t i = 0; i < source_count; i++) {
+		obs_data_t *entry = obs_data_array_item(sources, i);
+		obs_data_t *settings = obs_data_get_obj(entry, "settings");
+		const std::string name = "lyrics_replay_" + std::to_string(i);
+		obs_source_t *source = obs_source_create_private("lyrics_source", name.c_str(), settings);
+		if (source)
+			obs_source_inc_showing(source);
+		render.sources.push_back(source);
+		obs_data_release(settings);
+		obs_data_release(entry);
+	}
+
+	for (obs_source_t *source : render.sources) {
+		void *data = source ? obs_obj_get_data(source) : nullptr;
+		for (int i = 0; data && i < LOAD_TIMEOUT_MS / 10 && lyrics_source_get_song_count(data) == 0; i++)
+			os_sleep_ms(10);
+		if (data && lyrics_source_get_song_count(data) == 0)
+			plugin_log(LOG_WARNING, "Lyrics replay: %s has no songs on this machine",
+				   obs_source_get_name(source));
+	}
+
+	obs_add_main_render_callback(render_sources, &render);
+
+	const uint64_t start_ns = os_gettime_ns();
+	for (size_t i = 0; i < event_count; i++) {
+		obs_data_t *event = obs_data_array_item(events, i);
+		const size_t index = (size_t)obs_data_get_int(event, "source");
+		obs_data_t *args = obs_data_get_obj(event, "args");
+
+		os_sleepto_ns(start_ns + (uint64_t)obs_data_get_int(event, "t_us") * 1000);
+		const char *op = obs_data_get_string(event, "op");
+		if (index < render.sources.size() && render.sources[index] &&
+		    !lyrics_replay_play_event(render.sources[index], op, args))
+			plugin_log(LOG_WARNING, "Lyrics replay: unknown operation '%s'", op);
+
+		obs_data_release(args);
+		obs_data_release(event);
+	}
+	const uint64_t duration_ns = os_gettime_ns() - start_ns;
+	os_sleep_ms(SETTLE_MS);
+
+	obs_remove_main_render_callback(render_sources, &render);
+
+	obs_data_t *result = obs_data_create();
+	obs_data_set_string(result, "timeline", path);
+	obs_data_set_int(result, "events", (long long)event_count);
+	obs_data_set_int(result, "duration_ns", (long long)duration_ns);
+
+	obs_data_t *render_result = obs_data_create();
+	const uint64_t max_frame_gap_ns = render.max_frame_gap_ns;
+	lyrics_stats_set_percentiles(render_result, render.render_ns);
+	const uint64_t worst_render_ns = render.render_ns.empty() ? 0 : render.render_ns.back();
+	obs_data_set_int(render_result, "max_frame_gap_ns", (long long)max_frame_gap_ns);
+	obs_data_set_obj(result, "render", render_result);
+	obs_data_release(render_result);
+
+	// Worst latency over all sources, for the log line
+	double worst_p95_ms = 0.0;
+	double worst_max_ms = 0.0;
+	obs_data_array_t *source_results = obs_data_array_create();
+	for (obs_source_t *source : render.sources) {
+		if (!source)
+			continue;
+
+		calldata_t cd = {0};
+		proc_handler_call(obs_source_get_proc_handler(source), "get_stats", &cd);
+		obs_data_t *stats = obs_data_create_from_json(calldata_string(&cd, "stats"));
+		calldata_free(&cd);
+		if (!stats)
+			continue;
+
+		obs_data_t *latency = obs_data_get_obj(stats, "latency_ms");
+		worst_p95_ms = std::max(worst_p95_ms, obs_data_get_double(latency, "p95"));
+		worst_max_ms = std::max(worst_max_ms, obs_data_get_double(latency, "max"));
+		obs_data_release(latency);
+
+		obs_data_array_push_back(source_results, stats);
+		obs_data_release(stats);
+	}
+	obs_data_set_array(result, "sources", source_results);
+	obs_data_array_release(source_results);
+
+	plugin_log(LOG_INFO,
+		   "Lyrics replay: %s, %zu events: latency p95 %.1f ms, max %.1f ms; worst render %.2f ms, "
+		   "worst frame gap %.1f ms",
+		   path, event_count, worst_p95_ms, worst_max_ms, worst_render_ns / 1e6, max_frame_gap_ns / 1e6);
+
+	obs_enter_graphics();
+	gs_texrender_destroy(render.target);
+	obs_leave_graphics();
+
+	for (obs_source_t *source : render.sources) {
+		if (!source)
+			continue;
+		obs_source_dec_showing(source);
+		obs_source_release(source);
+	}
+
+	obs_data_array_release(events);
+	obs_data_array_release(sources);
+	obs_data_release(timeline);
+	return result;
+}
+
+static void replay_thread()
+{
+	os_set_thread_name("lyrics-replay");
+
+	const std::string folder = replay_folder();
+	const std::string pattern = folder + "/timeline-*.json";
+	os_glob_t *glob = nullptr;
+	if (os_glob(pattern.c_str(), 0, &glob) != 0 || !glob || !glob->gl_pathc) {
+		plugin_log(LOG_INFO, "Lyrics replay: no timelines in %s, record one first", folder.c_str());
+		if (glob)
+			os_globfree(glob);
+		replaying = false;
+		return;
+	}
+
+	obs_data_t *report = obs_data_create();
+	obs_data_set_string(report, "plugin_version", PLUGIN_VERSION);
+	obs_data_array_t *results = obs_data_array_create();
+	for (size_t i = 0; i < glob->gl_pathc; i++) {
+		obs_data_t *result = replay_timeline(glob->gl_pathv[i].path);
+		if (!result)
+			continue;
+		obs_data_array_push_back(results, result);
+		obs_data_release(result);
+	}
+	os_globfree(glob);
+	obs_data_set_array(report, "timelines", results);
+	obs_data_array_release(results);
+
+	const std::string path = folder + "/results-" + std::to_string(os_gettime_ns() / 1000000000) + ".json";
+	if (obs_data_save_json(report, path.c_str()))
+		plugin_log(LOG_INFO, "Lyrics replay finished, results written to %s", path.c_str());
+	else
+		plugin_log(LOG_WARNING, "Lyrics replay finished, but %s could not be written", path.c_str());
+	obs_data_release(report);
+
+	replaying = false;
+}
+
+static void record_clicked(void *data)
+{
+	UNUSED_PARAMETER(data);
+
+	if (recording)
+		stop_recording();
+	else if (replaying)
+		plugin_log(LOG_INFO, "Lyrics replay is running, not recording");
+	else
+		start_recording();
+}
+
+static void replay_clicked(void *data)
+{
+	UNUSED_PARAMETER(data);
+
+	if (recording) {
+		plugin_log(LOG_INFO, "Lyrics replay: stop recording first");
+		return;
+	}
+	if (replaying.exchange(true)) {
+		plugin_log(LOG_INFO, "Lyrics replay is already running");
+		return;
+	}
+
+	if (thread.joinable())
+		thread.join();
+	thread = std::thread(replay_thread);
+}
+
+void lyrics_replay_register(void)
+{
+	obs_frontend_add_tools_menu_item(obs_module_text("LyricsReplayRecord"), record_clicked, nullptr);
+	obs_frontend_add_tools_menu_item(obs_module_text("LyricsReplayRun"), replay_clicked, nullptr);
+}
+
+void lyrics_replay_free(void)
+{
+	if (recording)
+		stop_recording();
+	if (thread.joinable())
+		thread.join();
+}
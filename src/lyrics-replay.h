@@ -0,0 +1,37 @@
+#pragma once
+
+#include <obs-module.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Records what operators do to lyrics sources during a real service and
+// replays it against private copies of those sources, measuring navigation
+// latency and render stalls (ENABLE_REPLAY builds only). Adds "Lyrics Replay"
+// entries to the Tools menu.
+#ifdef ENABLE_REPLAY
+void lyrics_replay_register(void);
+void lyrics_replay_free(void);
+
+// Called by lyrics sources for every navigation and settings update; does
+// nothing unless a recording is running. args is copied. Any thread.
+void lyrics_replay_record(obs_source_t *source, const char *op, obs_data_t *args);
+// Lets callers skip building args when nothing records them
+bool lyrics_replay_recording(void);
+#else
+static inline void lyrics_replay_record(obs_source_t *source, const char *op, obs_data_t *args)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(op);
+	UNUSED_PARAMETER(args);
+}
+static inline bool lyrics_replay_recording(void)
+{
+	return false;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
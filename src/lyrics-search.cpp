@@ -0,0 +1,222 @@
+#include "lyrics-search.h"
+#include "lyrics-library.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+
+static inline uint8_t fold(uint8_t c)
+{
+	return (c >= 'A' && c <= 'Z') ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+static inline uint32_t trigram(const uint8_t *p)
+{
+	return ((uint32_t)fold(p[0]) << 16) | ((uint32_t)fold(p[1]) << 8) | fold(p[2]);
+}
+
+// Sorted, de-duplicated trigrams of every line of a song
+static void song_trigrams(const lyrics_library &library, size_t song, std::vector<uint32_t> &out)
+{
+	out.clear();
+
+	const lyrics_song &s = library.songs[song];
+	for (uint32_t i = 0; i < s.line_count; i++) {
+		const lyrics_line_span &span = library.lines[s.first_line + i];
+		const uint8_t *text = (const uint8_t *)library.arena.data() + span.offset;
+		for (uint32_t j = 0; j + 3 <= span.length; j++)
+			out.push_back(trigram(text + j));
+	}
+
+	std::sort(out.begin(), out.end());
+	out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+static bool same_song_text(const lyrics_library &a, const lyrics_song &sa, const lyrics_library &b,
+			   const lyrics_song &sb)
+{
+	if (sa.line_count != sb.line_count)
+		return false;
+
+	const lyrics_line_span &a_first = a.lines[sa.first_line];
+	const lyrics_line_span &a_last = a.lines[sa.first_line + sa.line_count - 1];
+	const lyrics_line_span &b_first = b.lines[sb.first_line];
+	const lyrics_line_span &b_last = b.lines[sb.first_line + sb.line_count - 1];
+
+	const size_t a_size = a_last.offset + a_last.length - a_first.offset;
+	const size_t b_size = b_last.offset + b_last.length - b_first.offset;
+	return a_size == b_size &&
+	       memcmp(a.arena.data() + a_first.offset, b.arena.data() + b_first.offset, a_size) == 0;
+}
+
+std::shared_ptr<const lyrics_search_index> lyrics_search_build(const lyrics_library &library,
+							       const lyrics_library *previous)
+{
+	const lyrics_search_index *old_index = previous ? previous->search.get() : nullptr;
+
+	// Map songs carried over unchanged from the previous library to their new
+	// index. Libraries keep their songs in file name order, so the mapping is
+	// monotonic and remapped postings stay sorted.
+	std::vector<int64_t> remap;
+	std::vector<bool> carried(library.songs.size(), false);
+	if (old_index) {
+		std::unordered_map<std::string, uint32_t> by_path;
+		for (uint32_t i = 0; i < library.songs.size(); i++)
+			by_path.emplace(library.songs[i].path, i);
+
+		remap.assign(previous->songs.size(), -1);
+		for (size_t i = 0; i < previous->songs.size(); i++) {
+			auto it = by_path.find(previous->songs[i].path);
+			if (it != by_path.end() &&
+			    same_song_text(*previous, previous->songs[i], library, library.songs[it->second])) {
+				remap[i] = it->second;
+				carried[it->second] = true;
+			}
+		}
+	}
+
+	// (trigram, song) pairs for the songs that need tokenizing
+	std::vector<uint64_t> fresh;
+	std::vector<uint32_t> trigrams;
+	for (size_t i = 0; i < library.songs.size(); i++) {
+		if (carried[i])
+			continue;
+		song_trigrams(library, i, trigrams);
+		for (uint32_t t : trigrams)
+			fresh.push_back(((uint64_t)t << 32) | i);
+	}
+	std::sort(fresh.begin(), fresh.end());
+
+	auto index = std::make_shared<lyrics_search_index>();
+	index->offsets.push_back(0);
+	if (old_index)
+		index->postings.reserve(old_index->postings.size() + fresh.size());
+	else
+		index->postings.reserve(fresh.size());
+
+	// Merge the old keys with the fresh pairs, both ascending by trigram
+	size_t old_key = 0;
+	size_t fresh_pos = 0;
+	const size_t old_key_count = old_index ? old_index->keys.size() : 0;
+	std::vector<uint32_t> merged;
+
+	while (old_key < old_key_count || fresh_pos < fresh.size()) {
+		uint32_t key = UINT32_MAX;
+		if (old_key < old_key_count)
+			key = old_index->keys[old_key];
+		if (fresh_pos < fresh.size())
+			key = std::min(key, (uint32_t)(fresh[fresh_pos] >> 32));
+
+		merged.clear();
+		if (old_key < old_key_count && old_index->keys[old_key] == key) {
+			for (uint32_t p = old_index->offsets[old_key]; p < old_index->offsets[old_key + 1]; p++) {
+				const int64_t song = remap[old_index->postings[p]];
+				if (song >= 0)
+					merged.push_back((uint32_t)song);
+			}
+			old_key++;
+		}
+
+		const size_t carried_count = merged.size();
+		if (!std::is_sorted(merged.begin(), merged.end()))
+			std::sort(merged.begin(), merged.end());
+		while (fresh_pos < fresh.size() && (uint32_t)(fresh[fresh_pos] >> 32) == key)
+			merged.push_back((uint32_t)fresh[fresh_pos++]);
+		std::inplace_merge(merged.begin(), merged.begin() + carried_count, merged.end());
+
+		if (merged.empty())
+			continue;
+
+		index->keys.push_back(key);
+		index->postings.insert(index->postings.end(), merged.begin(), merged.end());
+		index->offsets.push_back((uint32_t)index->postings.size());
+	}
+
+	return index;
+}
+
+// Case-insensitive substring test against an already folded needle
+static bool line_contains(const char *line, size_t length, const std::string &needle)
+{
+	if (needle.size() > length)
+		return false;
+
+	const size_t last = length - needle.size();
+	for (size_t i = 0; i <= last; i++) {
+		size_t j = 0;
+		while (j < needle.size() && fold((uint8_t)line[i + j]) == (uint8_t)needle[j])
+			j++;
+		if (j == needle.size())
+			return true;
+	}
+	return false;
+}
+
+static void scan_song(const lyrics_library &library, uint32_t song, const std::string &needle,
+		      std::vector<lyrics_search_hit> &hits, size_t max_results)
+{
+	const lyrics_song &s = library.songs[song];
+	for (uint32_t i = 0; i < s.line_count && hits.size() < max_results; i++) {
+		const lyrics_line_span &span = library.lines[s.first_line + i];
+		if (line_contains(library.arena.data() + span.offset, span.length, needle))
+			hits.push_back({song, i});
+	}
+}
+
+std::vector<lyrics_search_hit> lyrics_search_find(const lyrics_library &library, const char *query,
+						  size_t max_results)
+{
+	std::vector<lyrics_search_hit> hits;
+	if (!query || !max_results)
+		return hits;
+
+	std::string needle;
+	for (const char *p = query; *p; p++)
+		needle.push_back((char)fold((uint8_t)*p));
+	if (needle.empty())
+		return hits;
+
+	const lyrics_search_index *index = library.search.get();
+
+	// Too short to have a trigram, or no index yet: scan everything
+	if (needle.size() < 3 || !index) {
+		for (uint32_t song = 0; song < library.songs.size() && hits.size() < max_results; song++)
+			scan_song(library, song, needle, hits, max_results);
+		return hits;
+	}
+
+	// Posting ranges of every query trigram, shortest first
+	std::vector<std::pair<const uint32_t *, const uint32_t *>> ranges;
+	for (size_t i = 0; i + 3 <= needle.size(); i++) {
+		const uint32_t key = trigram((const uint8_t *)needle.data() + i);
+		auto it = std::lower_bound(index->keys.begin(), index->keys.end(), key);
+		if (it == index->keys.end() || *it != key)
+			return hits;
+
+		const size_t k = (size_t)(it - index->keys.begin());
+		ranges.emplace_back(index->postings.data() + index->offsets[k],
+				    index->postings.data() + index->offsets[k + 1]);
+	}
+	std::sort(ranges.begin(), ranges.end(), [](const auto &a, const auto &b) {
+		return (a.second - a.first) < (b.second - b.first);
+	});
+
+	std::vector<uint32_t> candidates(ranges[0].first, ranges[0].second);
+	std::vector<uint32_t> narrowed;
+	for (size_t i = 1; i < ranges.size() && !candidates.empty(); i++) {
+		narrowed.clear();
+		std::set_intersection(candidates.begin(), candidates.end(), ranges[i].first, ranges[i].second,
+				      std::back_inserter(narrowed));
+		candidates.swap(narrowed);
+	}
+
+	// Trigrams can match out of order, so confirm the phrase line by line
+	for (uint32_t song : candidates) {
+		if (hits.size() >= max_results)
+			break;
+		scan_song(library, song, needle, hits, max_results);
+	}
+
+	return hits;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct lyrics_library;
+
+// Trigram index over the lines of a library. Postings are per song; a query
+// intersects the postings of its trigrams and then only scans the lines of the
+// few candidate songs. Matching is case-insensitive for ASCII.
+struct lyrics_search_index {
+	std::vector<uint32_t> keys;     // distinct trigrams, ascending
+	std::vector<uint32_t> offsets;  // keys.size() + 1 entries into postings
+	std::vector<uint32_t> postings; // song indices, ascending per trigram
+};
+
+struct lyrics_search_hit {
+	uint32_t song;
+	uint32_t line;
+};
+
+// Builds the index for library. If previous is the library it was derived from
+// (and carries an index), postings of songs whose text is unchanged are carried
+// over and only new or edited songs are tokenized.
+std::shared_ptr<const lyrics_search_index> lyrics_search_build(const lyrics_library &library,
+							       const lyrics_library *previous);
+
+std::vector<lyrics_search_hit> lyrics_search_find(const lyrics_library &library, const char *query,
+						  size_t max_results);
@@ -1,4 +1,8 @@
 #include "lyrics-source.h"
+#include "lyrics-background-cache.h"
+#include "lyrics-layout.h"
+#include "lyrics-text-renderer.h"
+#include "lyrics-transition.h"
 #include <obs-module.h>
 
 static bool use_folder_modified(obs_properties_t *props, obs_property_t *property, obs_data_t *settings)
@@ -8,6 +12,8 @@ static bool use_folder_modified(obs_properties_t *props, obs_property_t *propert
 	obs_property_t *folder_path = obs_properties_get(props, LYRICS_FOLDER);
 	obs_property_t *files_list = obs_properties_get(props, LYRICS_FILES);
 	obs_property_set_visible(folder_path, use_folder);
+	obs_property_set_visible(obs_properties_get(props, LYRICS_RECURSIVE), use_folder);
+	obs_property_set_visible(obs_properties_get(props, LYRICS_PATTERNS), use_folder);
 	obs_property_set_visible(files_list, !use_folder);
 	return true;
 }
@@ -18,15 +24,24 @@ obs_properties_t *lyrics_source_properties(void *data)
 
 	// Background Image
 	obs_properties_add_path(props, BACKGROUND_FILE, obs_module_text("BackgroundImage"), OBS_PATH_FILE,
-				"Image Files (*.png *.jpg *.jpeg *.gif *.bmp);;All Files (*)", NULL);
+				lyrics_background_file_filter(), NULL);
 
 	// Lyrics Source Selection
 	obs_property_t *use_folder = obs_properties_add_bool(props, USE_FOLDER, obs_module_text("UseFolder"));
 
 	obs_properties_add_path(props, LYRICS_FOLDER, obs_module_text("LyricsFolder"), OBS_PATH_DIRECTORY, NULL, NULL);
+	obs_properties_add_bool(props, LYRICS_RECURSIVE, obs_module_text("IncludeSubfolders"));
+	obs_property_t *patterns =
+		obs_properties_add_text(props, LYRICS_PATTERNS, obs_module_text("FilePatterns"), OBS_TEXT_DEFAULT);
+	obs_property_set_long_description(patterns, obs_module_text("FilePatterns.Description"));
 
 	obs_properties_add_editable_list(props, LYRICS_FILES, obs_module_text("LyricsFiles"),
-					 OBS_EDITABLE_LIST_TYPE_FILES, "Text Files (*.txt);;All Files (*)", NULL);
+					 OBS_EDITABLE_LIST_TYPE_FILES, "Lyrics Files (*.txt *.lrc);;All Files (*)",
+					 NULL);
+
+	obs_property_t *setlist = obs_properties_add_editable_list(props, SETLIST, obs_module_text("Setlist"),
+								   OBS_EDITABLE_LIST_TYPE_STRINGS, NULL, NULL);
+	obs_property_set_long_description(setlist, obs_module_text("Setlist.Description"));
 
 	// Layout groups
 	obs_properties_t *align_group = obs_properties_create();
@@ -51,6 +66,12 @@ obs_properties_t *lyrics_source_properties(void *data)
 	obs_properties_add_int(pos_group, TEXT_Y, obs_module_text("TextY"), -2160, 2160, 1);
 	obs_properties_add_int(pos_group, TEXT_WIDTH, obs_module_text("TextWidth"), 1, 3840, 1);
 	obs_properties_add_int(pos_group, TEXT_HEIGHT, obs_module_text("TextHeight"), 1, 2160, 1);
+	obs_property_t *fit_mode = obs_properties_add_list(pos_group, TEXT_FIT_MODE, obs_module_text("FitMode"),
+							   OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(fit_mode, obs_module_text("FitMode.None"), LYRICS_FIT_NONE);
+	obs_property_list_add_int(fit_mode, obs_module_text("FitMode.Shrink"), LYRICS_FIT_SHRINK);
+	obs_property_list_add_int(fit_mode, obs_module_text("FitMode.Paginate"), LYRICS_FIT_PAGINATE);
+	obs_property_set_long_description(fit_mode, obs_module_text("FitMode.Description"));
 	obs_properties_add_bool(pos_group, TEXT_SHOW_BOUNDS, obs_module_text("ShowBounds"));
 	obs_properties_add_color_alpha(pos_group, TEXT_BOUNDS_COLOR, obs_module_text("BoundsColor"));
 	obs_properties_add_int(pos_group, TEXT_BOUNDS_THICKNESS, obs_module_text("BoundsThickness"), 1, 20, 1);
@@ -66,6 +87,12 @@ obs_properties_t *lyrics_source_properties(void *data)
 	obs_property_list_add_int(weight, obs_module_text("Normal"), 400);
 	obs_property_list_add_int(weight, obs_module_text("Bold"), 700);
 
+	obs_property_t *renderer = obs_properties_add_list(props, TEXT_RENDERER, obs_module_text("TextRenderer"),
+							   OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(renderer, obs_module_text("TextRenderer.Source"), LYRICS_TEXT_RENDERER_SOURCE);
+	obs_property_list_add_int(renderer, obs_module_text("TextRenderer.Builtin"), LYRICS_TEXT_RENDERER_BUILTIN);
+	obs_property_set_long_description(renderer, obs_module_text("TextRenderer.Description"));
+
 	// Text Color
 	obs_properties_add_color(props, TEXT_COLOR, obs_module_text("TextColor"));
 
@@ -80,6 +107,56 @@ obs_properties_t *lyrics_source_properties(void *data)
 	obs_properties_add_int(props, TEXT_SHADOW_OFFSET_Y, obs_module_text("ShadowOffsetY"), -50, 50, 1);
 	obs_properties_add_color(props, TEXT_SHADOW_COLOR, obs_module_text("ShadowColor"));
 
+	// Timed playback
+	obs_property_t *auto_advance =
+		obs_properties_add_bool(props, LRC_AUTO_ADVANCE, obs_module_text("LrcAutoAdvance"));
+	obs_property_set_long_description(auto_advance, obs_module_text("LrcAutoAdvance.Description"));
+	obs_property_t *karaoke = obs_properties_add_bool(props, KARAOKE, obs_module_text("Karaoke"));
+	obs_property_set_long_description(karaoke, obs_module_text("Karaoke.Description"));
+	obs_properties_add_color(props, KARAOKE_COLOR, obs_module_text("KaraokeColor"));
+
+	// Linked sources
+	obs_property_t *link_group =
+		obs_properties_add_text(props, LINK_GROUP, obs_module_text("LinkGroup"), OBS_TEXT_DEFAULT);
+	obs_property_set_long_description(link_group, obs_module_text("LinkGroup.Description"));
+
+	// Line transitions
+	obs_properties_t *transition_group = obs_properties_create();
+	obs_property_t *mode = obs_properties_add_list(transition_group, TRANSITION_MODE, obs_module_text("Transition"),
+						       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(mode, obs_module_text("Transition.None"), LYRICS_TRANSITION_NONE);
+	obs_property_list_add_int(mode, obs_module_text("Transition.Fade"), LYRICS_TRANSITION_FADE);
+	obs_property_list_add_int(mode, obs_module_text("Transition.Crossfade"), LYRICS_TRANSITION_CROSSFADE);
+	obs_property_list_add_int(mode, obs_module_text("Transition.Slide"), LYRICS_TRANSITION_SLIDE);
+	obs_property_t *duration = obs_properties_add_int(transition_group, TRANSITION_DURATION,
+							  obs_module_text("TransitionDuration"), 50, 5000, 50);
+	obs_property_int_set_suffix(duration, " ms");
+
+	obs_properties_add_group(props, "transition_group", obs_module_text("LineTransition"), OBS_GROUP_NORMAL,
+				 transition_group);
+
+	// Line and background caches
+	obs_properties_t *cache_group = obs_properties_create();
+	obs_property_t *budget = obs_properties_add_int(cache_group, LINE_CACHE_BUDGET,
+							obs_module_text("LineCacheBudget"), 0, 1024, 4);
+	obs_property_int_set_suffix(budget, " MiB");
+	obs_properties_add_int(cache_group, LINE_CACHE_PREFETCH, obs_module_text("LineCachePrefetch"), 0, 16, 1);
+	obs_property_t *background_budget = obs_properties_add_int(
+		cache_group, BACKGROUND_CACHE_BUDGET, obs_module_text("BackgroundCacheBudget"), 16, 4096, 16);
+	obs_property_int_set_suffix(background_budget, " MiB");
+
+	obs_properties_add_group(props, "cache_group", obs_module_text("LineCache"), OBS_GROUP_NORMAL, cache_group);
+
+	// Statistics
+	obs_properties_t *stats_group = obs_properties_create();
+	obs_property_t *interval =
+		obs_properties_add_int(stats_group, STATS_INTERVAL, obs_module_text("StatsInterval"), 0, 3600, 10);
+	obs_property_int_set_suffix(interval, " s");
+	obs_properties_add_path(stats_group, STATS_CSV, obs_module_text("StatsCsv"), OBS_PATH_FILE_SAVE,
+				"CSV Files (*.csv);;All Files (*)", NULL);
+
+	obs_properties_add_group(props, "stats_group", obs_module_text("Statistics"), OBS_GROUP_NORMAL, stats_group);
+
 	// Set property callbacks
 	obs_property_set_modified_callback(use_folder, use_folder_modified);
 	if (data) {
@@ -95,12 +172,18 @@ obs_properties_t *lyrics_source_properties(void *data)
 void lyrics_source_get_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_bool(settings, USE_FOLDER, false);
+	obs_data_set_default_bool(settings, LRC_AUTO_ADVANCE, true);
+	obs_data_set_default_bool(settings, KARAOKE, true);
+	obs_data_set_default_int(settings, KARAOKE_COLOR, 0xFF00D7FF); // gold
+	obs_data_set_default_bool(settings, LYRICS_RECURSIVE, false);
+	obs_data_set_default_string(settings, LYRICS_PATTERNS, "*.txt;*.lrc");
 	obs_data_set_default_int(settings, TEXT_COLOR, 0xFFFFFFFF);
 	obs_data_set_default_int(settings, TEXT_H_ALIGN, 1); // Center
 	obs_data_set_default_int(settings, TEXT_V_ALIGN, 2); // Bottom
 	obs_data_set_default_int(settings, TEXT_X, 0);
 	obs_data_set_default_int(settings, TEXT_Y, 0);
 	obs_data_set_default_int(settings, TEXT_WIDTH, 800);
+	obs_data_set_default_int(settings, TEXT_FIT_MODE, LYRICS_FIT_NONE);
 	obs_data_set_default_int(settings, TEXT_HEIGHT, 200);
 	obs_data_set_default_bool(settings, TEXT_SHOW_BOUNDS, true);
 	obs_data_set_default_int(settings, TEXT_BOUNDS_COLOR, 0x80FFFFFF);
@@ -108,6 +191,7 @@ void lyrics_source_get_defaults(obs_data_t *settings)
 	obs_data_set_default_string(settings, TEXT_FONT_NAME, "Arial");
 	obs_data_set_default_int(settings, TEXT_FONT_SIZE, 48);
 	obs_data_set_default_int(settings, TEXT_FONT_WEIGHT, 400);
+	obs_data_set_default_int(settings, TEXT_RENDERER, LYRICS_TEXT_RENDERER_SOURCE);
 	obs_data_set_default_bool(settings, TEXT_OUTLINE, true);
 	obs_data_set_default_int(settings, TEXT_OUTLINE_SIZE, 2);
 	obs_data_set_default_int(settings, TEXT_OUTLINE_COLOR, 0xFF000000);
@@ -115,4 +199,10 @@ void lyrics_source_get_defaults(obs_data_t *settings)
 	obs_data_set_default_int(settings, TEXT_SHADOW_OFFSET_X, 4);
 	obs_data_set_default_int(settings, TEXT_SHADOW_OFFSET_Y, 4);
 	obs_data_set_default_int(settings, TEXT_SHADOW_COLOR, 0x80000000);
+	obs_data_set_default_int(settings, TRANSITION_MODE, LYRICS_TRANSITION_NONE);
+	obs_data_set_default_int(settings, TRANSITION_DURATION, 300);
+	obs_data_set_default_int(settings, LINE_CACHE_BUDGET, 64);
+	obs_data_set_default_int(settings, BACKGROUND_CACHE_BUDGET, 256);
+	obs_data_set_default_int(settings, LINE_CACHE_PREFETCH, 2);
+	obs_data_set_default_int(settings, STATS_INTERVAL, 0);
 }
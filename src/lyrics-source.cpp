@@ -1,96 +1,425 @@
 #include "lyrics-source.h"
+#include "lyrics-background-cache.h"
+#include "lyrics-library.h"
+#include "lyrics-registry.h"
+#include "lyrics-replay.h"
+#include "lyrics-line-cache.h"
+#include "lyrics-cache.h"
+#include "lyrics-commands.h"
+#include "lyrics-layout.h"
+#include "lyrics-stats.h"
+#include "lyrics-text-renderer.h"
+#include "lyrics-transition.h"
 #include <obs-module.h>
 #include <obs-frontend-api.h>
+#include <plugin-support.h>
 #include <util/platform.h>
 #include <util/dstr.h>
-#include <QFile>
-#include <QTextStream>
+#include <util/profiler.h>
 #include <QFileDialog>
 #include <QMainWindow>
-#include <QFileInfo>
-#include <QDir>
-#include <QString>
-#include <QStringList>
 #include <graphics/image-file.h>
 #include <graphics/vec4.h>
-#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <cmath>
 
-// Internal data structure to hold Qt types
-struct lyrics_source_data {
-	std::vector<QStringList> songs;
-	std::vector<QString> song_names;
+// How long the last word of a line is wiped when nothing says when it ends
+#define LAST_WORD_MS 1000
+// Timed songs have no end time; the seek bar runs this far past the last line
+#define LAST_LINE_MS 5000
+
+// A word of the shown line, placed in the built-in renderer's layout
+struct karaoke_word {
+	int64_t time; // ms
+	float start;  // reading positions of its first and last glyph
+	float end;
 };
 
-static void load_lyrics_from_file(lyrics_source *ls, const QString &filepath)
-{
-	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+// Settings that video_tick and render read, and what video_tick loads. update
+// publishes a new immutable copy, and video_tick adopts it at the start of a
+// frame, so a frame never sees half of an update.
+struct render_settings {
+	lyrics_library_spec spec;
+	std::string background_file; // default background; songs may bring their own
+
+	int text_renderer = LYRICS_TEXT_RENDERER_SOURCE;
+	int text_x = 0;
+	int text_y = 0;
+	int text_width = 0;
+	int text_height = 0;
+	bool show_bounds = false;
+	uint32_t bounds_color = 0;
+	int bounds_thickness = 0;
+	bool lrc_auto_advance = false;
+	bool karaoke = false; // highlight words of enhanced LRC lines as they are sung
+	int stats_interval = 0; // seconds, 0 disables the periodic dump
+};
 
-	QFile file(filepath);
-	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-		return;
+// Internal data structure to hold C++ types
+//
+// Threading: video_tick owns the position (current_song, current_line,
+// text_visible). Everything else that navigates queues a command for it, and
+// reads the position back from the published copy. Neither navigation nor
+// render takes a lock that a reload could hold.
+struct lyrics_source_data {
+	// Latest laid out library, published RCU-style: the layout thread swaps the
+	// pointer with std::atomic_store, readers pin a snapshot with
+	// std::atomic_load, and an old one is freed when its last reader lets go
+	std::shared_ptr<const lyrics_layout> layout =
+		std::make_shared<lyrics_layout>(lyrics_layout{std::make_shared<lyrics_library>(), {}});
+	// The layout the position currently refers to, and its library. Graphics
+	// thread only.
+	std::shared_ptr<const lyrics_layout> current_layout;
+	std::shared_ptr<const lyrics_library> current;
+	lyrics_library_spec spec;
+	lyrics_registry_handle *library_handle = nullptr;
+	lyrics_line_cache *line_cache = nullptr;
+
+	// Shared parsed libraries are laid out for this source's font and text
+	// box in the background; layout is the result
+	lyrics_layouter *layouter = nullptr;
+	// Font size the text source currently has, 0 for the configured one.
+	// Graphics thread only.
+	int text_font_size = 0;
+
+	lyrics_command_queue *commands = nullptr;
+	// Position for other threads: song << 32 | line << 1 | visible
+	std::atomic<uint64_t> position{1};
+
+	// Render settings as of the last update, published like the library
+	std::shared_ptr<const render_settings> pending_settings = std::make_shared<render_settings>();
+	// The ones the current frame uses. Graphics thread only.
+	std::shared_ptr<const render_settings> settings = pending_settings;
+
+	// Guards style, text_style and stats_csv, which settings updates replace
+	std::mutex mutex;
+
+	// Text source settings are split into style (rebuilt only when a style
+	// setting changes) and content (just "text"). Changes are only flagged
+	// here and applied at most once per frame from video_tick.
+	obs_data_t *style = nullptr;
+	uint64_t style_hash = 0;
+	std::atomic<bool> style_dirty{false};
+	std::atomic<bool> content_dirty{false};
+
+	// The built-in renderer draws instead of the text source when selected
+	// (graphics thread only). Its style is kept apart because it takes the
+	// true shadow offsets, which the text source settings reduce to a distance.
+	lyrics_text_renderer *renderer = nullptr;
+	lyrics_text_style text_style; // guarded by mutex
+
+	// Background and bounds overlay, composited once and redrawn only when
+	// their settings change. Graphics thread only apart from the dirty flag.
+	gs_texrender_t *static_layer = nullptr;
+	uint32_t static_cx = 0;
+	uint32_t static_cy = 0;
+	bool static_empty = true;
+	std::atomic<bool> static_dirty{true};
+	uint64_t static_background = 0; // id of the background in the layer
+
+	// Backgrounds of the current and next song are requested whenever the
+	// song changes, so the next one is decoded before it is reached
+	lyrics_background_cache *backgrounds = nullptr;
+	int background_song = -1; // graphics thread only
+
+	// Animated backgrounds play in a private media source that only exists
+	// while one is shown. Graphics thread only apart from the size, which is
+	// that of the default background once it plays (videos have no other).
+	obs_source_t *animation = nullptr;
+	std::string animation_path;
+	std::atomic<uint32_t> animation_cx{0};
+	std::atomic<uint32_t> animation_cy{0};
+
+	// Navigation latency is measured from the request to the first rendered
+	// frame that can show the new line: the same tick when the line cache has
+	// it, otherwise the tick after the text source applies its update.
+	lyrics_stats *stats = nullptr;
+	std::atomic<uint64_t> navigation_ns{0};
+	uint64_t tick_count = 0;
+	uint64_t visible_tick = 0;
+	float stats_elapsed = 0.0f;
+	std::string stats_csv; // guarded by mutex
+
+	// Every applied text change bumps content_serial; render captures the new
+	// line into the transition once it is visible. Graphics thread only.
+	lyrics_transition *transition = nullptr;
+	uint64_t content_serial = 0;
+	uint64_t captured_serial = 0;
+	bool hard_cut = false;
+
+	// Songs and the default background are not loaded until the source is
+	// first shown or activated (which includes the Studio Mode preview), or
+	// a controller asks for its songs. A scene collection full of lyrics
+	// sources then opens without parsing any of them; until a source loads,
+	// settings updates are only recorded. Only video_tick loads, both the
+	// first time and after updates, so spec and library_handle are graphics
+	// thread only.
+	std::atomic<bool> load_requested{false};
+	std::atomic<bool> loaded{false};
+	uint64_t created_ns = 0;
+	std::atomic<bool> load_logged{false};
+
+	// Play clock for timed songs, advanced from video_tick while playing
+	std::atomic<bool> playing{false};
+	std::atomic<int64_t> play_ns{0};
+
+	// Word highlighting for enhanced LRC lines in the built-in renderer. The
+	// words of a line are placed once when it is laid out; after that a tick
+	// only moves the wipe, and the line is never rasterized again. Graphics
+	// thread only.
+	std::vector<karaoke_word> karaoke_words;
+	uint64_t karaoke_serial = UINT64_MAX; // content_serial the words were placed for
+	bool karaoke_enabled = false;
+	float karaoke_progress = LYRICS_TEXT_NO_PROGRESS;
+	bool karaoke_dirty = false; // the transition layer shows an older wipe
+};
 
-	QTextStream in(&file);
-	QStringList lines;
-	while (!in.atEnd()) {
-		QString line = in.readLine().trimmed();
-		if (!line.isEmpty())
-			lines.append(line);
-	}
+static const char *update_profile_name = "lyrics_source_update";
+static const char *load_profile_name = "load_lyrics_files";
+static const char *text_profile_name = "update_text_source";
+static const char *render_profile_name = "lyrics_source_render";
 
-	if (!lines.isEmpty()) {
-		data->songs.push_back(lines);
-		QFileInfo fileInfo(filepath);
-		data->song_names.push_back(fileInfo.baseName());
-	}
-}
+// profile_start/profile_end pair for the enclosing block
+struct profile_scope {
+	const char *name;
+	explicit profile_scope(const char *name) : name(name) { profile_start(name); }
+	~profile_scope() { profile_end(name); }
+};
 
-static void load_lyrics_files(lyrics_source *ls)
+static lyrics_library_spec build_library_spec(lyrics_source *ls)
 {
-	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
-	data->songs.clear();
-	data->song_names.clear();
-	ls->current_song = 0;
-	ls->current_line = 0;
-
-	if (ls->use_folder && ls->lyrics_folder) {
-		QDir dir(ls->lyrics_folder);
-		QStringList filters;
-		filters << "*.txt";
-		dir.setNameFilters(filters);
-
-		QFileInfoList files = dir.entryInfoList(QDir::Files | QDir::Readable);
-		for (const QFileInfo &fileInfo : files) {
-			load_lyrics_from_file(ls, fileInfo.absoluteFilePath());
-		}
+	lyrics_library_spec spec;
+	spec.use_folder = ls->use_folder;
+
+	if (ls->use_folder) {
+		if (ls->lyrics_folder)
+			spec.folder = ls->lyrics_folder;
+		if (ls->lyrics_patterns)
+			spec.patterns = ls->lyrics_patterns;
+		spec.recursive = ls->lyrics_recursive;
 	} else if (ls->lyrics_files) {
 		size_t count = obs_data_array_count(ls->lyrics_files);
 		for (size_t i = 0; i < count; i++) {
 			obs_data_t *item = obs_data_array_item(ls->lyrics_files, i);
 			const char *filepath = obs_data_get_string(item, "value");
 			if (filepath && *filepath)
-				load_lyrics_from_file(ls, QString::fromUtf8(filepath));
+				spec.files.push_back(filepath);
 			obs_data_release(item);
 		}
 	}
+
+	// Song IDs in play order; only these songs get parsed
+	if (ls->setlist) {
+		size_t count = obs_data_array_count(ls->setlist);
+		for (size_t i = 0; i < count; i++) {
+			obs_data_t *item = obs_data_array_item(ls->setlist, i);
+			const char *id = obs_data_get_string(item, "value");
+			if (id && *id)
+				spec.setlist.push_back(id);
+			obs_data_release(item);
+		}
+	}
+
+	return spec;
 }
 
-static void update_text_source(lyrics_source *ls)
+static void request_text_update(lyrics_source *ls)
 {
-	if (!ls->text_source)
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	data->content_dirty = true;
+}
+
+// Runs on the loader thread once a new library has been parsed, or right away
+// when the library is already shared by another source. Hands it to the
+// layout thread.
+static void library_loaded(void *param, std::shared_ptr<const lyrics_library> library)
+{
+	lyrics_source *ls = (lyrics_source *)param;
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	lyrics_stats_record(data->stats, LYRICS_STATS_LOAD, library->load_time_ns);
+	if (!data->load_logged.exchange(true))
+		plugin_log(LOG_INFO, "'%s' loaded %zu songs in %.1f ms on first use, instead of at startup",
+			   obs_source_get_name(ls->source), library->songs.size(), library->load_time_ns / 1e6);
+	lyrics_layouter_set_library(data->layouter, std::move(library));
+}
+
+// Runs on the layout thread. Only publishes the layout; video_tick moves the
+// position over on its next frame.
+static void library_laid_out(void *param, std::shared_ptr<const lyrics_layout> layout)
+{
+	lyrics_source *ls = (lyrics_source *)param;
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	std::atomic_store(&data->layout, std::move(layout));
+}
+
+static std::shared_ptr<const lyrics_library> get_library(lyrics_source_data *data)
+{
+	return std::atomic_load(&data->layout)->library;
+}
+
+struct source_position {
+	int song;
+	int line;
+	bool visible;
+};
+
+// Publishes the position for other threads and tells controllers about it.
+// Signal handlers run right here on the graphics thread, so the calldata
+// lives on the stack.
+static void publish_position(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	const uint64_t position = (uint64_t)(uint32_t)ls->current_song << 32 |
+				  (uint64_t)(uint32_t)ls->current_line << 1 | (ls->text_visible ? 1 : 0);
+	if (data->position.exchange(position) == position)
 		return;
 
+	const lyrics_library &library = *data->current;
+	long long absolute = -1;
+	if (ls->current_song < (int)library.songs.size())
+		absolute = (long long)library.songs[ls->current_song].first_line + ls->current_line;
+
+	uint8_t stack[256];
+	calldata_t cd;
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_ptr(&cd, "source", ls->source);
+	calldata_set_int(&cd, "song", ls->current_song);
+	calldata_set_int(&cd, "line", ls->current_line);
+	calldata_set_int(&cd, "absolute", absolute);
+	calldata_set_bool(&cd, "visible", ls->text_visible);
+	signal_handler_signal(obs_source_get_signal_handler(ls->source), "position_changed", &cd);
+}
+
+// The position as of the last frame, for threads other than the graphics thread
+static source_position get_position(lyrics_source_data *data)
+{
+	const uint64_t position = data->position;
+	return {(int)(uint32_t)(position >> 32), (int)((uint32_t)position >> 1), (position & 1) != 0};
+}
+
+static void push_command(lyrics_source *ls, lyrics_command_type type)
+{
 	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
-	obs_data_t *settings = obs_data_create();
+	lyrics_command *command = new lyrics_command();
+	command->type = type;
+	lyrics_command_push(data->commands, command);
+}
 
-	// Set text content
-	QString text;
-	if (ls->text_visible && ls->current_song >= 0 && ls->current_song < (int)data->songs.size() &&
-	    ls->current_line >= 0 && ls->current_line < data->songs[ls->current_song].size()) {
-		text = data->songs[ls->current_song][ls->current_line];
+// Starts decoding the current song's background and prefetching the next one's
+static void request_backgrounds(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	const lyrics_library &library = *data->current;
+	if (ls->current_song == data->background_song || ls->current_song >= (int)library.songs.size())
+		return;
+
+	data->background_song = ls->current_song;
+	lyrics_background_cache_request(data->backgrounds, library.songs[ls->current_song].path);
+	const size_t next = ((size_t)ls->current_song + 1) % library.songs.size();
+	lyrics_background_cache_request(data->backgrounds, library.songs[next].path);
+}
+
+// Moves the position onto a newly published layout, keeping the same song
+// if it survived the reload. Graphics thread only.
+static void adopt_layout(lyrics_source *ls, std::shared_ptr<const lyrics_layout> layout)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	const std::shared_ptr<const lyrics_library> &library = layout->library;
+
+	int song = -1;
+	const lyrics_library &old_library = *data->current;
+	if (ls->current_song >= 0 && ls->current_song < (int)old_library.songs.size())
+		song = lyrics_library_find_song(*library, old_library.songs[ls->current_song].path);
+
+	if (song < 0) {
+		song = 0;
+		ls->current_line = 0;
 	}
 
-	obs_data_set_string(settings, "text", text.toUtf8().constData());
+	ls->current_song = song;
+	if (song < (int)library->songs.size()) {
+		const int line_count = (int)library->songs[song].line_count;
+		if (ls->current_line >= line_count)
+			ls->current_line = line_count - 1;
+	} else {
+		ls->current_line = 0;
+	}
+
+	lyrics_line_cache_set_layout(data->line_cache, layout);
+	lyrics_line_cache_set_position(data->line_cache, ls->current_song, ls->current_line);
+	data->current = library;
+	data->current_layout = std::move(layout);
+
+	uint8_t stack[128];
+	calldata_t cd;
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_ptr(&cd, "source", ls->source);
+	calldata_set_int(&cd, "songs", (long long)data->current->songs.size());
+	calldata_set_int(&cd, "lines", (long long)data->current->lines.size());
+	signal_handler_signal(obs_source_get_signal_handler(ls->source), "library_changed", &cd);
+
+	// Sidecar images may have been added with the songs
+	lyrics_background_cache_forget_missing(data->backgrounds);
+	data->background_song = -1;
+	request_backgrounds(ls);
+
+	publish_position(ls);
+	request_text_update(ls);
+}
+
+static void load_lyrics_files(lyrics_source *ls)
+{
+	profile_scope profile(load_profile_name);
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	const lyrics_library_spec &spec = data->settings->spec;
+	if (spec == data->spec)
+		return;
+
+	data->spec = spec;
+
+	// Release first so the old library can no longer be delivered after the new one
+	lyrics_registry_release(data->library_handle);
+	data->library_handle = lyrics_registry_acquire(spec, library_loaded, ls);
+}
+
+// Loads the library and the default background for the adopted settings.
+// Graphics thread only.
+static void load_content(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	lyrics_background_cache_set_default(data->backgrounds, data->settings->background_file.c_str());
+	load_lyrics_files(ls);
+}
+
+// Any thread; the load itself starts on the next video_tick
+static void request_load(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	data->load_requested = true;
+}
+
+static void start_deferred_load(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	if (data->loaded || !data->load_requested)
+		return;
+
+	data->loaded = true;
+	plugin_log(LOG_DEBUG, "'%s' shown %.1f s after it was created, loading its songs",
+		   obs_source_get_name(ls->source), (os_gettime_ns() - data->created_ns) / 1e9);
+	load_content(ls);
+}
+
+// Everything the text source needs except the text itself
+static obs_data_t *create_style_settings(lyrics_source *ls)
+{
+	obs_data_t *settings = obs_data_create();
 
 	// Font settings
 	obs_data_t *font = obs_data_create();
@@ -114,26 +443,15 @@ static void update_text_source(lyrics_source *ls)
 	obs_data_set_int(settings, "shadow_distance", shadow_distance);
 	obs_data_set_int(settings, "shadow_color", ls->shadow_color);
 
-	// Alignment
+	// Alignment, indexed by [v_align][h_align]
+	static const char *const align_names[3][3] = {
+		{"top_left", "top_center", "top_right"},
+		{"center_left", "center", "center_right"},
+		{"bottom_left", "bottom_center", "bottom_right"},
+	};
 	const char *align_str = "center";
-	if (ls->text_h_align == 0 && ls->text_v_align == 0)
-		align_str = "top_left";
-	else if (ls->text_h_align == 1 && ls->text_v_align == 0)
-		align_str = "top_center";
-	else if (ls->text_h_align == 2 && ls->text_v_align == 0)
-		align_str = "top_right";
-	else if (ls->text_h_align == 0 && ls->text_v_align == 1)
-		align_str = "center_left";
-	else if (ls->text_h_align == 1 && ls->text_v_align == 1)
-		align_str = "center";
-	else if (ls->text_h_align == 2 && ls->text_v_align == 1)
-		align_str = "center_right";
-	else if (ls->text_h_align == 0 && ls->text_v_align == 2)
-		align_str = "bottom_left";
-	else if (ls->text_h_align == 1 && ls->text_v_align == 2)
-		align_str = "bottom_center";
-	else if (ls->text_h_align == 2 && ls->text_v_align == 2)
-		align_str = "bottom_right";
+	if (ls->text_h_align >= 0 && ls->text_h_align < 3 && ls->text_v_align >= 0 && ls->text_v_align < 3)
+		align_str = align_names[ls->text_v_align][ls->text_h_align];
 	obs_data_set_string(settings, "align", align_str);
 
 	// Word wrap
@@ -142,36 +460,327 @@ static void update_text_source(lyrics_source *ls)
 	obs_data_set_int(settings, "extents_height", ls->text_height);
 	obs_data_set_bool(settings, "extents", true);
 
+	return settings;
+}
+
+// The same style for the built-in renderer
+static lyrics_text_style create_text_style(lyrics_source *ls)
+{
+	lyrics_text_style style;
+	style.face = ls->font_name ? ls->font_name : "Arial";
+	style.weight = ls->font_weight;
+	style.size = ls->font_size;
+	style.color = ls->text_color;
+	style.outline = ls->outline_enabled ? ls->outline_size : 0;
+	style.outline_color = ls->outline_color;
+	style.shadow = ls->shadow_enabled;
+	style.shadow_x = ls->shadow_offset_x;
+	style.shadow_y = ls->shadow_offset_y;
+	style.shadow_color = ls->shadow_color;
+	style.highlight_color = ls->karaoke_color;
+	style.h_align = ls->text_h_align;
+	style.v_align = ls->text_v_align;
+	style.width = ls->text_width;
+	style.height = ls->text_height;
+	return style;
+}
+
+// Rebuilds the cached style settings, flagging them dirty only if something changed
+static void update_style(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	obs_data_t *style = create_style_settings(ls);
+	const char *style_json = obs_data_get_json(style);
+	const uint64_t style_hash = lyrics_cache_hash(style_json, strlen(style_json));
+	lyrics_text_style text_style = create_text_style(ls);
+
+	{
+		std::lock_guard<std::mutex> lock(data->mutex);
+		const bool text_style_changed = text_style != data->text_style;
+		data->text_style = std::move(text_style);
+
+		if (data->style && data->style_hash == style_hash) {
+			obs_data_release(style);
+			// Only the shadow direction changed, which the text source cannot show
+			if (text_style_changed)
+				data->style_dirty = true;
+			return;
+		}
+
+		obs_data_release(data->style);
+		data->style = style;
+		data->style_hash = style_hash;
+	}
+
+	lyrics_line_cache_set_style(data->line_cache, style, style_hash);
+	lyrics_stats_count(data->stats, LYRICS_STATS_STYLE_UPDATES);
+	data->style_dirty = true;
+}
+
+// Applies pending style/content changes to the main text source. Called once
+// per frame, so any number of navigation requests cost at most one update.
+static void apply_text_update(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	const bool style_dirty = data->style_dirty.exchange(false);
+	const bool content_dirty = data->content_dirty.exchange(false);
+	if (!ls->text_source || (!style_dirty && !content_dirty))
+		return;
+
+	profile_scope profile(text_profile_name);
+
+	const lyrics_library *library = data->current.get();
+	const int song = ls->current_song;
+	const int line = ls->current_line;
+	const bool has_line = song >= 0 && song < (int)library->songs.size() && line >= 0 &&
+			      line < (int)library->songs[song].line_count;
+
+	// Lines shrunk to fit bring their own font size, which stays on the text
+	// source until a line needs a different one
+	const int font_size =
+		ls->text_visible && has_line ? data->current_layout->line_size(song, line) : data->text_font_size;
+	const bool resize = font_size != data->text_font_size;
+
+	// Text content points straight into the library arena
+	const char *text = "";
+	if (ls->text_visible && has_line)
+		text = library->line_text(song, line);
+
+	// The built-in renderer lays the line out right here and draws it this frame
+	if (data->settings->text_renderer == LYRICS_TEXT_RENDERER_BUILTIN) {
+		if (style_dirty) {
+			lyrics_text_style style;
+			{
+				std::lock_guard<std::mutex> lock(data->mutex);
+				style = data->text_style;
+			}
+			lyrics_text_renderer_set_style(data->renderer, style);
+		}
+		lyrics_text_renderer_set_text(data->renderer, text, font_size);
+		data->text_font_size = font_size;
+
+		lyrics_stats_count(data->stats, LYRICS_STATS_TEXT_UPDATES);
+		data->visible_tick = data->tick_count;
+		data->content_serial++;
+		data->hard_cut = data->hard_cut || style_dirty;
+		return;
+	}
+
+	// Lines the cache already rasterized are rendered from there instead
+	if (!style_dirty && ls->text_visible && lyrics_line_cache_ready(data->line_cache, song, line)) {
+		lyrics_stats_count(data->stats, LYRICS_STATS_CACHED_LINES);
+		data->visible_tick = data->tick_count;
+		data->content_serial++;
+		return;
+	}
+
+	obs_data_t *style = nullptr;
+	if (style_dirty || resize) {
+		std::lock_guard<std::mutex> lock(data->mutex);
+		style = data->style;
+		obs_data_addref(style);
+	}
+
+	obs_data_t *settings = obs_data_create();
+	if (style) {
+		obs_data_apply(settings, style);
+		if (font_size)
+			lyrics_layout_set_font_size(settings, style, font_size);
+		obs_data_release(style);
+	}
+	data->text_font_size = font_size;
+	obs_data_set_string(settings, "text", text);
+
 	obs_source_update(ls->text_source, settings);
 	obs_data_release(settings);
+
+	lyrics_stats_count(data->stats, LYRICS_STATS_TEXT_UPDATES);
+	data->visible_tick = data->tick_count + 1;
+	data->content_serial++;
+	// A new style changes every line, so it is cut rather than blended
+	data->hard_cut = data->hard_cut || style_dirty;
+}
+
+// Starts a latency measurement at the time the command was issued; call
+// after request_text_update so render never sees the new start time together
+// with already-applied content
+static void mark_navigation(lyrics_source *ls, uint64_t issued_ns)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	data->navigation_ns = issued_ns;
 }
 
-static void unload_background_image(lyrics_source *ls)
+// Render side of the latency measurement
+static void check_navigation_visible(lyrics_source_data *data)
 {
-	if (!ls->background_loaded)
+	uint64_t start = data->navigation_ns.load();
+	if (!start || data->content_dirty || data->tick_count < data->visible_tick)
 		return;
 
-	obs_enter_graphics();
-	gs_image_file4_free(&ls->background_image);
-	obs_leave_graphics();
+	if (data->navigation_ns.compare_exchange_strong(start, 0))
+		lyrics_stats_record(data->stats, LYRICS_STATS_LATENCY, os_gettime_ns() - start);
+}
 
-	ls->background_loaded = false;
+// Moves the play clock to the start of a line of a timed song, so manual
+// navigation is not undone by the next auto-advance
+static void seek_to_line(lyrics_source *ls, int song, int line)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	const lyrics_library &library = *data->current;
+	if (song >= 0 && song < (int)library.songs.size() && library.song_timed(song) && line >= 0 &&
+	    line < (int)library.songs[song].line_count)
+		data->play_ns = library.song_times(song)[line] * 1000000;
 }
 
-static void load_background_image(lyrics_source *ls)
+// Sends this source's position and visibility to its link group
+static void follow_linked(void *source, void *param)
 {
-	unload_background_image(ls);
+	lyrics_source *ls = (lyrics_source *)source;
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	const lyrics_command *position = (const lyrics_command *)param;
+
+	lyrics_command *command = new lyrics_command();
+	command->type = LYRICS_COMMAND_FOLLOW;
+	command->song = position->song;
+	command->line = position->line;
+	command->visible = position->visible;
+	command->path = position->path;
+	command->issued_ns = position->issued_ns;
+	lyrics_command_push(data->commands, command);
+}
 
-	if (!ls->background_file || !*ls->background_file)
-		return;
+static void sync_linked(lyrics_source *ls, uint64_t issued_ns)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
 
-	gs_image_file4_init(&ls->background_image, ls->background_file, GS_IMAGE_ALPHA_PREMULTIPLY);
+	lyrics_command position;
+	position.song = ls->current_song;
+	position.line = ls->current_line;
+	position.visible = ls->text_visible;
+	position.issued_ns = issued_ns;
+	if (position.song >= 0 && position.song < (int)data->current->songs.size())
+		position.path = data->current->songs[position.song].path;
 
-	obs_enter_graphics();
-	gs_image_file4_init_texture(&ls->background_image);
-	obs_leave_graphics();
+	lyrics_registry_for_each_linked(ls, follow_linked, &position);
+}
+
+// Applies one command to the position. Returns false if it changed nothing.
+static bool apply_command(lyrics_source *ls, const lyrics_command &command)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+	const lyrics_library &library = *data->current;
+
+	switch (command.type) {
+	case LYRICS_COMMAND_NEXT:
+		if (!lyrics_library_next(library, ls->current_song, ls->current_line))
+			return false;
+		seek_to_line(ls, ls->current_song, ls->current_line);
+		return true;
+
+	case LYRICS_COMMAND_PREVIOUS:
+		if (!lyrics_library_previous(library, ls->current_song, ls->current_line))
+			return false;
+		seek_to_line(ls, ls->current_song, ls->current_line);
+		return true;
+
+	case LYRICS_COMMAND_GOTO:
+		// Validated against the library the caller saw, which a reload may have replaced
+		if (command.song < 0 || command.song >= (int)library.songs.size() || command.line < 0 ||
+		    command.line >= (int)library.songs[command.song].line_count)
+			return false;
+		ls->current_song = command.song;
+		ls->current_line = command.line;
+		seek_to_line(ls, ls->current_song, ls->current_line);
+		return true;
+
+	case LYRICS_COMMAND_GOTO_LINE:
+		if (ls->current_song >= (int)library.songs.size() || command.line < 0 ||
+		    command.line >= (int)library.songs[ls->current_song].line_count)
+			return false;
+		ls->current_line = command.line;
+		seek_to_line(ls, ls->current_song, ls->current_line);
+		return true;
+
+	case LYRICS_COMMAND_GOTO_ABSOLUTE:
+		if (command.line < 0 || command.line >= (int)library.lines.size())
+			return false;
+		ls->current_song = (int)library.line_songs[command.line];
+		ls->current_line = command.line - (int)library.songs[ls->current_song].first_line;
+		seek_to_line(ls, ls->current_song, ls->current_line);
+		return true;
+
+	case LYRICS_COMMAND_TOGGLE:
+		ls->text_visible = !ls->text_visible;
+		return true;
+
+	case LYRICS_COMMAND_SHOW:
+		ls->text_visible = command.visible;
+		return true;
+
+	case LYRICS_COMMAND_RESTART:
+	case LYRICS_COMMAND_STOP:
+		ls->current_song = 0;
+		ls->current_line = 0;
+		ls->text_visible = command.type == LYRICS_COMMAND_RESTART;
+		return true;
+
+	case LYRICS_COMMAND_FOLLOW: {
+		// Songs are matched by path, so linked sources may show different
+		// song lists; otherwise the index is used
+		int song = command.path.empty() ? -1 : lyrics_library_find_song(library, command.path);
+		if (song < 0)
+			song = command.song;
+		if (song >= 0 && song < (int)library.songs.size()) {
+			ls->current_song = song;
+			ls->current_line =
+				std::clamp(command.line, 0, std::max((int)library.songs[song].line_count - 1, 0));
+		}
+		ls->text_visible = command.visible;
+		seek_to_line(ls, ls->current_song, ls->current_line);
+		return true;
+	}
+	}
+	return false;
+}
+
+// Picks up a newly published library and applies all queued navigation, so
+// any number of requests per frame cost one text update and one link sync
+static void process_commands(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	std::shared_ptr<const lyrics_layout> layout = std::atomic_load(&data->layout);
+	if (layout != data->current_layout)
+		adopt_layout(ls, std::move(layout));
+
+	uint64_t issued_ns = 0;
+	bool moved = false;
+	bool local = false;
+	while (lyrics_command *command = lyrics_command_pop(data->commands)) {
+		if (apply_command(ls, *command)) {
+			lyrics_stats_count(data->stats, LYRICS_STATS_NAVIGATIONS);
+			if (!moved)
+				issued_ns = command->issued_ns;
+			moved = true;
+			// Linked moves are not echoed back to the group
+			local = local || command->type != LYRICS_COMMAND_FOLLOW;
+		}
+		delete command;
+	}
+
+	if (!moved)
+		return;
 
-	ls->background_loaded = true;
+	lyrics_line_cache_set_position(data->line_cache, ls->current_song, ls->current_line);
+	request_backgrounds(ls);
+	publish_position(ls);
+	request_text_update(ls);
+	mark_navigation(ls, issued_ns);
+	if (local)
+		sync_linked(ls, issued_ns);
 }
 
 static void draw_bounds_outline(int x, int y, int w, int h, int thickness, uint32_t rgba)
@@ -184,7 +793,7 @@ static void draw_bounds_outline(int x, int y, int w, int h, int thickness, uint3
 	gs_technique_t *tech = gs_effect_get_technique(solid, "Solid");
 
 	struct vec4 color;
-	vec4_from_rgba(&color, rgba);
+	vec4_from_rgba_srgb(&color, rgba);
 	gs_effect_set_vec4(color_param, &color);
 
 	gs_technique_begin(tech);
@@ -218,6 +827,414 @@ static void draw_bounds_outline(int x, int y, int w, int h, int thickness, uint3
 	gs_technique_end(tech);
 }
 
+static void get_background(lyrics_source *ls, lyrics_background *background)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	const lyrics_library &library = *data->current;
+	static const std::string no_song;
+	const std::string &song_path =
+		ls->current_song < (int)library.songs.size() ? library.songs[ls->current_song].path : no_song;
+	lyrics_background_cache_get(data->backgrounds, song_path, background);
+}
+
+// Starts, switches or stops the media source for an animated background.
+// Decoding and frame pacing are left to the media source, and its texture is
+// only uploaded when a new frame is due. Graphics thread only.
+static void update_animation(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	lyrics_background background;
+	get_background(ls, &background);
+	if (background.pending)
+		return;
+
+	if (background.animation != data->animation_path) {
+		data->animation_path = background.animation;
+
+		if (background.animation.empty()) {
+			obs_source_release(data->animation);
+			data->animation = nullptr;
+		} else {
+			obs_data_t *settings = obs_data_create();
+			obs_data_set_bool(settings, "is_local_file", true);
+			obs_data_set_string(settings, "local_file", background.animation.c_str());
+			obs_data_set_bool(settings, "looping", true);
+			obs_data_set_bool(settings, "restart_on_activate", false);
+			obs_data_set_bool(settings, "close_when_inactive", false);
+
+			if (data->animation) {
+				obs_source_update(data->animation, settings);
+			} else {
+				data->animation =
+					obs_source_create_private("ffmpeg_source", "lyrics_background", settings);
+				obs_source_set_muted(data->animation, true);
+			}
+			obs_data_release(settings);
+		}
+	}
+
+	const bool sized = data->animation && background.is_default;
+	data->animation_cx = sized ? obs_source_get_width(data->animation) : 0;
+	data->animation_cy = sized ? obs_source_get_height(data->animation) : 0;
+}
+
+// Redraws the background and bounds overlay into the static layer, but only
+// after a settings change, a resize or a different background. While the new
+// song's background is still decoding, the previous one stays up. Animated
+// backgrounds are drawn underneath instead.
+static void update_static_layer(lyrics_source *ls)
+{
+	lyrics_source_data *data = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	lyrics_background background;
+	get_background(ls, &background);
+
+	const uint32_t cx = lyrics_source_get_width(ls);
+	const uint32_t cy = lyrics_source_get_height(ls);
+	const bool dirty = data->static_dirty.exchange(false);
+	if (background.pending) {
+		// Redraw once it is decoded; until then the old layer stays up
+		if (dirty)
+			data->static_dirty = true;
+		return;
+	}
+	if (!dirty && background.id == data->static_background && data->static_cx == cx && data->static_cy == cy)
+		return;
+
+	data->static_cx = cx;
+	data->static_cy = cy;
+	data->static_background = background.id;
+
+	const render_settings &settings = *data->settings;
+	const bool has_background = background.texture != nullptr;
+	data->static_empty = !has_background && !settings.show_bounds;
+	if (data->static_empty)
+		return;
+
+	if (!data->static_layer)
+		data->static_layer = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	gs_texrender_reset(data->static_layer);
+	if (!gs_texrender_begin(data->static_layer, cx, cy)) {
+		data->static_empty = true;
+		return;
+	}
+
+	struct vec4 clear_color;
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+	const bool previous = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(true);
+	gs_blend_state_push();
+
+	// The layer stays premultiplied so it can be drawn with ONE, INVSRCALPHA
+	if (has_background) {
+		gs_effect_t *const effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+		gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+		// Song backgrounds are scaled to the size of the default one
+		gs_eparam_t *const param = gs_effect_get_param_by_name(effect, "image");
+		gs_effect_set_texture_srgb(param, background.texture);
+
+		while (gs_effect_loop(effect, "Draw"))
+			gs_draw_sprite(background.texture, 0, cx, cy);
+	}
+
+	if (settings.show_bounds) {
+		gs_blend_function_separate(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA, GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+		draw_bounds_outline(settings.text_x, settings.text_y, settings.text_width, settings.text_height,
+				    settings.bounds_thickness, settings.bounds_color);
+	}
+
+	gs_blend_state_pop();
+	gs_enable_framebuffer_srgb(previous);
+	gs_texrender_end(data->static_layer);
+}
+
+// Proc handler: search(in string query, in int max_results, out string results)
+// Results are a JSON object with a "results" array of {song, line, name, text}.
+static void search_proc(void *data, calldata_t *cd)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	request_load(ls);
+	const char *query = calldata_string(cd, "query");
+	long long max_results = calldata_int(cd, "max_results");
+	if (max_results <= 0)
+		max_results = 20;
+
+	std::shared_ptr<const lyrics_library> library = get_library(ldata);
+
+	const uint64_t start = os_gettime_ns();
+	std::vector<lyrics_search_hit> hits = lyrics_search_find(*library, query, (size_t)max_results);
+	const uint64_t elapsed = os_gettime_ns() - start;
+
+	obs_data_t *result = obs_data_create();
+	obs_data_array_t *array = obs_data_array_create();
+	for (const lyrics_search_hit &hit : hits) {
+		obs_data_t *item = obs_data_create();
+		obs_data_set_int(item, "song", hit.song);
+		obs_data_set_int(item, "line", hit.line);
+		obs_data_set_string(item, "name", library->songs[hit.song].name.c_str());
+		obs_data_set_string(item, "text", library->line_text(hit.song, hit.line));
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+	}
+	obs_data_set_array(result, "results", array);
+	obs_data_set_int(result, "elapsed_us", (long long)(elapsed / 1000));
+	obs_data_array_release(array);
+
+	calldata_set_string(cd, "results", obs_data_get_json(result));
+	obs_data_release(result);
+}
+
+// Builds the command for one controller request, validated against the
+// library the caller sees. Song-relative lines are checked when applied.
+// Returns null for unknown commands and positions outside the library.
+static lyrics_command *make_command(const lyrics_library &library, const std::string &name, long long song,
+				    const char *song_id, long long line)
+{
+	lyrics_command_type type;
+	bool visible = true;
+
+	if (name == "next") {
+		type = LYRICS_COMMAND_NEXT;
+	} else if (name == "previous") {
+		type = LYRICS_COMMAND_PREVIOUS;
+	} else if (name == "toggle") {
+		type = LYRICS_COMMAND_TOGGLE;
+	} else if (name == "show" || name == "hide") {
+		type = LYRICS_COMMAND_SHOW;
+		visible = name == "show";
+	} else if (name == "goto" || name == "goto_song") {
+		if (song_id && *song_id)
+			song = lyrics_library_find_song_id(library, song_id);
+		if (name == "goto_song")
+			line = 0;
+		if (song < 0 || song >= (long long)library.songs.size() || line < 0 ||
+		    line >= (long long)library.songs[song].line_count)
+			return nullptr;
+		type = LYRICS_COMMAND_GOTO;
+	} else if (name == "goto_line") {
+		type = LYRICS_COMMAND_GOTO_LINE;
+	} else if (name == "goto_absolute") {
+		if (line < 0 || line >= (long long)library.lines.size())
+			return nullptr;
+		type = LYRICS_COMMAND_GOTO_ABSOLUTE;
+	} else {
+		return nullptr;
+	}
+
+	lyrics_command *command = new lyrics_command();
+	command->type = type;
+	command->song = (int)song;
+	command->line = (int)line;
+	command->visible = visible;
+	return command;
+}
+
+// Shared body of the single-command proc handlers
+static void queue_control(void *data, calldata_t *cd, const char *name)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	long long song = -1;
+	calldata_get_int(cd, "song", &song);
+	std::shared_ptr<const lyrics_library> library = get_library(ldata);
+
+	if (lyrics_replay_recording()) {
+		obs_data_t *args = obs_data_create();
+		obs_data_set_int(args, "song", song);
+		obs_data_set_string(args, "name", calldata_string(cd, "name"));
+		obs_data_set_int(args, "line", calldata_int(cd, "line"));
+		lyrics_replay_record(ls->source, name, args);
+		obs_data_release(args);
+	}
+
+	lyrics_command *command =
+		make_command(*library, name, song, calldata_string(cd, "name"), calldata_int(cd, "line"));
+	if (command)
+		lyrics_command_push(ldata->commands, command);
+	calldata_set_bool(cd, "success", command != nullptr);
+}
+
+// Proc handlers: next(), previous()
+static void next_proc(void *data, calldata_t *cd)
+{
+	queue_control(data, cd, "next");
+}
+
+static void previous_proc(void *data, calldata_t *cd)
+{
+	queue_control(data, cd, "previous");
+}
+
+// Proc handler: goto(in int song, in int line, out bool success)
+static void goto_proc(void *data, calldata_t *cd)
+{
+	queue_control(data, cd, "goto");
+}
+
+// Proc handler: goto_song(in int song, in string name, out bool success)
+// A non-empty name (song name or path) takes precedence over the index.
+static void goto_song_proc(void *data, calldata_t *cd)
+{
+	queue_control(data, cd, "goto_song");
+}
+
+// Proc handler: goto_line(in int line, out bool success), within the current song
+static void goto_line_proc(void *data, calldata_t *cd)
+{
+	queue_control(data, cd, "goto_line");
+}
+
+// Proc handler: goto_absolute(in int line, out bool success)
+// line counts across the whole library, as reported in "absolute" by get_state.
+static void goto_absolute_proc(void *data, calldata_t *cd)
+{
+	queue_control(data, cd, "goto_absolute");
+}
+
+// Proc handler: batch(in string commands, out int queued)
+// commands is a JSON array such as [{"command": "goto_song", "name": "Amazing
+// Grace"}, {"command": "goto_line", "line": 2}, {"command": "show"}]. Valid
+// entries are queued together and applied in order on the next frame.
+static void batch_proc(void *data, calldata_t *cd)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	const char *json = calldata_string(cd, "commands");
+	if (lyrics_replay_recording()) {
+		obs_data_t *args = obs_data_create();
+		obs_data_set_string(args, "commands", json ? json : "");
+		lyrics_replay_record(ls->source, "batch", args);
+		obs_data_release(args);
+	}
+	const std::string wrapped = std::string("{\"commands\":") + (json && *json ? json : "[]") + "}";
+	obs_data_t *request = obs_data_create_from_json(wrapped.c_str());
+	obs_data_array_t *array = request ? obs_data_get_array(request, "commands") : nullptr;
+
+	std::shared_ptr<const lyrics_library> library = get_library(ldata);
+	std::vector<lyrics_command *> commands;
+	const size_t count = array ? obs_data_array_count(array) : 0;
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(array, i);
+		long long song = obs_data_has_user_value(item, "song") ? obs_data_get_int(item, "song") : -1;
+		lyrics_command *command = make_command(*library, obs_data_get_string(item, "command"), song,
+						       obs_data_get_string(item, "name"),
+						       obs_data_get_int(item, "line"));
+		if (command)
+			commands.push_back(command);
+		else
+			plugin_log(LOG_DEBUG, "Ignoring batch entry %zu: %s", i, obs_data_get_json(item));
+		obs_data_release(item);
+	}
+
+	lyrics_command_push_batch(ldata->commands, commands.data(), commands.size());
+	calldata_set_int(cd, "queued", (long long)commands.size());
+
+	obs_data_array_release(array);
+	obs_data_release(request);
+}
+
+// Proc handler: get_state(out string state)
+// JSON with the position as of the last frame: song, line, absolute, visible,
+// playing, time_ms, song_count, line_count and the current song and text.
+static void get_state_proc(void *data, calldata_t *cd)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	std::shared_ptr<const lyrics_library> library = get_library(ldata);
+	const source_position position = get_position(ldata);
+
+	obs_data_t *state = obs_data_create();
+	obs_data_set_int(state, "song", position.song);
+	obs_data_set_int(state, "line", position.line);
+	obs_data_set_bool(state, "visible", position.visible);
+	obs_data_set_bool(state, "playing", ldata->playing);
+	obs_data_set_int(state, "time_ms", ldata->play_ns / 1000000);
+	obs_data_set_int(state, "song_count", (long long)library->songs.size());
+	obs_data_set_int(state, "line_count", (long long)library->lines.size());
+
+	// The library may have been swapped since the position was published
+	if (position.song < (int)library->songs.size() &&
+	    position.line < (int)library->songs[position.song].line_count) {
+		const lyrics_song &song = library->songs[position.song];
+		obs_data_set_int(state, "absolute", (long long)song.first_line + position.line);
+		obs_data_set_string(state, "name", song.name.c_str());
+		obs_data_set_string(state, "path", song.path.c_str());
+		obs_data_set_int(state, "song_lines", song.line_count);
+		obs_data_set_string(state, "text", library->line_text(position.song, position.line));
+	}
+
+	calldata_set_string(cd, "state", obs_data_get_json(state));
+	obs_data_release(state);
+}
+
+// Proc handler: list_songs(out string songs)
+// JSON with "songs", the navigable songs in order ({name, path, first_line,
+// lines, timed}), and "catalog", every song file found ({name, path}), which
+// is larger than "songs" while a setlist is active.
+static void list_songs_proc(void *data, calldata_t *cd)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	// Songs of a source that was never shown arrive on a later call
+	request_load(ls);
+	std::shared_ptr<const lyrics_library> library = get_library(ldata);
+
+	obs_data_t *result = obs_data_create();
+	obs_data_array_t *songs = obs_data_array_create();
+	for (size_t i = 0; i < library->songs.size(); i++) {
+		const lyrics_song &song = library->songs[i];
+		obs_data_t *item = obs_data_create();
+		obs_data_set_string(item, "name", song.name.c_str());
+		obs_data_set_string(item, "path", song.path.c_str());
+		obs_data_set_int(item, "first_line", song.first_line);
+		obs_data_set_int(item, "lines", song.line_count);
+		obs_data_set_bool(item, "timed", library->song_timed(i));
+		obs_data_array_push_back(songs, item);
+		obs_data_release(item);
+	}
+	obs_data_set_array(result, "songs", songs);
+	obs_data_array_release(songs);
+
+	obs_data_array_t *catalog = obs_data_array_create();
+	for (const lyrics_catalog_entry &entry : library->catalog) {
+		obs_data_t *item = obs_data_create();
+		obs_data_set_string(item, "name", entry.name.c_str());
+		obs_data_set_string(item, "path", entry.path.c_str());
+		obs_data_array_push_back(catalog, item);
+		obs_data_release(item);
+	}
+	obs_data_set_array(result, "catalog", catalog);
+	obs_data_array_release(catalog);
+
+	calldata_set_string(cd, "songs", obs_data_get_json(result));
+	obs_data_release(result);
+}
+
+// Proc handler: get_stats(out string stats)
+// Latency and load percentiles in milliseconds plus update counters, as JSON.
+static void get_stats_proc(void *data, calldata_t *cd)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	obs_data_t *stats = lyrics_stats_get(ldata->stats);
+	calldata_set_string(cd, "stats", obs_data_get_json(stats));
+	obs_data_release(stats);
+}
+
 const char *lyrics_source_get_name(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -230,7 +1247,18 @@ void *lyrics_source_create(obs_data_t *settings, obs_source_t *source)
 	ls->source = source;
 
 	// Create internal data structure
-	ls->songs_data = new lyrics_source_data();
+	lyrics_source_data *ldata = new lyrics_source_data();
+	ldata->stats = lyrics_stats_create();
+	ldata->line_cache = lyrics_line_cache_create();
+	ldata->transition = lyrics_transition_create();
+	ldata->commands = lyrics_command_queue_create();
+	ldata->backgrounds = lyrics_background_cache_create();
+	ldata->layouter = lyrics_layouter_create(library_laid_out, ls);
+	ldata->renderer = lyrics_text_renderer_create();
+	ldata->current_layout = ldata->layout;
+	ldata->current = ldata->layout->library;
+	ldata->created_ns = os_gettime_ns();
+	ls->songs_data = ldata;
 
 	// Initialize defaults
 	ls->text_visible = true;
@@ -273,6 +1301,28 @@ void *lyrics_source_create(obs_data_t *settings, obs_source_t *source)
 		},
 		ls);
 
+	// Register proc handlers for external controllers
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void search(in string query, in int max_results, out string results)", search_proc, ls);
+	proc_handler_add(ph, "void goto(in int song, in int line, out bool success)", goto_proc, ls);
+	proc_handler_add(ph, "void get_stats(out string stats)", get_stats_proc, ls);
+	proc_handler_add(ph, "void next(out bool success)", next_proc, ls);
+	proc_handler_add(ph, "void previous(out bool success)", previous_proc, ls);
+	proc_handler_add(ph, "void goto_song(in int song, in string name, out bool success)", goto_song_proc, ls);
+	proc_handler_add(ph, "void goto_line(in int line, out bool success)", goto_line_proc, ls);
+	proc_handler_add(ph, "void goto_absolute(in int line, out bool success)", goto_absolute_proc, ls);
+	proc_handler_add(ph, "void batch(in string commands, out int queued)", batch_proc, ls);
+	proc_handler_add(ph, "void get_state(out string state)", get_state_proc, ls);
+	proc_handler_add(ph, "void list_songs(out string songs)", list_songs_proc, ls);
+
+	// Signals for controllers, emitted from the graphics thread
+	static const char *signals[] = {
+		"void position_changed(ptr source, int song, int line, int absolute, bool visible)",
+		"void library_changed(ptr source, int songs, int lines)",
+		NULL,
+	};
+	signal_handler_add_array(obs_source_get_signal_handler(source), signals);
+
 	lyrics_source_update(ls, settings);
 
 	return ls;
@@ -281,40 +1331,53 @@ void *lyrics_source_create(obs_data_t *settings, obs_source_t *source)
 void lyrics_source_destroy(void *data)
 {
 	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	// Leave the link group and the shared library first so nothing can call
+	// back into a dying source
+	lyrics_registry_unlink(ls);
+	lyrics_registry_release(ldata->library_handle);
+	lyrics_layouter_destroy(ldata->layouter);
+	if (!ldata->loaded)
+		plugin_log(LOG_DEBUG, "'%s' was never shown, its songs were never loaded",
+			   obs_source_get_name(ls->source));
 
-	unload_background_image(ls);
 	if (ls->text_source)
 		obs_source_release(ls->text_source);
+	obs_source_release(ldata->animation);
+
+	obs_enter_graphics();
+	gs_texrender_destroy(ldata->static_layer);
+	obs_leave_graphics();
 
 	// Delete internal data structure
-	if (ls->songs_data)
-		delete static_cast<lyrics_source_data *>(ls->songs_data);
+	lyrics_line_cache_destroy(ldata->line_cache);
+	lyrics_transition_destroy(ldata->transition);
+	lyrics_command_queue_destroy(ldata->commands);
+	lyrics_background_cache_destroy(ldata->backgrounds);
+	lyrics_text_renderer_destroy(ldata->renderer);
+	lyrics_stats_destroy(ldata->stats);
+	obs_data_release(ldata->style);
+	delete ldata;
 
-	bfree(ls->background_file);
 	bfree(ls->font_name);
 	bfree(ls->lyrics_folder);
+	bfree(ls->lyrics_patterns);
 	if (ls->lyrics_files)
 		obs_data_array_release(ls->lyrics_files);
+	if (ls->setlist)
+		obs_data_array_release(ls->setlist);
 
 	bfree(ls);
 }
 
 void lyrics_source_update(void *data, obs_data_t *settings)
 {
+	profile_scope profile(update_profile_name);
 	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_replay_record(ls->source, "update", settings);
 
-	// Update background image
-	const char *background_file = obs_data_get_string(settings, BACKGROUND_FILE);
-	if (ls->background_file && strcmp(ls->background_file, background_file) != 0) {
-		bfree(ls->background_file);
-		ls->background_file = nullptr;
-		unload_background_image(ls);
-	}
-
-	if (!ls->background_file && background_file && *background_file) {
-		ls->background_file = bstrdup(background_file);
-		load_background_image(ls);
-	}
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
 
 	// Update text properties
 	ls->text_color = (uint32_t)obs_data_get_int(settings, TEXT_COLOR);
@@ -329,13 +1392,8 @@ void lyrics_source_update(void *data, obs_data_t *settings)
 	// Update alignment
 	ls->text_h_align = (int)obs_data_get_int(settings, TEXT_H_ALIGN);
 	ls->text_v_align = (int)obs_data_get_int(settings, TEXT_V_ALIGN);
-	ls->text_x = (int)obs_data_get_int(settings, TEXT_X);
-	ls->text_y = (int)obs_data_get_int(settings, TEXT_Y);
 	ls->text_width = (int)obs_data_get_int(settings, TEXT_WIDTH);
 	ls->text_height = (int)obs_data_get_int(settings, TEXT_HEIGHT);
-	ls->show_bounds = obs_data_get_bool(settings, TEXT_SHOW_BOUNDS);
-	ls->bounds_color = (uint32_t)obs_data_get_int(settings, TEXT_BOUNDS_COLOR);
-	ls->bounds_thickness = (int)obs_data_get_int(settings, TEXT_BOUNDS_THICKNESS);
 
 	// Update font
 	const char *font_name = obs_data_get_string(settings, TEXT_FONT_NAME);
@@ -345,33 +1403,300 @@ void lyrics_source_update(void *data, obs_data_t *settings)
 	ls->font_size = (int)obs_data_get_int(settings, TEXT_FONT_SIZE);
 	ls->font_weight = (int)obs_data_get_int(settings, TEXT_FONT_WEIGHT);
 
+	ls->text_renderer = (int)obs_data_get_int(settings, TEXT_RENDERER);
+	const bool builtin = ls->text_renderer == LYRICS_TEXT_RENDERER_BUILTIN;
+
 	// Update lyrics files
 	ls->use_folder = obs_data_get_bool(settings, USE_FOLDER);
 	const char *lyrics_folder = obs_data_get_string(settings, LYRICS_FOLDER);
 	if (ls->lyrics_folder)
 		bfree(ls->lyrics_folder);
 	ls->lyrics_folder = (lyrics_folder && *lyrics_folder) ? bstrdup(lyrics_folder) : nullptr;
+	ls->lyrics_recursive = obs_data_get_bool(settings, LYRICS_RECURSIVE);
+	const char *lyrics_patterns = obs_data_get_string(settings, LYRICS_PATTERNS);
+	if (ls->lyrics_patterns)
+		bfree(ls->lyrics_patterns);
+	ls->lyrics_patterns = (lyrics_patterns && *lyrics_patterns) ? bstrdup(lyrics_patterns) : nullptr;
 
 	if (ls->lyrics_files)
 		obs_data_array_release(ls->lyrics_files);
 	ls->lyrics_files = obs_data_get_array(settings, LYRICS_FILES);
 
-	load_lyrics_files(ls);
-	update_text_source(ls);
+	if (ls->setlist)
+		obs_data_array_release(ls->setlist);
+	ls->setlist = obs_data_get_array(settings, SETLIST);
+
+	// Line cache
+	ls->line_cache_budget = (int)obs_data_get_int(settings, LINE_CACHE_BUDGET);
+	ls->line_cache_prefetch = (int)obs_data_get_int(settings, LINE_CACHE_PREFETCH);
+
+	// The built-in renderer draws any line as fast as a cached one
+	lyrics_line_cache_configure(ldata->line_cache, builtin ? 0 : (uint64_t)ls->line_cache_budget * 1024 * 1024,
+				    ls->line_cache_prefetch);
+	ls->background_cache_budget = (int)obs_data_get_int(settings, BACKGROUND_CACHE_BUDGET);
+	lyrics_background_cache_configure(ldata->backgrounds, (uint64_t)ls->background_cache_budget * 1024 * 1024);
+
+	ls->karaoke_color = (uint32_t)obs_data_get_int(settings, KARAOKE_COLOR);
+
+	// Link group
+	lyrics_registry_link(ls, obs_data_get_string(settings, LINK_GROUP));
+
+	// Line transitions
+	ls->transition_mode = (int)obs_data_get_int(settings, TRANSITION_MODE);
+	ls->transition_duration = (int)obs_data_get_int(settings, TRANSITION_DURATION);
+	lyrics_transition_configure(ldata->transition, ls->transition_mode, ls->transition_duration);
+
+	// Statistics
+	{
+		std::lock_guard<std::mutex> lock(ldata->mutex);
+		ldata->stats_csv = obs_data_get_string(settings, STATS_CSV);
+	}
+
+	// Line fitting, laid out again only when it or what it measures changes
+	ls->fit_mode = (int)obs_data_get_int(settings, TEXT_FIT_MODE);
+	lyrics_layout_spec layout;
+	layout.mode = ls->fit_mode;
+	if (layout.mode != LYRICS_FIT_NONE) {
+		layout.face = ls->font_name;
+		layout.weight = ls->font_weight;
+		layout.size = ls->font_size;
+		layout.width = ls->text_width;
+		layout.height = ls->text_height;
+		layout.outline = ls->outline_enabled ? ls->outline_size : 0;
+	}
+	lyrics_layouter_set_spec(ldata->layouter, layout);
+
+	update_style(ls);
+
+	// What video_tick and render read, taken over by the next frame. Songs and
+	// the default background (decoded off the graphics thread) are loaded
+	// from there too, once the source loads.
+	auto render = std::make_shared<render_settings>();
+	render->spec = build_library_spec(ls);
+	const char *background_file = obs_data_get_string(settings, BACKGROUND_FILE);
+	render->background_file = background_file ? background_file : "";
+	render->text_renderer = ls->text_renderer;
+	render->text_x = (int)obs_data_get_int(settings, TEXT_X);
+	render->text_y = (int)obs_data_get_int(settings, TEXT_Y);
+	render->text_width = ls->text_width;
+	render->text_height = ls->text_height;
+	render->show_bounds = obs_data_get_bool(settings, TEXT_SHOW_BOUNDS);
+	render->bounds_color = (uint32_t)obs_data_get_int(settings, TEXT_BOUNDS_COLOR);
+	render->bounds_thickness = (int)obs_data_get_int(settings, TEXT_BOUNDS_THICKNESS);
+	render->lrc_auto_advance = obs_data_get_bool(settings, LRC_AUTO_ADVANCE);
+	render->karaoke = obs_data_get_bool(settings, KARAOKE);
+	render->stats_interval = (int)obs_data_get_int(settings, STATS_INTERVAL);
+	std::atomic_store(&ldata->pending_settings, std::shared_ptr<const render_settings>(std::move(render)));
+}
+
+// Takes over the settings of the last update for this frame. Switching
+// renderers redraws the line with the new one; anything else may have moved
+// the bounds overlay or changed what a loaded source shows.
+static void adopt_settings(lyrics_source *ls)
+{
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	std::shared_ptr<const render_settings> settings = std::atomic_load(&ldata->pending_settings);
+	if (settings == ldata->settings)
+		return;
+
+	if (settings->text_renderer != ldata->settings->text_renderer) {
+		ldata->style_dirty = true;
+		ldata->content_dirty = true;
+	}
+	ldata->static_dirty = true;
+	ldata->settings = std::move(settings);
+	if (ldata->loaded)
+		load_content(ls);
+}
+
+// Follows the play clock through a timed song: one binary search per tick,
+// and only an actual line change touches the text
+static void advance_timed_line(lyrics_source *ls, float seconds)
+{
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	if (!ldata->settings->lrc_auto_advance || !ldata->playing)
+		return;
+
+	const int64_t delta = (int64_t)((double)seconds * 1000000000.0);
+	const int64_t now_ms = (ldata->play_ns.fetch_add(delta) + delta) / 1000000;
+
+	const int line = lyrics_library_line_at(*ldata->current, ls->current_song, now_ms);
+	if (line < 0 || line == ls->current_line)
+		return;
+	ls->current_line = line;
+
+	lyrics_line_cache_set_position(ldata->line_cache, ls->current_song, line);
+	publish_position(ls);
+	request_text_update(ls);
+	sync_linked(ls, os_gettime_ns());
+}
+
+// Moves the word wipe of the built-in renderer with the play clock: a binary
+// search over the words of the line and one shader uniform per tick
+static void update_karaoke(lyrics_source *ls)
+{
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	const render_settings &settings = *ldata->settings;
+	if (settings.text_renderer != LYRICS_TEXT_RENDERER_BUILTIN)
+		return;
+
+	// Placed again whenever the renderer laid out a new line or style
+	const bool enabled = settings.karaoke && settings.lrc_auto_advance;
+	if (ldata->karaoke_serial != ldata->content_serial || ldata->karaoke_enabled != enabled) {
+		ldata->karaoke_serial = ldata->content_serial;
+		ldata->karaoke_enabled = enabled;
+		ldata->karaoke_words.clear();
+		ldata->karaoke_progress = LYRICS_TEXT_NO_PROGRESS;
+
+		const lyrics_library &library = *ldata->current;
+		const int song = ls->current_song;
+		const int line = ls->current_line;
+		size_t count = 0;
+		const lyrics_word_time *words =
+			enabled && ls->text_visible ? lyrics_library_line_words(library, song, line, &count) : nullptr;
+		const uint32_t length = count ? library.lines[library.songs[song].first_line + line].length : 0;
+
+		for (size_t i = 0; i < count; i++) {
+			karaoke_word word;
+			word.time = words[i].time;
+			const uint32_t end = i + 1 < count ? words[i + 1].offset : length;
+			// A closing tag, or a word of only spaces, just marks a time
+			if (!lyrics_text_renderer_word_span(ldata->renderer, words[i].offset, end, &word.start,
+							    &word.end)) {
+				word.start = word.end = ldata->karaoke_words.empty() ? LYRICS_TEXT_NO_PROGRESS
+										      : ldata->karaoke_words.back().end;
+			}
+			ldata->karaoke_words.push_back(word);
+		}
+	}
+
+	const std::vector<karaoke_word> &words = ldata->karaoke_words;
+	float progress = LYRICS_TEXT_NO_PROGRESS;
+	if (!words.empty()) {
+		const int64_t now_ms = ldata->play_ns / 1000000;
+		auto next = std::upper_bound(words.begin(), words.end(), now_ms,
+					     [](int64_t time, const karaoke_word &word) { return time < word.time; });
+		if (next != words.begin()) {
+			const karaoke_word &word = *(next - 1);
+			const int64_t until = next != words.end() ? next->time : word.time + LAST_WORD_MS;
+			const float fraction =
+				until > word.time ? (float)(now_ms - word.time) / (float)(until - word.time) : 1.0f;
+			progress = word.start + (word.end - word.start) * std::min(fraction, 1.0f);
+		}
+	}
+
+	if (progress != ldata->karaoke_progress) {
+		ldata->karaoke_progress = progress;
+		ldata->karaoke_dirty = true;
+		lyrics_text_renderer_set_progress(ldata->renderer, progress);
+	}
+}
+
+void lyrics_source_video_tick(void *data, float seconds)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	ldata->tick_count++;
+	adopt_settings(ls);
+	start_deferred_load(ls);
+	process_commands(ls);
+	advance_timed_line(ls, seconds);
+	lyrics_line_cache_tick(ldata->line_cache);
+	lyrics_background_cache_tick(ldata->backgrounds);
+	update_animation(ls);
+	apply_text_update(ls);
+	update_karaoke(ls);
+	lyrics_transition_tick(ldata->transition, seconds);
+
+	const int stats_interval = ldata->settings->stats_interval;
+	if (stats_interval <= 0) {
+		ldata->stats_elapsed = 0.0f;
+		return;
+	}
+
+	ldata->stats_elapsed += seconds;
+	if (ldata->stats_elapsed >= (float)stats_interval) {
+		ldata->stats_elapsed = 0.0f;
+
+		std::string csv;
+		{
+			std::lock_guard<std::mutex> lock(ldata->mutex);
+			csv = ldata->stats_csv;
+		}
+		lyrics_stats_dump(ldata->stats, obs_source_get_name(ls->source), csv.c_str());
+	}
+}
+
+// Draws the current line, preferring an already rasterized one from the cache
+static void draw_text(void *param)
+{
+	lyrics_source *ls = (lyrics_source *)param;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	if (ldata->settings->text_renderer == LYRICS_TEXT_RENDERER_BUILTIN)
+		lyrics_text_renderer_render(ldata->renderer);
+	else if (!lyrics_line_cache_render(ldata->line_cache, ls->current_song, ls->current_line))
+		obs_source_video_render(ls->text_source);
+}
+
+// Captures each new line once it is visible and lets the transition blend it
+// in; between changes this is a single draw of the captured layer
+static void render_transition(lyrics_source *ls)
+{
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	const bool has_capture = lyrics_transition_has_capture(ldata->transition);
+	const bool changed = ldata->captured_serial != ldata->content_serial;
+	if (!has_capture || (changed && ldata->tick_count >= ldata->visible_tick)) {
+		// The built-in renderer lays text out in the text box and has no size of its own
+		const render_settings &settings = *ldata->settings;
+		const bool builtin = settings.text_renderer == LYRICS_TEXT_RENDERER_BUILTIN;
+		const uint32_t cx = std::max((uint32_t)std::max(settings.text_width, 1),
+					     builtin ? 0 : obs_source_get_width(ls->text_source));
+		const uint32_t cy = std::max((uint32_t)std::max(settings.text_height, 1),
+					     builtin ? 0 : obs_source_get_height(ls->text_source));
+		lyrics_transition_capture(ldata->transition, cx, cy, !ldata->hard_cut, !ls->text_visible, draw_text,
+					  ls);
+
+		ldata->captured_serial = ldata->content_serial;
+		ldata->hard_cut = false;
+	} else if (ldata->karaoke_dirty) {
+		lyrics_transition_redraw(ldata->transition, draw_text, ls);
+	}
+	ldata->karaoke_dirty = false;
+
+	lyrics_transition_render(ldata->transition);
 }
 
 void lyrics_source_render(void *data, gs_effect_t *effect)
 {
+	profile_scope profile(render_profile_name);
 	lyrics_source *ls = (lyrics_source *)data;
 
 	gs_effect_t *draw_effect = effect;
 	if (!draw_effect)
 		draw_effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
 
-	// Render background
-	if (ls->background_loaded) {
-		struct gs_image_file *const image = &ls->background_image.image3.image2.image;
-		gs_texture_t *const texture = image->texture;
+	// Background and bounds overlay come from one cached composite, on top of
+	// an animated background if there is one
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	update_static_layer(ls);
+	if (ldata->animation) {
+		const uint32_t width = obs_source_get_width(ldata->animation);
+		const uint32_t height = obs_source_get_height(ldata->animation);
+		if (width && height) {
+			gs_matrix_push();
+			const float scale_x = (float)ldata->static_cx / (float)width;
+			const float scale_y = (float)ldata->static_cy / (float)height;
+			gs_matrix_scale3f(scale_x, scale_y, 1.0f);
+			obs_source_video_render(ldata->animation);
+			gs_matrix_pop();
+		}
+	}
+	if (!ldata->static_empty) {
+		gs_texture_t *const texture = gs_texrender_get_texture(ldata->static_layer);
 		if (texture) {
 			const bool previous = gs_framebuffer_srgb_enabled();
 			gs_enable_framebuffer_srgb(true);
@@ -382,69 +1707,107 @@ void lyrics_source_render(void *data, gs_effect_t *effect)
 			gs_eparam_t *const param = gs_effect_get_param_by_name(draw_effect, "image");
 			gs_effect_set_texture_srgb(param, texture);
 
-			for (gs_effect_loop(draw_effect, "Draw")) {
-				gs_draw_sprite(texture, 0, image->cx, image->cy);
-			}
+			while (gs_effect_loop(draw_effect, "Draw"))
+				gs_draw_sprite(texture, 0, ldata->static_cx, ldata->static_cy);
 
 			gs_blend_state_pop();
 			gs_enable_framebuffer_srgb(previous);
 		}
 	}
 
-	// Bounds preview overlay
-	if (ls->show_bounds) {
-		draw_bounds_outline(ls->text_x, ls->text_y, ls->text_width, ls->text_height, ls->bounds_thickness,
-				   ls->bounds_color);
-	}
-
-	// Render text translated into position
-	if (ls->text_source) {
+	// Render text translated into position. Without a transition, hidden text
+	// has nothing to draw, leaving just the composite above.
+	if (ls->text_source && (ls->text_visible || lyrics_transition_enabled(ldata->transition))) {
 		gs_matrix_push();
-		gs_matrix_translate3f((float)ls->text_x, (float)ls->text_y, 0.0f);
-		obs_source_video_render(ls->text_source);
+		gs_matrix_translate3f((float)ldata->settings->text_x, (float)ldata->settings->text_y, 0.0f);
+		if (lyrics_transition_enabled(ldata->transition))
+			render_transition(ls);
+		else
+			draw_text(ls);
 		gs_matrix_pop();
 	}
+
+	check_navigation_visible(ldata);
+}
+
+void lyrics_source_free_loaders(void)
+{
+	lyrics_loader_free_all();
+	lyrics_layouter_free_all();
 }
 
+// Shown anywhere, including the Studio Mode preview
+void lyrics_source_show(void *data)
+{
+	request_load((lyrics_source *)data);
+}
+
+void lyrics_source_activate(void *data)
+{
+	request_load((lyrics_source *)data);
+}
+
+// The default background sets the source size, song backgrounds are scaled to it
 uint32_t lyrics_source_get_width(void *data)
 {
 	lyrics_source *ls = (lyrics_source *)data;
-	if (ls->background_loaded && ls->background_image.image3.image2.image.cx > 0)
-		return ls->background_image.image3.image2.image.cx;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	uint32_t cx, cy;
+	if (lyrics_background_cache_default_size(ldata->backgrounds, &cx, &cy))
+		return cx;
+	if (ldata->animation_cx)
+		return ldata->animation_cx;
 	return 1920; // Default width
 }
 
 uint32_t lyrics_source_get_height(void *data)
 {
 	lyrics_source *ls = (lyrics_source *)data;
-	if (ls->background_loaded && ls->background_image.image3.image2.image.cy > 0)
-		return ls->background_image.image3.image2.image.cy;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	uint32_t cx, cy;
+	if (lyrics_background_cache_default_size(ldata->backgrounds, &cx, &cy))
+		return cy;
+	if (ldata->animation_cy)
+		return ldata->animation_cy;
 	return 1080; // Default height
 }
 
 void lyrics_source_media_play_pause(void *data, bool pause)
 {
 	lyrics_source *ls = (lyrics_source *)data;
-	ls->text_visible = !pause;
-	update_text_source(ls);
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	if (lyrics_replay_recording()) {
+		obs_data_t *args = obs_data_create();
+		obs_data_set_bool(args, "pause", pause);
+		lyrics_replay_record(ls->source, "play_pause", args);
+		obs_data_release(args);
+	}
+	ldata->playing = !pause;
+
+	lyrics_command *command = new lyrics_command();
+	command->type = LYRICS_COMMAND_SHOW;
+	command->visible = !pause;
+	lyrics_command_push(ldata->commands, command);
 }
 
 void lyrics_source_media_restart(void *data)
 {
 	lyrics_source *ls = (lyrics_source *)data;
-	ls->current_song = 0;
-	ls->current_line = 0;
-	ls->text_visible = true;
-	update_text_source(ls);
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	lyrics_replay_record(ls->source, "restart", nullptr);
+	ldata->play_ns = 0;
+	ldata->playing = true;
+	push_command(ls, LYRICS_COMMAND_RESTART);
 }
 
 void lyrics_source_media_stop(void *data)
 {
 	lyrics_source *ls = (lyrics_source *)data;
-	ls->current_song = 0;
-	ls->current_line = 0;
-	ls->text_visible = false;
-	update_text_source(ls);
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	lyrics_replay_record(ls->source, "stop", nullptr);
+	ldata->play_ns = 0;
+	ldata->playing = false;
+	push_command(ls, LYRICS_COMMAND_STOP);
 }
 
 void lyrics_source_media_next(void *data)
@@ -457,54 +1820,127 @@ void lyrics_source_media_previous(void *data)
 	lyrics_source_previous(data);
 }
 
+// Timed songs report the play clock; plain songs report whether text is shown
+static bool current_song_timed(lyrics_source *ls)
+{
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	std::shared_ptr<const lyrics_library> library = get_library(ldata);
+	const int song = get_position(ldata).song;
+	return std::atomic_load(&ldata->pending_settings)->lrc_auto_advance && song < (int)library->songs.size() &&
+	       library->song_timed(song);
+}
+
 enum obs_media_state lyrics_source_media_get_state(void *data)
 {
 	lyrics_source *ls = (lyrics_source *)data;
-	return ls->text_visible ? OBS_MEDIA_STATE_PLAYING : OBS_MEDIA_STATE_PAUSED;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	if (current_song_timed(ls))
+		return ldata->playing ? OBS_MEDIA_STATE_PLAYING : OBS_MEDIA_STATE_PAUSED;
+	return get_position(ldata).visible ? OBS_MEDIA_STATE_PLAYING : OBS_MEDIA_STATE_PAUSED;
 }
 
-void lyrics_source_next(void *data)
+int64_t lyrics_source_media_get_time(void *data)
 {
 	lyrics_source *ls = (lyrics_source *)data;
 	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
-	if (ldata->songs.empty())
-		return;
-
-	const int song_line_count = static_cast<int>(ldata->songs[ls->current_song].size());
+	return ldata->play_ns / 1000000;
+}
 
-	ls->current_line++;
-	if (ls->current_line >= song_line_count) {
-		ls->current_line = 0;
-		ls->current_song++;
-		if (ls->current_song >= static_cast<int>(ldata->songs.size()))
-			ls->current_song = 0;
+void lyrics_source_media_set_time(void *data, int64_t ms)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+	if (lyrics_replay_recording()) {
+		obs_data_t *args = obs_data_create();
+		obs_data_set_int(args, "ms", ms);
+		lyrics_replay_record(ls->source, "set_time", args);
+		obs_data_release(args);
 	}
+	// The line for the new time is picked up on the next tick
+	ldata->play_ns = std::max<int64_t>(ms, 0) * 1000000;
+}
 
-	update_text_source(ls);
+int64_t lyrics_source_media_get_duration(void *data)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
+
+	std::shared_ptr<const lyrics_library> library = get_library(ldata);
+	const int song = get_position(ldata).song;
+	if (song < 0 || song >= (int)library->songs.size() || !library->song_timed(song))
+		return 0;
+	const int line_count = (int)library->songs[song].line_count;
+	if (line_count <= 0)
+		return 0;
+
+	// The last line is sung after its timestamp, for as long as its words say
+	const int64_t last = library->song_times(song)[line_count - 1];
+	size_t word_count;
+	const lyrics_word_time *words = lyrics_library_line_words(*library, song, line_count - 1, &word_count);
+	const int64_t end = word_count ? words[word_count - 1].time + LAST_WORD_MS : 0;
+	return std::max(last + LAST_LINE_MS, end);
 }
 
-void lyrics_source_previous(void *data)
+size_t lyrics_source_get_song_count(void *data)
 {
 	lyrics_source *ls = (lyrics_source *)data;
 	lyrics_source_data *ldata = static_cast<lyrics_source_data *>(ls->songs_data);
-	if (ldata->songs.empty())
-		return;
+	return get_library(ldata)->songs.size();
+}
 
-	ls->current_line--;
-	if (ls->current_line < 0) {
-		ls->current_song--;
-		if (ls->current_song < 0)
-			ls->current_song = static_cast<int>(ldata->songs.size()) - 1;
-		const int previous_song_lines = static_cast<int>(ldata->songs[ls->current_song].size());
-		ls->current_line = previous_song_lines - 1;
-	}
+void lyrics_source_get_position(void *data, int *song, int *line)
+{
+	lyrics_source *ls = (lyrics_source *)data;
+	const source_position position = get_position(static_cast<lyrics_source_data *>(ls->songs_data));
+	*song = position.song;
+	*line = position.line;
+}
 
-	update_text_source(ls);
+void lyrics_source_next(void *data)
+{
+	lyrics_replay_record(((lyrics_source *)data)->source, "next", nullptr);
+	push_command((lyrics_source *)data, LYRICS_COMMAND_NEXT);
+}
+
+void lyrics_source_previous(void *data)
+{
+	lyrics_replay_record(((lyrics_source *)data)->source, "previous", nullptr);
+	push_command((lyrics_source *)data, LYRICS_COMMAND_PREVIOUS);
 }
 
 void lyrics_source_toggle_text(void *data)
 {
-	lyrics_source *ls = (lyrics_source *)data;
-	ls->text_visible = !ls->text_visible;
-	update_text_source(ls);
+	lyrics_replay_record(((lyrics_source *)data)->source, "toggle", nullptr);
+	push_command((lyrics_source *)data, LYRICS_COMMAND_TOGGLE);
+}
+
+void lyrics_source_register(void)
+{
+	static obs_source_info info = {};
+	info.id = "lyrics_source";
+	info.type = OBS_SOURCE_TYPE_INPUT;
+	info.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW | OBS_SOURCE_CONTROLLABLE_MEDIA;
+	info.get_name = lyrics_source_get_name;
+	info.create = lyrics_source_create;
+	info.destroy = lyrics_source_destroy;
+	info.update = lyrics_source_update;
+	info.video_tick = lyrics_source_video_tick;
+	info.video_render = lyrics_source_render;
+	info.show = lyrics_source_show;
+	info.activate = lyrics_source_activate;
+	info.get_width = lyrics_source_get_width;
+	info.get_height = lyrics_source_get_height;
+	info.get_properties = lyrics_source_properties;
+	info.get_defaults = lyrics_source_get_defaults;
+	info.media_play_pause = lyrics_source_media_play_pause;
+	info.media_restart = lyrics_source_media_restart;
+	info.media_stop = lyrics_source_media_stop;
+	info.media_next = lyrics_source_media_next;
+	info.media_previous = lyrics_source_media_previous;
+	info.media_get_state = lyrics_source_media_get_state;
+	info.media_get_time = lyrics_source_media_get_time;
+	info.media_set_time = lyrics_source_media_set_time;
+	info.media_get_duration = lyrics_source_media_get_duration;
+	info.icon_type = OBS_ICON_TYPE_TEXT;
+	obs_register_source(&info);
 }
@@ -1,11 +1,11 @@
 #pragma once
 
 #include <obs-module.h>
-#include <graphics/image-file.h>
 
 #define TEXT_FONT_NAME "font_name"
 #define TEXT_FONT_SIZE "font_size"
 #define TEXT_FONT_WEIGHT "font_weight"
+#define TEXT_RENDERER "text_renderer"
 #define TEXT_COLOR "text_color"
 #define TEXT_OUTLINE "outline"
 #define TEXT_OUTLINE_SIZE "outline_size"
@@ -20,6 +20,7 @@
 #define TEXT_Y "text_y"
 #define TEXT_WIDTH "text_width"
 #define TEXT_HEIGHT "text_height"
+#define TEXT_FIT_MODE "fit_mode"
 #define TEXT_SHOW_BOUNDS "show_bounds"
 #define TEXT_BOUNDS_COLOR "bounds_color"
 #define TEXT_BOUNDS_THICKNESS "bounds_thickness"
@@ -27,6 +28,20 @@
 #define LYRICS_FOLDER "lyrics_folder"
 #define LYRICS_FILES "lyrics_files"
 #define USE_FOLDER "use_folder"
+#define LYRICS_RECURSIVE "lyrics_recursive"
+#define LYRICS_PATTERNS "lyrics_patterns"
+#define SETLIST "setlist"
+#define LINE_CACHE_BUDGET "line_cache_budget"
+#define LINE_CACHE_PREFETCH "line_cache_prefetch"
+#define BACKGROUND_CACHE_BUDGET "background_cache_budget"
+#define LINK_GROUP "link_group"
+#define LRC_AUTO_ADVANCE "lrc_auto_advance"
+#define KARAOKE "karaoke"
+#define KARAOKE_COLOR "karaoke_color"
+#define TRANSITION_MODE "transition_mode"
+#define TRANSITION_DURATION "transition_duration"
+#define STATS_INTERVAL "stats_interval"
+#define STATS_CSV "stats_csv"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,14 +50,10 @@ extern "C" {
 struct lyrics_source {
 	obs_source_t *source;
 
-	// Background image
-	gs_image_file4_t background_image;
-	bool background_loaded;
-	char *background_file;
-
 	// Lyrics data - using void* to hide C++ implementation
 	void *songs_data;
 	void *song_names_data;
+	// Owned by video_tick; other threads queue navigation commands instead
 	int current_song;
 	int current_line;
 	bool text_visible;
@@ -50,6 +61,10 @@ struct lyrics_source {
 	// Text rendering
 	obs_source_t *text_source;
 
+	// Settings below belong to the thread that runs update. What video_tick
+	// and render need is published to them as an immutable snapshot instead.
+	int text_renderer; // lyrics_text_renderer_mode
+
 	// Text properties
 	uint32_t text_color;
 	uint32_t outline_color;
@@ -63,13 +78,9 @@ struct lyrics_source {
 	// Text positioning
 	int text_h_align; // 0 = left, 1 = center, 2 = right
 	int text_v_align; // 0 = top, 1 = center, 2 = bottom
-	int text_x;
-	int text_y;
 	int text_width;
 	int text_height;
-	bool show_bounds;
-	uint32_t bounds_color;
-	int bounds_thickness;
+	int fit_mode; // lyrics_fit_mode
 
 	// Font settings
 	char *font_name;
@@ -78,20 +89,51 @@ struct lyrics_source {
 
 	// File management
 	char *lyrics_folder;
+	char *lyrics_patterns;
 	obs_data_array_t *lyrics_files;
+	obs_data_array_t *setlist;
 	bool use_folder;
+	bool lyrics_recursive;
+
+	// Line cache
+	int line_cache_budget; // MiB
+	int line_cache_prefetch;
+	int background_cache_budget; // MiB
+
+	// Highlight of sung words in enhanced LRC lines
+	uint32_t karaoke_color;
+
+	// Line transitions
+	int transition_mode;
+	int transition_duration; // ms
 };
 
+// Registers "lyrics_source" with every callback below; called from
+// obs_module_load and by the command line tools
+void lyrics_source_register(void);
+
 // Source functions
 const char *lyrics_source_get_name(void *unused);
 void *lyrics_source_create(obs_data_t *settings, obs_source_t *source);
 void lyrics_source_destroy(void *data);
 void lyrics_source_update(void *data, obs_data_t *settings);
+void lyrics_source_video_tick(void *data, float seconds);
 void lyrics_source_render(void *data, gs_effect_t *effect);
+// Either one loads the songs of a source that was never shown before
+void lyrics_source_show(void *data);
+void lyrics_source_activate(void *data);
 uint32_t lyrics_source_get_width(void *data);
 uint32_t lyrics_source_get_height(void *data);
 obs_properties_t *lyrics_source_properties(void *data);
 void lyrics_source_get_defaults(obs_data_t *settings);
+// Module unload: waits for the loaders of released libraries and the layout
+// threads of destroyed sources to stop
+void lyrics_source_free_loaders(void);
+
+// Library state
+size_t lyrics_source_get_song_count(void *data);
+// Position as of the last video_tick
+void lyrics_source_get_position(void *data, int *song, int *line);
 
 // Toolbar actions
 void lyrics_source_next(void *data);
@@ -105,6 +147,9 @@ void lyrics_source_media_stop(void *data);
 void lyrics_source_media_next(void *data);
 void lyrics_source_media_previous(void *data);
 enum obs_media_state lyrics_source_media_get_state(void *data);
+int64_t lyrics_source_media_get_time(void *data);
+void lyrics_source_media_set_time(void *data, int64_t ms);
+int64_t lyrics_source_media_get_duration(void *data);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,216 @@
+#include "lyrics-stats.h"
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Samples kept per ring; older samples are overwritten
+#define RING_SIZE 1024
+
+struct sample_ring {
+	uint64_t values[RING_SIZE];
+	size_t next = 0;
+	size_t count = 0;
+};
+
+struct percentiles {
+	size_t count = 0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+struct lyrics_stats {
+	std::mutex mutex;
+	sample_ring rings[LYRICS_STATS_SAMPLE_COUNT];
+	std::atomic<uint64_t> counters[LYRICS_STATS_COUNTER_COUNT] = {};
+};
+
+static const char *sample_names[LYRICS_STATS_SAMPLE_COUNT] = {"latency_ms", "load_ms"};
+static const char *counter_names[LYRICS_STATS_COUNTER_COUNT] = {"navigations", "text_updates", "cached_lines",
+								 "style_updates"};
+
+lyrics_stats *lyrics_stats_create(void)
+{
+	return new lyrics_stats();
+}
+
+void lyrics_stats_destroy(lyrics_stats *stats)
+{
+	delete stats;
+}
+
+void lyrics_stats_record(lyrics_stats *stats, lyrics_stats_sample sample, uint64_t ns)
+{
+	std::lock_guard<std::mutex> lock(stats->mutex);
+	sample_ring &ring = stats->rings[sample];
+	ring.values[ring.next] = ns;
+	ring.next = (ring.next + 1) % RING_SIZE;
+	ring.count = std::min<size_t>(ring.count + 1, RING_SIZE);
+}
+
+void lyrics_stats_count(lyrics_stats *stats, lyrics_stats_counter counter)
+{
+	stats->counters[counter].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Nearest-rank percentile p of sorted, non-empty values
+static uint64_t nearest_rank(const std::vector<uint64_t> &values, double p)
+{
+	const size_t index = (size_t)(p * (double)values.size() + 0.999999);
+	return values[std::min(std::max<size_t>(index, 1), values.size()) - 1];
+}
+
+// Percentiles in milliseconds
+static percentiles compute_percentiles(std::vector<uint64_t> values)
+{
+	percentiles result;
+	result.count = values.size();
+	if (values.empty())
+		return result;
+
+	std::sort(values.begin(), values.end());
+	result.p50 = (double)nearest_rank(values, 0.50) / 1000000.0;
+	result.p95 = (double)nearest_rank(values, 0.95) / 1000000.0;
+	result.p99 = (double)nearest_rank(values, 0.99) / 1000000.0;
+	result.max = (double)values.back() / 1000000.0;
+	return result;
+}
+
+void lyrics_stats_set_percentiles(obs_data_t *obj, std::vector<uint64_t> &samples)
+{
+	if (samples.empty())
+		return;
+
+	std::sort(samples.begin(), samples.end());
+	obs_data_set_int(obj, "count", (long long)samples.size());
+	obs_data_set_int(obj, "p50_ns", (long long)nearest_rank(samples, 0.50));
+	obs_data_set_int(obj, "p95_ns", (long long)nearest_rank(samples, 0.95));
+	obs_data_set_int(obj, "p99_ns", (long long)nearest_rank(samples, 0.99));
+	obs_data_set_int(obj, "max_ns", (long long)samples.back());
+}
+
+static void snapshot(lyrics_stats *stats, percentiles (&samples)[LYRICS_STATS_SAMPLE_COUNT],
+		     uint64_t (&counters)[LYRICS_STATS_COUNTER_COUNT])
+{
+	std::vector<uint64_t> values[LYRICS_STATS_SAMPLE_COUNT];
+	{
+		std::lock_guard<std::mutex> lock(stats->mutex);
+		for (int i = 0; i < LYRICS_STATS_SAMPLE_COUNT; i++) {
+			const sample_ring &ring = stats->rings[i];
+			values[i].assign(ring.values, ring.values + ring.count);
+		}
+	}
+
+	for (int i = 0; i < LYRICS_STATS_SAMPLE_COUNT; i++)
+		samples[i] = compute_percentiles(std::move(values[i]));
+	for (int i = 0; i < LYRICS_STATS_COUNTER_COUNT; i++)
+		counters[i] = stats->counters[i].load(std::memory_order_relaxed);
+}
+
+obs_data_t *lyrics_stats_get(lyrics_stats *stats)
+{
+	percentiles samples[LYRICS_STATS_SAMPLE_COUNT];
+	uint64_t counters[LYRICS_STATS_COUNTER_COUNT];
+	snapshot(stats, samples, counters);
+
+	obs_data_t *result = obs_data_create();
+	for (int i = 0; i < LYRICS_STATS_SAMPLE_COUNT; i++) {
+		obs_data_t *item = obs_data_create();
+		obs_data_set_int(item, "count", (long long)samples[i].count);
+		obs_data_set_double(item, "p50", samples[i].p50);
+		obs_data_set_double(item, "p95", samples[i].p95);
+		obs_data_set_double(item, "p99", samples[i].p99);
+		obs_data_set_double(item, "max", samples[i].max);
+		obs_data_set_obj(result, sample_names[i], item);
+		obs_data_release(item);
+	}
+	for (int i = 0; i < LYRICS_STATS_COUNTER_COUNT; i++)
+		obs_data_set_int(result, counter_names[i], (long long)counters[i]);
+
+	return result;
+}
+
+struct csv_row {
+	std::string path;
+	std::string header;
+	std::string row;
+};
+
+static void append_csv(void *param)
+{
+	csv_row *row = (csv_row *)param;
+
+	const bool exists = os_file_exists(row->path.c_str());
+	FILE *file = os_fopen(row->path.c_str(), "a");
+	if (file) {
+		if (!exists)
+			fputs(row->header.c_str(), file);
+		fputs(row->row.c_str(), file);
+		fclose(file);
+	} else {
+		plugin_log(LOG_WARNING, "Failed to write lyrics statistics to '%s'", row->path.c_str());
+	}
+
+	delete row;
+}
+
+void lyrics_stats_dump(lyrics_stats *stats, const char *source_name, const char *csv_path)
+{
+	percentiles samples[LYRICS_STATS_SAMPLE_COUNT];
+	uint64_t counters[LYRICS_STATS_COUNTER_COUNT];
+	snapshot(stats, samples, counters);
+
+	const percentiles &latency = samples[LYRICS_STATS_LATENCY];
+	const percentiles &load = samples[LYRICS_STATS_LOAD];
+	plugin_log(LOG_INFO,
+		   "Stats for '%s': latency p50 %.2f / p95 %.2f / p99 %.2f ms (%zu), "
+		   "load p50 %.2f / p99 %.2f ms (%zu), "
+		   "%llu navigations, %llu text updates, %llu cached lines, %llu style updates",
+		   source_name, latency.p50, latency.p95, latency.p99, latency.count, load.p50, load.p99, load.count,
+		   (unsigned long long)counters[LYRICS_STATS_NAVIGATIONS],
+		   (unsigned long long)counters[LYRICS_STATS_TEXT_UPDATES],
+		   (unsigned long long)counters[LYRICS_STATS_CACHED_LINES],
+		   (unsigned long long)counters[LYRICS_STATS_STYLE_UPDATES]);
+
+	if (!csv_path || !*csv_path)
+		return;
+
+	csv_row *row = new csv_row();
+	row->path = csv_path;
+	row->header = "time,source";
+	for (int i = 0; i < LYRICS_STATS_SAMPLE_COUNT; i++) {
+		for (const char *field : {"count", "p50", "p95", "p99", "max"})
+			row->header += std::string(",") + sample_names[i] + "_" + field;
+	}
+	for (int i = 0; i < LYRICS_STATS_COUNTER_COUNT; i++)
+		row->header += std::string(",") + counter_names[i];
+	row->header += "\n";
+
+	char buffer[128];
+	std::string name = source_name;
+	for (size_t pos = name.find('"'); pos != std::string::npos; pos = name.find('"', pos + 2))
+		name.insert(pos, 1, '"');
+
+	snprintf(buffer, sizeof(buffer), "%lld", (long long)time(nullptr));
+	row->row = buffer;
+	row->row += ",\"" + name + "\"";
+	for (int i = 0; i < LYRICS_STATS_SAMPLE_COUNT; i++) {
+		snprintf(buffer, sizeof(buffer), ",%zu,%.3f,%.3f,%.3f,%.3f", samples[i].count, samples[i].p50,
+			 samples[i].p95, samples[i].p99, samples[i].max);
+		row->row += buffer;
+	}
+	for (int i = 0; i < LYRICS_STATS_COUNTER_COUNT; i++) {
+		snprintf(buffer, sizeof(buffer), ",%llu", (unsigned long long)counters[i]);
+		row->row += buffer;
+	}
+	row->row += "\n";
+
+	obs_queue_task(OBS_TASK_UI, append_csv, row, false);
+}
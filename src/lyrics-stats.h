@@ -0,0 +1,42 @@
+#pragma once
+
+#include <obs-module.h>
+#include <stdint.h>
+#include <vector>
+
+// Per-source runtime statistics. Durations go into fixed-size rings so the
+// percentiles describe recent behaviour, counters run for the source's life.
+// Every function is thread safe; recording is cheap enough for the render path.
+enum lyrics_stats_sample {
+	LYRICS_STATS_LATENCY, // navigation to the first frame showing the new line
+	LYRICS_STATS_LOAD,    // library load or incremental update
+	LYRICS_STATS_SAMPLE_COUNT,
+};
+
+enum lyrics_stats_counter {
+	LYRICS_STATS_NAVIGATIONS,
+	LYRICS_STATS_TEXT_UPDATES,  // obs_source_update calls on the text source
+	LYRICS_STATS_CACHED_LINES,  // line switches served by the line cache
+	LYRICS_STATS_STYLE_UPDATES,
+	LYRICS_STATS_COUNTER_COUNT,
+};
+
+struct lyrics_stats;
+
+lyrics_stats *lyrics_stats_create(void);
+void lyrics_stats_destroy(lyrics_stats *stats);
+
+void lyrics_stats_record(lyrics_stats *stats, lyrics_stats_sample sample, uint64_t ns);
+void lyrics_stats_count(lyrics_stats *stats, lyrics_stats_counter counter);
+
+// {"latency_ms": {count, p50, p95, p99, max}, "load_ms": {...}, "navigations": n, ...}
+obs_data_t *lyrics_stats_get(lyrics_stats *stats);
+
+// Logs a one-line summary and, if csv_path is set, appends the same numbers
+// as a CSV row. The file work is queued to the UI thread.
+void lyrics_stats_dump(lyrics_stats *stats, const char *source_name, const char *csv_path);
+
+// Sorts samples (ns) and sets {count, p50_ns, p95_ns, p99_ns, max_ns} on obj,
+// nearest-rank like the percentiles above; nothing without samples. For
+// measurements taken outside a source: replay runs and the benchmark.
+void lyrics_stats_set_percentiles(obs_data_t *obj, std::vector<uint64_t> &samples);
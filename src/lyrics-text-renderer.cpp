@@ -0,0 +1,561 @@
+#include "lyrics-text-renderer.h"
+#include "lyrics-layout.h"
+#include <plugin-support.h>
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
+#include <QFont>
+#include <QImage>
+#include <QPainter>
+#include <QPainterPath>
+#include <QRawFont>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Glyphs are rasterized at this pixel size and scaled to any other
+#define SDF_SIZE 48
+// Distance range stored around every edge, in atlas pixels. Outlines up to
+// this wide at SDF_SIZE come straight out of the distance field.
+#define SDF_SPREAD 8
+#define ATLAS_SIZE 1024
+#define MIN_VERTICES (6 * 64)
+
+// Metrics at SDF_SIZE
+struct atlas_glyph {
+	bool drawn = false; // false for glyphs without pixels, like spaces
+	uint16_t x = 0;     // cell in the atlas, spread included
+	uint16_t y = 0;
+	uint16_t cx = 0;
+	uint16_t cy = 0;
+	float left = 0.0f; // cell origin relative to the pen position on the baseline
+	float top = 0.0f;
+	float advance = 0.0f;
+};
+
+struct lyrics_text_renderer {
+	lyrics_text_style style;
+	bool has_style = false;
+	std::string text;
+	int size_override = 0;
+
+	QRawFont font;
+	std::string font_face;
+	int font_weight = -1;
+	float ascent = 0.0f;
+	float line_height = 0.0f;
+
+	// CPU copy of the atlas; uploaded only after glyphs were added
+	std::unordered_map<char32_t, atlas_glyph> glyphs;
+	std::vector<uint8_t> atlas;
+	uint32_t shelf_x = 0;
+	uint32_t shelf_y = 0;
+	uint32_t shelf_height = 0;
+	bool atlas_dirty = false;
+
+	// Two triangles per drawn glyph
+	std::vector<vec3> positions;
+	std::vector<vec2> uvs;
+	std::vector<float> reading; // position along the rows
+	bool vertices_dirty = false;
+
+	// Every laid out glyph, spaces included, in text order
+	struct placed_glyph {
+		uint32_t offset;
+		float start; // reading positions of its pen and its advance
+		float end;
+		bool space;
+	};
+	std::vector<placed_glyph> placed;
+	float progress = LYRICS_TEXT_NO_PROGRESS;
+
+	gs_texture_t *texture = nullptr;
+	gs_vertbuffer_t *vertices = nullptr;
+	size_t vertex_capacity = 0;
+	gs_effect_t *effect = nullptr;
+	bool effect_loaded = false;
+};
+
+lyrics_text_renderer *lyrics_text_renderer_create(void)
+{
+	return new lyrics_text_renderer();
+}
+
+void lyrics_text_renderer_destroy(lyrics_text_renderer *renderer)
+{
+	if (!renderer)
+		return;
+
+	obs_enter_graphics();
+	gs_texture_destroy(renderer->texture);
+	gs_vertexbuffer_destroy(renderer->vertices);
+	gs_effect_destroy(renderer->effect);
+	obs_leave_graphics();
+
+	delete renderer;
+}
+
+static void reset_atlas(lyrics_text_renderer *renderer)
+{
+	renderer->glyphs.clear();
+	renderer->atlas.assign(ATLAS_SIZE * ATLAS_SIZE, 0);
+	renderer->shelf_x = 0;
+	renderer->shelf_y = 0;
+	renderer->shelf_height = 0;
+	renderer->atlas_dirty = true;
+}
+
+static void load_font(lyrics_text_renderer *renderer)
+{
+	const lyrics_text_style &style = renderer->style;
+	if (renderer->font_face == style.face && renderer->font_weight == style.weight)
+		return;
+
+	renderer->font_face = style.face;
+	renderer->font_weight = style.weight;
+
+	QFont font(QString::fromStdString(style.face));
+	font.setPixelSize(SDF_SIZE);
+	font.setWeight((QFont::Weight)style.weight);
+	renderer->font = QRawFont::fromFont(font);
+
+	if (renderer->font.isValid()) {
+		renderer->ascent = (float)renderer->font.ascent();
+		renderer->line_height = (float)(renderer->font.ascent() + renderer->font.descent() +
+						renderer->font.leading());
+	} else {
+		plugin_log(LOG_WARNING, "Font '%s' not found for the built-in text renderer", style.face.c_str());
+		renderer->ascent = SDF_SIZE * 0.8f;
+		renderer->line_height = SDF_SIZE * 1.2f;
+	}
+
+	reset_atlas(renderer);
+}
+
+// Shelf packing; glyphs are never removed, the atlas is reset when full
+static bool place_cell(lyrics_text_renderer *renderer, uint32_t cx, uint32_t cy, uint16_t *x, uint16_t *y)
+{
+	if (renderer->shelf_x + cx > ATLAS_SIZE) {
+		renderer->shelf_y += renderer->shelf_height;
+		renderer->shelf_x = 0;
+		renderer->shelf_height = 0;
+	}
+	if (renderer->shelf_y + cy > ATLAS_SIZE)
+		return false;
+
+	*x = (uint16_t)renderer->shelf_x;
+	*y = (uint16_t)renderer->shelf_y;
+	renderer->shelf_x += cx + 1;
+	renderer->shelf_height = std::max(renderer->shelf_height, cy + 1);
+	return true;
+}
+
+// Stands for "no pixel of that side" in the squared distance transform
+#define EDT_INF 1.0e20f
+
+// One pass of Felzenszwalb and Huttenlocher's squared Euclidean distance
+// transform over n samples step apart: each becomes the minimum over j of
+// (i - j)^2 + f[j]. The lower envelope of those parabolas is built in one
+// sweep and read back in another, so a row or column costs O(n).
+static void distance_pass(float *f, int n, int step, std::vector<float> &d, std::vector<int> &v,
+			  std::vector<float> &z)
+{
+	int k = 0;
+	v[0] = 0;
+	z[0] = -EDT_INF;
+	z[1] = EDT_INF;
+	for (int q = 1; q < n; q++) {
+		const float fq = f[(size_t)q * step] + (float)q * q;
+		float s;
+		for (;;) {
+			const int p = v[k];
+			s = (fq - (f[(size_t)p * step] + (float)p * p)) / (float)(2 * (q - p));
+			if (s > z[k] || k == 0)
+				break;
+			k--;
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = EDT_INF;
+	}
+
+	k = 0;
+	for (int q = 0; q < n; q++) {
+		while (z[k + 1] < (float)q)
+			k++;
+		const int p = v[k];
+		d[q] = (float)(q - p) * (q - p) + f[(size_t)p * step];
+	}
+	for (int q = 0; q < n; q++)
+		f[(size_t)q * step] = d[q];
+}
+
+// Squared distance from every pixel to the nearest one whose inside flag is
+// side, by a pass down every column and then along every row
+static void squared_distances(const std::vector<uint8_t> &inside, uint8_t side, int cx, int cy,
+			      std::vector<float> &out)
+{
+	out.resize(inside.size());
+	for (size_t i = 0; i < inside.size(); i++)
+		out[i] = inside[i] == side ? 0.0f : EDT_INF;
+
+	const int n = std::max(cx, cy);
+	std::vector<float> d((size_t)n);
+	std::vector<int> v((size_t)n);
+	std::vector<float> z((size_t)n + 1);
+	for (int x = 0; x < cx; x++)
+		distance_pass(out.data() + x, cy, cx, d, v, z);
+	for (int y = 0; y < cy; y++)
+		distance_pass(out.data() + (size_t)y * cx, cx, 1, d, v, z);
+}
+
+// Signed distance from every pixel to the nearest one on the other side of the
+// edge, from an exact distance transform towards each side. That is linear in
+// the cell size, where searching the spread around every pixel was not. Cells
+// have the spread as a margin, so pixels past the cell never matter.
+static void build_distance_field(const QImage &image, uint8_t *out, uint32_t stride)
+{
+	const int cx = image.width();
+	const int cy = image.height();
+
+	std::vector<uint8_t> inside((size_t)cx * cy);
+	for (int y = 0; y < cy; y++) {
+		const uint8_t *line = image.constScanLine(y);
+		for (int x = 0; x < cx; x++)
+			inside[(size_t)y * cx + x] = line[x] >= 128;
+	}
+
+	std::vector<float> to_outside;
+	std::vector<float> to_inside;
+	squared_distances(inside, 0, cx, cy, to_outside);
+	squared_distances(inside, 1, cx, cy, to_inside);
+
+	const float limit = (float)((SDF_SPREAD + 1) * (SDF_SPREAD + 1));
+	for (int y = 0; y < cy; y++) {
+		for (int x = 0; x < cx; x++) {
+			const size_t i = (size_t)y * cx + x;
+			const bool in = inside[i] != 0;
+			const float best = std::min(in ? to_outside[i] : to_inside[i], limit);
+
+			const float distance = std::min(std::sqrt(best) - 0.5f, (float)SDF_SPREAD);
+			const float value = 0.5f + (in ? distance : -distance) / (2.0f * SDF_SPREAD);
+			out[(size_t)y * stride + x] = (uint8_t)std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+		}
+	}
+}
+
+// Null when the atlas is full
+static const atlas_glyph *get_glyph(lyrics_text_renderer *renderer, char32_t codepoint)
+{
+	auto it = renderer->glyphs.find(codepoint);
+	if (it != renderer->glyphs.end())
+		return &it->second;
+
+	atlas_glyph glyph;
+	if (!renderer->font.isValid()) {
+		glyph.advance = SDF_SIZE * 0.5f;
+		return &renderer->glyphs.emplace(codepoint, glyph).first->second;
+	}
+
+	const QList<quint32> indexes = renderer->font.glyphIndexesForString(QString::fromUcs4(&codepoint, 1));
+	for (const QPointF &advance : renderer->font.advancesForGlyphIndexes(indexes))
+		glyph.advance += (float)advance.x();
+
+	const QPainterPath path = indexes.isEmpty() ? QPainterPath() : renderer->font.pathForGlyph(indexes[0]);
+	if (!path.isEmpty()) {
+		const QRectF bounds = path.boundingRect();
+		const int left = (int)std::floor(bounds.left()) - SDF_SPREAD;
+		const int top = (int)std::floor(bounds.top()) - SDF_SPREAD;
+		const int cx = (int)std::ceil(bounds.right()) + SDF_SPREAD - left;
+		const int cy = (int)std::ceil(bounds.bottom()) + SDF_SPREAD - top;
+
+		if (cx <= ATLAS_SIZE && cy <= ATLAS_SIZE) {
+			if (!place_cell(renderer, (uint32_t)cx, (uint32_t)cy, &glyph.x, &glyph.y))
+				return nullptr;
+
+			QImage image(cx, cy, QImage::Format_Alpha8);
+			image.fill(Qt::transparent);
+			QPainter painter(&image);
+			painter.setRenderHint(QPainter::Antialiasing);
+			painter.translate(-left, -top);
+			painter.fillPath(path, Qt::white);
+			painter.end();
+
+			build_distance_field(image, renderer->atlas.data() + (size_t)glyph.y * ATLAS_SIZE + glyph.x,
+					     ATLAS_SIZE);
+			glyph.drawn = true;
+			glyph.cx = (uint16_t)cx;
+			glyph.cy = (uint16_t)cy;
+			glyph.left = (float)left;
+			glyph.top = (float)top;
+			renderer->atlas_dirty = true;
+		}
+	}
+
+	return &renderer->glyphs.emplace(codepoint, glyph).first->second;
+}
+
+// shift turns x into the reading position
+static void add_quad(lyrics_text_renderer *renderer, const atlas_glyph &glyph, float x, float y, float scale,
+		     float shift)
+{
+	const float x1 = x + glyph.cx * scale;
+	const float y1 = y + glyph.cy * scale;
+	const float u0 = (float)glyph.x / ATLAS_SIZE;
+	const float v0 = (float)glyph.y / ATLAS_SIZE;
+	const float u1 = (float)(glyph.x + glyph.cx) / ATLAS_SIZE;
+	const float v1 = (float)(glyph.y + glyph.cy) / ATLAS_SIZE;
+
+	const float corners[6][4] = {
+		{x, y, u0, v0}, {x1, y, u1, v0}, {x, y1, u0, v1}, {x, y1, u0, v1}, {x1, y, u1, v0}, {x1, y1, u1, v1},
+	};
+	for (const auto &corner : corners) {
+		vec3 position;
+		vec3_set(&position, corner[0], corner[1], 0.0f);
+		vec2 uv;
+		vec2_set(&uv, corner[2], corner[3]);
+		renderer->positions.push_back(position);
+		renderer->uvs.push_back(uv);
+		renderer->reading.push_back(corner[0] + shift);
+	}
+}
+
+static float render_size(const lyrics_text_renderer *renderer)
+{
+	return (float)(renderer->size_override ? renderer->size_override : renderer->style.size);
+}
+
+// Wraps the text like the text source does and aligns every row in the box.
+// Returns false if the atlas filled up half-way.
+static bool build_vertices(lyrics_text_renderer *renderer)
+{
+	renderer->positions.clear();
+	renderer->uvs.clear();
+	renderer->reading.clear();
+	renderer->placed.clear();
+	renderer->vertices_dirty = true;
+
+	const lyrics_text_style &style = renderer->style;
+	const float size = render_size(renderer);
+	if (size <= 0.0f || renderer->text.empty())
+		return true;
+
+	const float scale = size / SDF_SIZE;
+	std::vector<lyrics_layout_glyph> line;
+	std::vector<const atlas_glyph *> cells;
+
+	const uint8_t *const begin = (const uint8_t *)renderer->text.data();
+	const uint8_t *const end = begin + renderer->text.size();
+	for (const uint8_t *p = begin; p < end;) {
+		const uint32_t offset = (uint32_t)(p - begin);
+		const char32_t codepoint = lyrics_layout_next_codepoint(p, end);
+		const atlas_glyph *glyph = get_glyph(renderer, codepoint);
+		if (!glyph)
+			return false;
+		line.push_back({offset, codepoint, glyph->advance, codepoint == ' ' || codepoint == '\t'});
+		cells.push_back(glyph);
+	}
+
+	std::vector<lyrics_layout_row> rows;
+	lyrics_layout_wrap(line, style.width > 0 ? (float)style.width / scale : FLT_MAX, rows);
+
+	const float line_height = renderer->line_height * scale;
+	const float box_height = (float)style.height;
+	const float text_height = line_height * (float)rows.size();
+	const float free_height = box_height - text_height;
+	float y = style.v_align == 0 ? 0.0f : (style.v_align == 1 ? free_height * 0.5f : free_height);
+	float row_start = 0.0f; // reading position of the row
+
+	for (const lyrics_layout_row &row : rows) {
+		const float row_width = row.width * scale;
+		const float box_width = (float)style.width;
+		const float free_width = box_width - row_width;
+		float x = style.h_align == 0 ? 0.0f : (style.h_align == 1 ? free_width * 0.5f : free_width);
+		const float baseline = y + renderer->ascent * scale;
+		const float shift = row_start - x;
+
+		for (uint32_t i = row.begin; i < row.end; i++) {
+			const atlas_glyph &glyph = *cells[i];
+			const float advance = glyph.advance * scale;
+			if (glyph.drawn)
+				add_quad(renderer, glyph, x + glyph.left * scale, baseline + glyph.top * scale, scale,
+					 shift);
+			renderer->placed.push_back({line[i].offset, x + shift, x + shift + advance, line[i].space});
+			x += advance;
+		}
+		y += line_height;
+		row_start += row_width;
+	}
+	return true;
+}
+
+static void update_layout(lyrics_text_renderer *renderer)
+{
+	load_font(renderer);
+	if (build_vertices(renderer))
+		return;
+
+	// Start over with only this line's glyphs
+	plugin_log(LOG_DEBUG, "Glyph atlas full, rebuilding it");
+	reset_atlas(renderer);
+	if (!build_vertices(renderer))
+		plugin_log(LOG_WARNING, "Line has more glyphs than the glyph atlas holds");
+}
+
+void lyrics_text_renderer_set_style(lyrics_text_renderer *renderer, const lyrics_text_style &style)
+{
+	const lyrics_text_style &old = renderer->style;
+	const bool relayout = !renderer->has_style || old.face != style.face || old.weight != style.weight ||
+			      old.size != style.size || old.width != style.width || old.height != style.height ||
+			      old.h_align != style.h_align || old.v_align != style.v_align;
+
+	// Colors, outline and shadow are only uniforms
+	renderer->style = style;
+	renderer->has_style = true;
+	if (relayout)
+		update_layout(renderer);
+}
+
+void lyrics_text_renderer_set_text(lyrics_text_renderer *renderer, const char *text, int size)
+{
+	if (renderer->text == text && renderer->size_override == size)
+		return;
+
+	renderer->text = text;
+	renderer->size_override = size;
+	renderer->progress = LYRICS_TEXT_NO_PROGRESS;
+	if (renderer->has_style)
+		update_layout(renderer);
+}
+
+bool lyrics_text_renderer_word_span(lyrics_text_renderer *renderer, uint32_t begin, uint32_t end, float *start,
+				    float *stop)
+{
+	bool found = false;
+	for (const lyrics_text_renderer::placed_glyph &glyph : renderer->placed) {
+		if (glyph.offset < begin || glyph.offset >= end || glyph.space)
+			continue;
+		if (!found)
+			*start = glyph.start;
+		*stop = glyph.end;
+		found = true;
+	}
+	return found;
+}
+
+void lyrics_text_renderer_set_progress(lyrics_text_renderer *renderer, float progress)
+{
+	renderer->progress = progress;
+}
+
+static void load_effect(lyrics_text_renderer *renderer)
+{
+	if (renderer->effect_loaded)
+		return;
+	renderer->effect_loaded = true;
+
+	char *path = obs_module_file("lyrics-text.effect");
+	char *error = nullptr;
+	renderer->effect = gs_effect_create_from_file(path, &error);
+	if (!renderer->effect)
+		plugin_log(LOG_WARNING, "Failed to load text effect '%s': %s", path, error ? error : "unknown");
+	bfree(error);
+	bfree(path);
+}
+
+static void upload(lyrics_text_renderer *renderer)
+{
+	if (!renderer->texture) {
+		renderer->texture = gs_texture_create(ATLAS_SIZE, ATLAS_SIZE, GS_R8, 1, nullptr, GS_DYNAMIC);
+		renderer->atlas_dirty = true;
+	}
+	if (renderer->atlas_dirty && !renderer->atlas.empty()) {
+		gs_texture_set_image(renderer->texture, renderer->atlas.data(), ATLAS_SIZE, false);
+		renderer->atlas_dirty = false;
+	}
+
+	if (!renderer->vertices_dirty)
+		return;
+	renderer->vertices_dirty = false;
+
+	const size_t count = renderer->positions.size();
+	if (count > renderer->vertex_capacity) {
+		gs_vertexbuffer_destroy(renderer->vertices);
+		renderer->vertex_capacity = std::max({count, renderer->vertex_capacity * 2, (size_t)MIN_VERTICES});
+
+		gs_vb_data *data = gs_vbdata_create();
+		data->num = renderer->vertex_capacity;
+		data->points = (vec3 *)bzalloc(sizeof(vec3) * data->num);
+		data->num_tex = 2;
+		data->tvarray = (gs_tvertarray *)bzalloc(sizeof(gs_tvertarray) * 2);
+		data->tvarray[0].width = 2;
+		data->tvarray[0].array = bzalloc(sizeof(vec2) * data->num);
+		data->tvarray[1].width = 1;
+		data->tvarray[1].array = bzalloc(sizeof(float) * data->num);
+		renderer->vertices = gs_vertexbuffer_create(data, GS_DYNAMIC);
+	}
+
+	if (!count || !renderer->vertices)
+		return;
+
+	gs_vb_data *data = gs_vertexbuffer_get_data(renderer->vertices);
+	memcpy(data->points, renderer->positions.data(), sizeof(vec3) * count);
+	memcpy(data->tvarray[0].array, renderer->uvs.data(), sizeof(vec2) * count);
+	memcpy(data->tvarray[1].array, renderer->reading.data(), sizeof(float) * count);
+	gs_vertexbuffer_flush(renderer->vertices);
+}
+
+void lyrics_text_renderer_render(lyrics_text_renderer *renderer)
+{
+	load_effect(renderer);
+	if (!renderer->effect || !renderer->has_style)
+		return;
+
+	upload(renderer);
+	const size_t count = renderer->positions.size();
+	if (!count || !renderer->vertices)
+		return;
+
+	// One screen pixel in distance field units at this size
+	const lyrics_text_style &style = renderer->style;
+	const float scale = render_size(renderer) / SDF_SIZE;
+	const float unit = 1.0f / (2.0f * SDF_SPREAD * scale);
+	const float smoothing = std::min(0.75f * unit, 0.25f);
+	const float outline = style.outline > 0 ? std::min((float)style.outline * unit, 0.5f - smoothing) : 0.0f;
+
+	struct vec4 color, outline_color, shadow_color, highlight_color;
+	vec4_from_rgba_srgb(&color, style.color);
+	vec4_from_rgba_srgb(&highlight_color, style.highlight_color);
+	vec4_from_rgba_srgb(&outline_color, style.outline > 0 ? style.outline_color : 0);
+	vec4_from_rgba_srgb(&shadow_color, style.shadow_color);
+	struct vec2 shadow_offset;
+	vec2_set(&shadow_offset, (float)style.shadow_x, (float)style.shadow_y);
+
+	gs_effect_t *const effect = renderer->effect;
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "atlas"), renderer->texture);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color"), &color);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "outline_color"), &outline_color);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "shadow_color"), &shadow_color);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "highlight_color"), &highlight_color);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "progress"), renderer->progress);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "outline_width"), outline);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "smoothing"), smoothing);
+	gs_effect_set_vec2(gs_effect_get_param_by_name(effect, "shadow_offset"), &shadow_offset);
+
+	const bool previous = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(true);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	gs_load_vertexbuffer(renderer->vertices);
+	gs_load_indexbuffer(nullptr);
+	while (gs_effect_loop(effect, style.shadow ? "DrawShadow" : "Draw"))
+		gs_draw(GS_TRIS, 0, (uint32_t)count);
+	gs_load_vertexbuffer(nullptr);
+
+	gs_blend_state_pop();
+	gs_enable_framebuffer_srgb(previous);
+}
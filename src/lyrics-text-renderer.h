@@ -0,0 +1,67 @@
+#pragma once
+
+#include <obs-module.h>
+#include <string>
+
+// Which renderer draws the text of a lyrics source
+enum lyrics_text_renderer_mode {
+	LYRICS_TEXT_RENDERER_SOURCE,  // a private text_ft2_source
+	LYRICS_TEXT_RENDERER_BUILTIN, // the glyph atlas below
+};
+
+// Text drawn straight from a signed distance field glyph atlas, instead of
+// through a private text source. Glyphs are rasterized into the atlas once per
+// font; a line is laid out into a single vertex buffer, and colors, outline
+// and shadow are shader uniforms. Style changes that keep the font, size and
+// box cost no CPU work, and a new line only uploads glyphs the atlas lacks.
+// Every vertex also carries its reading position: its distance in pixels
+// along the rows, as if they were laid end to end. Sung words are a wipe in
+// the highlight color up to a progress uniform in those units.
+
+struct lyrics_text_style {
+	std::string face;
+	int weight = 400;
+	int size = 0;
+	uint32_t color = 0xFFFFFFFF;
+	int outline = 0; // pixels, 0 for none
+	uint32_t outline_color = 0;
+	bool shadow = false;
+	int shadow_x = 0;
+	int shadow_y = 0;
+	uint32_t shadow_color = 0;
+	uint32_t highlight_color = 0; // sung words
+	int h_align = 1; // 0 = left, 1 = center, 2 = right
+	int v_align = 1; // 0 = top, 1 = center, 2 = bottom
+	int width = 0;
+	int height = 0;
+
+	bool operator==(const lyrics_text_style &other) const
+	{
+		return face == other.face && weight == other.weight && size == other.size && color == other.color &&
+		       outline == other.outline && outline_color == other.outline_color && shadow == other.shadow &&
+		       shadow_x == other.shadow_x && shadow_y == other.shadow_y && shadow_color == other.shadow_color &&
+		       highlight_color == other.highlight_color && h_align == other.h_align &&
+		       v_align == other.v_align && width == other.width && height == other.height;
+	}
+	bool operator!=(const lyrics_text_style &other) const { return !(*this == other); }
+};
+
+struct lyrics_text_renderer;
+
+lyrics_text_renderer *lyrics_text_renderer_create(void);
+void lyrics_text_renderer_destroy(lyrics_text_renderer *renderer);
+
+// Graphics thread only (video_tick or render). Text is copied.
+void lyrics_text_renderer_set_style(lyrics_text_renderer *renderer, const lyrics_text_style &style);
+// size replaces the style's font size for a line shrunk to fit, 0 keeps it
+void lyrics_text_renderer_set_text(lyrics_text_renderer *renderer, const char *text, int size);
+// Reading positions of the glyphs of bytes [begin, end) of the text, spaces
+// aside. False if none of them is laid out.
+bool lyrics_text_renderer_word_span(lyrics_text_renderer *renderer, uint32_t begin, uint32_t end, float *start,
+				    float *stop);
+// Highlights everything before this reading position; new text starts at
+// LYRICS_TEXT_NO_PROGRESS, which highlights nothing
+#define LYRICS_TEXT_NO_PROGRESS -1.0e9f
+void lyrics_text_renderer_set_progress(lyrics_text_renderer *renderer, float progress);
+// Draws the text into its box at the origin
+void lyrics_text_renderer_render(lyrics_text_renderer *renderer);
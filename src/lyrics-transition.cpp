@@ -0,0 +1,183 @@
+#include "lyrics-transition.h"
+#include <plugin-support.h>
+#include <graphics/vec4.h>
+#include <algorithm>
+#include <atomic>
+
+struct lyrics_transition {
+	std::atomic<int> mode{LYRICS_TRANSITION_NONE};
+	std::atomic<int> duration_ms{300};
+	std::atomic<bool> reset{false};
+
+	// Graphics thread only
+	gs_effect_t *effect = nullptr;
+	bool effect_loaded = false;
+	gs_texrender_t *layers[2] = {};
+	int front = 0;
+	bool front_empty = true;
+	bool has_capture = false;
+	uint32_t cx = 0;
+	uint32_t cy = 0;
+
+	bool active = false;
+	float elapsed = 0.0f;
+};
+
+static const char *technique_names[] = {"Crossfade", "Fade", "Crossfade", "Slide"};
+
+lyrics_transition *lyrics_transition_create(void)
+{
+	return new lyrics_transition();
+}
+
+void lyrics_transition_destroy(lyrics_transition *transition)
+{
+	if (!transition)
+		return;
+
+	obs_enter_graphics();
+	gs_texrender_destroy(transition->layers[0]);
+	gs_texrender_destroy(transition->layers[1]);
+	gs_effect_destroy(transition->effect);
+	obs_leave_graphics();
+
+	delete transition;
+}
+
+void lyrics_transition_configure(lyrics_transition *transition, int mode, int duration_ms)
+{
+	if (mode < LYRICS_TRANSITION_NONE || mode > LYRICS_TRANSITION_SLIDE)
+		mode = LYRICS_TRANSITION_NONE;
+
+	// Layers captured while disabled would be stale once re-enabled
+	if (transition->mode.exchange(mode) != mode)
+		transition->reset = true;
+	transition->duration_ms = duration_ms > 0 ? duration_ms : 1;
+}
+
+bool lyrics_transition_enabled(lyrics_transition *transition)
+{
+	return transition->mode != LYRICS_TRANSITION_NONE;
+}
+
+bool lyrics_transition_has_capture(lyrics_transition *transition)
+{
+	if (transition->reset.exchange(false)) {
+		transition->has_capture = false;
+		transition->active = false;
+	}
+	return transition->has_capture;
+}
+
+void lyrics_transition_tick(lyrics_transition *transition, float seconds)
+{
+	if (!transition->active)
+		return;
+
+	transition->elapsed += seconds;
+	if (transition->elapsed * 1000.0f >= (float)transition->duration_ms)
+		transition->active = false;
+}
+
+static void load_effect(lyrics_transition *transition)
+{
+	if (transition->effect_loaded)
+		return;
+	transition->effect_loaded = true;
+
+	char *path = obs_module_file("lyrics-transition.effect");
+	char *error = nullptr;
+	transition->effect = gs_effect_create_from_file(path, &error);
+	if (!transition->effect)
+		plugin_log(LOG_WARNING, "Failed to load transition effect '%s': %s", path, error ? error : "unknown");
+	bfree(error);
+	bfree(path);
+}
+
+// Clears layer to cx x cy and draws into it unless empty
+static void draw_layer(gs_texrender_t *layer, uint32_t cx, uint32_t cy, bool empty, lyrics_transition_draw_t draw,
+		       void *param)
+{
+	gs_texrender_reset(layer);
+	if (gs_texrender_begin(layer, cx, cy)) {
+		struct vec4 clear_color;
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+		gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+		// Keep the layer premultiplied
+		gs_blend_state_push();
+		gs_blend_function_separate(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA, GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+		if (!empty)
+			draw(param);
+		gs_blend_state_pop();
+
+		gs_texrender_end(layer);
+	}
+}
+
+void lyrics_transition_capture(lyrics_transition *transition, uint32_t cx, uint32_t cy, bool animate, bool empty,
+			       lyrics_transition_draw_t draw, void *param)
+{
+	load_effect(transition);
+
+	const int back = transition->front ^ 1;
+	if (!transition->layers[back])
+		transition->layers[back] = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+	draw_layer(transition->layers[back], cx, cy, empty, draw, param);
+
+	// Only blend between layers of the same size that hold something
+	animate = animate && transition->effect && transition->has_capture && transition->cx == cx &&
+		  transition->cy == cy && !(empty && transition->front_empty);
+
+	transition->front = back;
+	transition->front_empty = empty;
+	transition->has_capture = true;
+	transition->cx = cx;
+	transition->cy = cy;
+	transition->active = animate;
+	transition->elapsed = 0.0f;
+}
+
+void lyrics_transition_redraw(lyrics_transition *transition, lyrics_transition_draw_t draw, void *param)
+{
+	if (!transition->has_capture || transition->front_empty)
+		return;
+	draw_layer(transition->layers[transition->front], transition->cx, transition->cy, false, draw, param);
+}
+
+void lyrics_transition_render(lyrics_transition *transition)
+{
+	if (!transition->has_capture)
+		return;
+
+	gs_texture_t *incoming = gs_texrender_get_texture(transition->layers[transition->front]);
+	gs_texture_t *outgoing = transition->layers[transition->front ^ 1]
+					 ? gs_texrender_get_texture(transition->layers[transition->front ^ 1])
+					 : nullptr;
+	if (!incoming || (!transition->active && transition->front_empty))
+		return;
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	if (transition->active && outgoing) {
+		const float duration = (float)transition->duration_ms / 1000.0f;
+		const float progress = duration > 0.0f ? std::min(transition->elapsed / duration, 1.0f) : 1.0f;
+
+		gs_effect_set_texture(gs_effect_get_param_by_name(transition->effect, "image_a"), outgoing);
+		gs_effect_set_texture(gs_effect_get_param_by_name(transition->effect, "image_b"), incoming);
+		gs_effect_set_float(gs_effect_get_param_by_name(transition->effect, "progress"), progress);
+
+		while (gs_effect_loop(transition->effect, technique_names[transition->mode]))
+			gs_draw_sprite(incoming, 0, transition->cx, transition->cy);
+	} else {
+		gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+		gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), incoming);
+
+		while (gs_effect_loop(effect, "Draw"))
+			gs_draw_sprite(incoming, 0, transition->cx, transition->cy);
+	}
+
+	gs_blend_state_pop();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <obs-module.h>
+
+// Animated line changes. Each shown line is drawn once into one of two
+// texrenders; a transition then only blends the outgoing and incoming
+// textures with a progress uniform, so no text is re-rasterized while it runs.
+enum lyrics_transition_mode {
+	LYRICS_TRANSITION_NONE,
+	LYRICS_TRANSITION_FADE,
+	LYRICS_TRANSITION_CROSSFADE,
+	LYRICS_TRANSITION_SLIDE,
+};
+
+typedef void (*lyrics_transition_draw_t)(void *param);
+
+struct lyrics_transition;
+
+lyrics_transition *lyrics_transition_create(void);
+void lyrics_transition_destroy(lyrics_transition *transition);
+
+void lyrics_transition_configure(lyrics_transition *transition, int mode, int duration_ms);
+bool lyrics_transition_enabled(lyrics_transition *transition);
+
+// Graphics thread only
+bool lyrics_transition_has_capture(lyrics_transition *transition);
+void lyrics_transition_tick(lyrics_transition *transition, float seconds);
+// Draws the new line into the spare layer with draw(param), or leaves it
+// empty, and animates from the current layer to it when animate is set
+void lyrics_transition_capture(lyrics_transition *transition, uint32_t cx, uint32_t cy, bool animate, bool empty,
+			       lyrics_transition_draw_t draw, void *param);
+// Draws the current line again in place, for changes that are not a new line
+// such as a moving word highlight. A running transition carries on.
+void lyrics_transition_redraw(lyrics_transition *transition, lyrics_transition_draw_t draw, void *param);
+void lyrics_transition_render(lyrics_transition *transition);
@@ -0,0 +1,303 @@
+#include "lyrics-watcher.h"
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#endif
+
+// Quiet period after the last event before changes are reported
+#define DEBOUNCE_MS 300
+
+namespace fs = std::filesystem;
+
+struct lyrics_watcher {
+	std::string folder;
+	bool recursive;
+	lyrics_watcher_changed_t changed;
+	void *param;
+	std::thread thread;
+
+#ifdef __linux__
+	int inotify_fd = -1;
+	int stop_fd = -1;
+	std::map<int, std::string> dirs; // watch descriptor -> path relative to folder
+#else
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool stopping = false;
+#endif
+};
+
+static void report(lyrics_watcher *watcher, std::set<std::string> &pending)
+{
+	if (pending.empty())
+		return;
+
+	std::vector<std::string> paths;
+	paths.reserve(pending.size());
+	for (const std::string &relative : pending)
+		paths.push_back(relative.empty() ? watcher->folder : watcher->folder + "/" + relative);
+	pending.clear();
+
+	watcher->changed(watcher->param, paths);
+}
+
+#ifdef __linux__
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+static bool add_watch(lyrics_watcher *watcher, const std::string &relative)
+{
+	const std::string path = relative.empty() ? watcher->folder : watcher->folder + "/" + relative;
+	const int wd = inotify_add_watch(watcher->inotify_fd, path.c_str(), WATCH_MASK | IN_ONLYDIR);
+	if (wd < 0)
+		return false;
+	watcher->dirs[wd] = relative;
+
+	if (!watcher->recursive)
+		return true;
+
+	// Incremented by hand: the range-for form throws on the first unreadable entry
+	std::error_code ec;
+	const fs::directory_options options = fs::directory_options::skip_permission_denied;
+	for (fs::directory_iterator it(fs::u8path(path), options, ec), end; !ec && it != end; it.increment(ec)) {
+		const fs::directory_entry &entry = *it;
+		std::error_code entry_ec;
+		if (entry.is_directory(entry_ec) && !entry.is_symlink(entry_ec)) {
+			const std::string name = entry.path().filename().u8string();
+			add_watch(watcher, relative.empty() ? name : relative + "/" + name);
+		}
+	}
+	return true;
+}
+
+static void watcher_thread(lyrics_watcher *watcher)
+{
+	os_set_thread_name("lyrics-watcher");
+
+	std::set<std::string> pending;
+	alignas(struct inotify_event) char buffer[4096];
+
+	for (;;) {
+		struct pollfd fds[2] = {{watcher->inotify_fd, POLLIN, 0}, {watcher->stop_fd, POLLIN, 0}};
+		const int ret = poll(fds, 2, pending.empty() ? -1 : DEBOUNCE_MS);
+
+		if (ret < 0)
+			continue;
+		if (fds[1].revents)
+			return;
+		if (ret == 0) {
+			report(watcher, pending);
+			continue;
+		}
+
+		ssize_t len;
+		while ((len = read(watcher->inotify_fd, buffer, sizeof(buffer))) > 0) {
+			for (char *ptr = buffer; ptr < buffer + len;) {
+				const struct inotify_event *event = (const struct inotify_event *)ptr;
+				ptr += sizeof(struct inotify_event) + event->len;
+
+				// Events were dropped: watch any folders that appeared
+				// meanwhile and have the whole folder rescanned
+				if (event->mask & IN_Q_OVERFLOW) {
+					plugin_log(LOG_WARNING, "Lyrics folder watcher missed events in %s, rescanning",
+						   watcher->folder.c_str());
+					add_watch(watcher, std::string());
+					pending.insert(std::string());
+					continue;
+				}
+
+				if (event->mask & IN_IGNORED) {
+					watcher->dirs.erase(event->wd);
+					continue;
+				}
+
+				auto dir = watcher->dirs.find(event->wd);
+				if (!event->len || dir == watcher->dirs.end())
+					continue;
+
+				const std::string relative =
+					dir->second.empty() ? event->name : dir->second + "/" + event->name;
+
+				if (event->mask & IN_ISDIR) {
+					if (!watcher->recursive)
+						continue;
+					// New subfolders get their own watches, the loader
+					// expands the reported folder path into its files
+					if (event->mask & (IN_CREATE | IN_MOVED_TO))
+						add_watch(watcher, relative);
+				}
+				pending.insert(relative);
+			}
+		}
+	}
+}
+
+static bool watcher_start(lyrics_watcher *watcher)
+{
+	watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher->inotify_fd < 0)
+		return false;
+
+	if (!add_watch(watcher, std::string())) {
+		close(watcher->inotify_fd);
+		return false;
+	}
+
+	watcher->stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (watcher->stop_fd < 0) {
+		close(watcher->inotify_fd);
+		return false;
+	}
+
+	watcher->thread = std::thread(watcher_thread, watcher);
+	return true;
+}
+
+static void watcher_stop(lyrics_watcher *watcher)
+{
+	const uint64_t value = 1;
+	if (write(watcher->stop_fd, &value, sizeof(value)) < 0)
+		plugin_log(LOG_WARNING, "Failed to signal lyrics folder watcher");
+	watcher->thread.join();
+
+	close(watcher->stop_fd);
+	close(watcher->inotify_fd);
+}
+#else
+#define POLL_INTERVAL_MS 1000
+
+struct file_state {
+	uintmax_t size;
+	fs::file_time_type mtime;
+	bool operator!=(const file_state &other) const { return size != other.size || mtime != other.mtime; }
+};
+
+static void snapshot_entry(std::map<std::string, file_state> &files, const fs::path &root,
+			   const fs::directory_entry &entry)
+{
+	std::error_code ec;
+	if (!entry.is_regular_file(ec))
+		return;
+
+	file_state state;
+	state.size = entry.file_size(ec);
+	state.mtime = entry.last_write_time(ec);
+	if (!ec)
+		files.emplace(entry.path().lexically_relative(root).generic_u8string(), state);
+}
+
+static std::map<std::string, file_state> snapshot(const std::string &folder, bool recursive)
+{
+	std::map<std::string, file_state> files;
+	const fs::path root = fs::u8path(folder);
+	std::error_code ec;
+
+	// Unreadable subfolders are left out; any other error ends the walk
+	// rather than throwing out of the watcher thread
+	const fs::directory_options options = fs::directory_options::skip_permission_denied;
+	if (recursive) {
+		for (fs::recursive_directory_iterator it(root, options, ec), end; !ec && it != end; it.increment(ec))
+			snapshot_entry(files, root, *it);
+	} else {
+		for (fs::directory_iterator it(root, options, ec), end; !ec && it != end; it.increment(ec))
+			snapshot_entry(files, root, *it);
+	}
+
+	return files;
+}
+
+static void watcher_thread(lyrics_watcher *watcher)
+{
+	os_set_thread_name("lyrics-watcher");
+
+	std::map<std::string, file_state> known = snapshot(watcher->folder, watcher->recursive);
+	std::set<std::string> pending;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(watcher->mutex);
+			watcher->cond.wait_for(lock, std::chrono::milliseconds(POLL_INTERVAL_MS),
+					       [watcher] { return watcher->stopping; });
+			if (watcher->stopping)
+				return;
+		}
+
+		std::map<std::string, file_state> current = snapshot(watcher->folder, watcher->recursive);
+		std::set<std::string> changed;
+
+		for (const auto &pair : current) {
+			auto it = known.find(pair.first);
+			if (it == known.end() || it->second != pair.second)
+				changed.insert(pair.first);
+		}
+		for (const auto &pair : known) {
+			if (!current.count(pair.first))
+				changed.insert(pair.first);
+		}
+		known = std::move(current);
+
+		// A poll with no new changes doubles as the debounce quiet period
+		if (changed.empty())
+			report(watcher, pending);
+		else
+			pending.insert(changed.begin(), changed.end());
+	}
+}
+
+static bool watcher_start(lyrics_watcher *watcher)
+{
+	watcher->thread = std::thread(watcher_thread, watcher);
+	return true;
+}
+
+static void watcher_stop(lyrics_watcher *watcher)
+{
+	{
+		std::lock_guard<std::mutex> lock(watcher->mutex);
+		watcher->stopping = true;
+	}
+	watcher->cond.notify_one();
+	watcher->thread.join();
+}
+#endif
+
+lyrics_watcher *lyrics_watcher_create(const std::string &folder, bool recursive, lyrics_watcher_changed_t changed,
+				      void *param)
+{
+	lyrics_watcher *watcher = new lyrics_watcher();
+	watcher->folder = folder;
+	watcher->recursive = recursive;
+	watcher->changed = changed;
+	watcher->param = param;
+
+	if (!watcher_start(watcher)) {
+		plugin_log(LOG_WARNING, "Failed to watch lyrics folder '%s'", folder.c_str());
+		delete watcher;
+		return nullptr;
+	}
+
+	return watcher;
+}
+
+void lyrics_watcher_destroy(lyrics_watcher *watcher)
+{
+	if (!watcher)
+		return;
+
+	watcher_stop(watcher);
+	delete watcher;
+}
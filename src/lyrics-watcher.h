@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Watches a directory, optionally including its subdirectories, for files being
+// added, removed or rewritten. Events are debounced so a burst of writes (an
+// editor saving, a sync client copying a batch of songs) is delivered as one
+// callback with the absolute paths of every file that changed. A subdirectory
+// that appears or disappears as a whole may be reported by its own path, and
+// the watched folder itself is reported when events were lost, meaning that
+// anything in it may have changed. The callback runs on the watcher thread.
+//
+// Linux uses inotify; other platforms fall back to polling the directory.
+typedef void (*lyrics_watcher_changed_t)(void *param, const std::vector<std::string> &paths);
+
+struct lyrics_watcher;
+
+lyrics_watcher *lyrics_watcher_create(const std::string &folder, bool recursive, lyrics_watcher_changed_t changed,
+				      void *param);
+void lyrics_watcher_destroy(lyrics_watcher *watcher);
@@ -0,0 +1,665 @@
+#include "libobs-stub.h"
+#include <util/platform.h>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// obs_data with the same semantics the plugin relies on: user values over
+// defaults, numbers readable as either int or double, reference counted
+// objects and arrays, and JSON in both directions
+
+enum value_type {
+	VALUE_NULL,
+	VALUE_STRING,
+	VALUE_INT,
+	VALUE_DOUBLE,
+	VALUE_BOOL,
+	VALUE_OBJECT,
+	VALUE_ARRAY,
+};
+
+struct data_value {
+	value_type type = VALUE_NULL;
+	std::string string;
+	long long integer = 0;
+	double number = 0.0;
+	obs_data_t *object = nullptr;
+	obs_data_array_t *array = nullptr;
+
+	data_value() = default;
+	data_value(const data_value &other) { *this = other; }
+	data_value &operator=(const data_value &other);
+	~data_value() { reset(); }
+	void reset();
+};
+
+struct obs_data {
+	std::atomic<long> refs{1};
+	std::map<std::string, data_value> values;
+	std::map<std::string, data_value> defaults;
+	std::string json; // last obs_data_get_json result
+};
+
+struct obs_data_array {
+	std::atomic<long> refs{1};
+	std::vector<obs_data_t *> items;
+};
+
+data_value &data_value::operator=(const data_value &other)
+{
+	if (this == &other)
+		return *this;
+
+	reset();
+	type = other.type;
+	string = other.string;
+	integer = other.integer;
+	number = other.number;
+	object = other.object;
+	array = other.array;
+	obs_data_addref(object);
+	obs_data_array_addref(array);
+	return *this;
+}
+
+void data_value::reset()
+{
+	obs_data_release(object);
+	obs_data_array_release(array);
+	object = nullptr;
+	array = nullptr;
+	type = VALUE_NULL;
+}
+
+obs_data_t *obs_data_create(void)
+{
+	return new obs_data();
+}
+
+void obs_data_addref(obs_data_t *data)
+{
+	if (data)
+		data->refs++;
+}
+
+void obs_data_release(obs_data_t *data)
+{
+	if (data && --data->refs == 0)
+		delete data;
+}
+
+obs_data_array_t *obs_data_array_create(void)
+{
+	return new obs_data_array();
+}
+
+void obs_data_array_addref(obs_data_array_t *array)
+{
+	if (array)
+		array->refs++;
+}
+
+void obs_data_array_release(obs_data_array_t *array)
+{
+	if (!array || --array->refs != 0)
+		return;
+	for (obs_data_t *item : array->items)
+		obs_data_release(item);
+	delete array;
+}
+
+size_t obs_data_array_count(obs_data_array_t *array)
+{
+	return array ? array->items.size() : 0;
+}
+
+obs_data_t *obs_data_array_item(obs_data_array_t *array, size_t idx)
+{
+	if (!array || idx >= array->items.size())
+		return nullptr;
+	obs_data_addref(array->items[idx]);
+	return array->items[idx];
+}
+
+size_t obs_data_array_push_back(obs_data_array_t *array, obs_data_t *obj)
+{
+	if (!array || !obj)
+		return 0;
+	obs_data_addref(obj);
+	array->items.push_back(obj);
+	return array->items.size() - 1;
+}
+
+// User value, or the default when there is none
+static const data_value *find_value(obs_data_t *data, const char *name)
+{
+	if (!data || !name)
+		return nullptr;
+	auto it = data->values.find(name);
+	if (it != data->values.end())
+		return &it->second;
+	it = data->defaults.find(name);
+	return it != data->defaults.end() ? &it->second : nullptr;
+}
+
+static data_value *set_value(obs_data_t *data, const char *name, value_type type, bool user)
+{
+	if (!data || !name)
+		return nullptr;
+	data_value &value = (user ? data->values : data->defaults)[name];
+	value.reset();
+	value.type = type;
+	return &value;
+}
+
+void obs_data_set_string(obs_data_t *data, const char *name, const char *val)
+{
+	if (data_value *value = set_value(data, name, VALUE_STRING, true))
+		value->string = val ? val : "";
+}
+
+void obs_data_set_int(obs_data_t *data, const char *name, long long val)
+{
+	if (data_value *value = set_value(data, name, VALUE_INT, true))
+		value->integer = val;
+}
+
+void obs_data_set_double(obs_data_t *data, const char *name, double val)
+{
+	if (data_value *value = set_value(data, name, VALUE_DOUBLE, true))
+		value->number = val;
+}
+
+void obs_data_set_bool(obs_data_t *data, const char *name, bool val)
+{
+	if (data_value *value = set_value(data, name, VALUE_BOOL, true))
+		value->integer = val;
+}
+
+void obs_data_set_obj(obs_data_t *data, const char *name, obs_data_t *obj)
+{
+	if (data_value *value = set_value(data, name, VALUE_OBJECT, true)) {
+		obs_data_addref(obj);
+		value->object = obj;
+	}
+}
+
+void obs_data_set_array(obs_data_t *data, const char *name, obs_data_array_t *array)
+{
+	if (data_value *value = set_value(data, name, VALUE_ARRAY, true)) {
+		obs_data_array_addref(array);
+		value->array = array;
+	}
+}
+
+void obs_data_set_default_string(obs_data_t *data, const char *name, const char *val)
+{
+	if (data_value *value = set_value(data, name, VALUE_STRING, false))
+		value->string = val ? val : "";
+}
+
+void obs_data_set_default_int(obs_data_t *data, const char *name, long long val)
+{
+	if (data_value *value = set_value(data, name, VALUE_INT, false))
+		value->integer = val;
+}
+
+void obs_data_set_default_double(obs_data_t *data, const char *name, double val)
+{
+	if (data_value *value = set_value(data, name, VALUE_DOUBLE, false))
+		value->number = val;
+}
+
+void obs_data_set_default_bool(obs_data_t *data, const char *name, bool val)
+{
+	if (data_value *value = set_value(data, name, VALUE_BOOL, false))
+		value->integer = val;
+}
+
+const char *obs_data_get_string(obs_data_t *data, const char *name)
+{
+	const data_value *value = find_value(data, name);
+	return value && value->type == VALUE_STRING ? value->string.c_str() : "";
+}
+
+long long obs_data_get_int(obs_data_t *data, const char *name)
+{
+	const data_value *value = find_value(data, name);
+	if (!value)
+		return 0;
+	if (value->type == VALUE_DOUBLE)
+		return (long long)value->number;
+	return value->type == VALUE_INT || value->type == VALUE_BOOL ? value->integer : 0;
+}
+
+double obs_data_get_double(obs_data_t *data, const char *name)
+{
+	const data_value *value = find_value(data, name);
+	if (!value)
+		return 0.0;
+	if (value->type == VALUE_INT)
+		return (double)value->integer;
+	return value->type == VALUE_DOUBLE ? value->number : 0.0;
+}
+
+bool obs_data_get_bool(obs_data_t *data, const char *name)
+{
+	const data_value *value = find_value(data, name);
+	return value && value->type == VALUE_BOOL && value->integer != 0;
+}
+
+obs_data_t *obs_data_get_obj(obs_data_t *data, const char *name)
+{
+	const data_value *value = find_value(data, name);
+	if (!value || value->type != VALUE_OBJECT)
+		return nullptr;
+	obs_data_addref(value->object);
+	return value->object;
+}
+
+obs_data_array_t *obs_data_get_array(obs_data_t *data, const char *name)
+{
+	const data_value *value = find_value(data, name);
+	if (!value || value->type != VALUE_ARRAY)
+		return nullptr;
+	obs_data_array_addref(value->array);
+	return value->array;
+}
+
+bool obs_data_has_user_value(obs_data_t *data, const char *name)
+{
+	return data && name && data->values.count(name) != 0;
+}
+
+// Copies the user values; objects and arrays are shared, as in libobs
+void obs_data_apply(obs_data_t *target, obs_data_t *apply_data)
+{
+	if (!target || !apply_data || target == apply_data)
+		return;
+	for (const auto &pair : apply_data->values)
+		target->values[pair.first] = pair.second;
+}
+
+// JSON output
+
+static void write_json(std::string &out, obs_data_t *data, int indent, int depth);
+
+static void write_string(std::string &out, const std::string &str)
+{
+	out += '"';
+	for (unsigned char c : str) {
+		switch (c) {
+		case '"':
+			out += "\\\"";
+			break;
+		case '\\':
+			out += "\\\\";
+			break;
+		case '\n':
+			out += "\\n";
+			break;
+		case '\r':
+			out += "\\r";
+			break;
+		case '\t':
+			out += "\\t";
+			break;
+		default:
+			if (c < 0x20) {
+				char escape[8];
+				snprintf(escape, sizeof(escape), "\\u%04x", c);
+				out += escape;
+			} else {
+				out += (char)c;
+			}
+		}
+	}
+	out += '"';
+}
+
+static void write_newline(std::string &out, int indent, int depth)
+{
+	if (!indent)
+		return;
+	out += '\n';
+	out.append((size_t)(indent * depth), ' ');
+}
+
+static void write_value(std::string &out, const data_value &value, int indent, int depth)
+{
+	char number[32];
+	switch (value.type) {
+	case VALUE_NULL:
+		out += "null";
+		break;
+	case VALUE_STRING:
+		write_string(out, value.string);
+		break;
+	case VALUE_INT:
+		out += std::to_string(value.integer);
+		break;
+	case VALUE_DOUBLE:
+		// Always with a fraction or exponent, so it reads back as a double
+		if (!std::isfinite(value.number)) {
+			out += "null";
+			break;
+		}
+		snprintf(number, sizeof(number), "%.17g", value.number);
+		out += number;
+		if (!strpbrk(number, ".eE"))
+			out += ".0";
+		break;
+	case VALUE_BOOL:
+		out += value.integer ? "true" : "false";
+		break;
+	case VALUE_OBJECT:
+		write_json(out, value.object, indent, depth);
+		break;
+	case VALUE_ARRAY: {
+		const std::vector<obs_data_t *> &items = value.array->items;
+		out += '[';
+		for (size_t i = 0; i < items.size(); i++) {
+			if (i)
+				out += ',';
+			write_newline(out, indent, depth + 1);
+			write_json(out, items[i], indent, depth + 1);
+		}
+		if (!items.empty())
+			write_newline(out, indent, depth);
+		out += ']';
+		break;
+	}
+	}
+}
+
+static void write_json(std::string &out, obs_data_t *data, int indent, int depth)
+{
+	out += '{';
+	bool first = true;
+	for (const auto &pair : data->values) {
+		if (!first)
+			out += ',';
+		first = false;
+		write_newline(out, indent, depth + 1);
+		write_string(out, pair.first);
+		out += indent ? ": " : ":";
+		write_value(out, pair.second, indent, depth + 1);
+	}
+	if (!first)
+		write_newline(out, indent, depth);
+	out += '}';
+}
+
+const char *obs_data_get_json(obs_data_t *data)
+{
+	if (!data)
+		return nullptr;
+	data->json.clear();
+	write_json(data->json, data, 0, 0);
+	return data->json.c_str();
+}
+
+const char *obs_data_get_json_pretty(obs_data_t *data)
+{
+	if (!data)
+		return nullptr;
+	data->json.clear();
+	write_json(data->json, data, 4, 0);
+	return data->json.c_str();
+}
+
+bool obs_data_save_json(obs_data_t *data, const char *file)
+{
+	if (!data || !file)
+		return false;
+
+	std::string json;
+	write_json(json, data, 4, 0);
+	json += '\n';
+
+	FILE *out = os_fopen(file, "wb");
+	if (!out)
+		return false;
+	const bool written = fwrite(json.data(), 1, json.size(), out) == json.size();
+	return fclose(out) == 0 && written;
+}
+
+// JSON input. Like libobs, arrays hold objects; anything else in them is dropped.
+
+struct json_parser {
+	const char *pos;
+	const char *end;
+	bool failed = false;
+
+	void skip_space()
+	{
+		while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+			pos++;
+	}
+
+	bool accept(char c)
+	{
+		skip_space();
+		if (pos < end && *pos == c) {
+			pos++;
+			return true;
+		}
+		return false;
+	}
+
+	bool accept_word(const char *word)
+	{
+		const size_t length = strlen(word);
+		if ((size_t)(end - pos) < length || strncmp(pos, word, length) != 0)
+			return false;
+		pos += length;
+		return true;
+	}
+
+	static void append_utf8(std::string &out, uint32_t codepoint)
+	{
+		if (codepoint < 0x80) {
+			out += (char)codepoint;
+		} else if (codepoint < 0x800) {
+			out += (char)(0xC0 | (codepoint >> 6));
+			out += (char)(0x80 | (codepoint & 0x3F));
+		} else if (codepoint < 0x10000) {
+			out += (char)(0xE0 | (codepoint >> 12));
+			out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+			out += (char)(0x80 | (codepoint & 0x3F));
+		} else {
+			out += (char)(0xF0 | (codepoint >> 18));
+			out += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+			out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+			out += (char)(0x80 | (codepoint & 0x3F));
+		}
+	}
+
+	bool parse_hex(uint32_t *out)
+	{
+		if (end - pos < 4)
+			return false;
+		char digits[5] = {pos[0], pos[1], pos[2], pos[3], 0};
+		char *digits_end;
+		*out = (uint32_t)strtoul(digits, &digits_end, 16);
+		pos += 4;
+		return digits_end == digits + 4;
+	}
+
+	bool parse_string(std::string &out)
+	{
+		if (!accept('"'))
+			return false;
+		while (pos < end && *pos != '"') {
+			if (*pos != '\\') {
+				out += *pos++;
+				continue;
+			}
+			if (++pos >= end)
+				return false;
+			const char escape = *pos++;
+			uint32_t codepoint;
+			switch (escape) {
+			case 'n':
+				out += '\n';
+				break;
+			case 'r':
+				out += '\r';
+				break;
+			case 't':
+				out += '\t';
+				break;
+			case 'b':
+				out += '\b';
+				break;
+			case 'f':
+				out += '\f';
+				break;
+			case 'u':
+				if (!parse_hex(&codepoint))
+					return false;
+				if (codepoint >= 0xD800 && codepoint < 0xDC00 && end - pos >= 6 && pos[0] == '\\' &&
+				    pos[1] == 'u') {
+					pos += 2;
+					uint32_t low;
+					if (!parse_hex(&low))
+						return false;
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				append_utf8(out, codepoint);
+				break;
+			default:
+				out += escape;
+			}
+		}
+		return pos++ < end;
+	}
+
+	bool parse_value(data_value &value)
+	{
+		skip_space();
+		if (pos >= end)
+			return false;
+
+		if (*pos == '"') {
+			value.type = VALUE_STRING;
+			return parse_string(value.string);
+		}
+		if (*pos == '{') {
+			value.type = VALUE_OBJECT;
+			value.object = parse_object();
+			return value.object != nullptr;
+		}
+		if (*pos == '[') {
+			value.type = VALUE_ARRAY;
+			value.array = parse_array();
+			return value.array != nullptr;
+		}
+		if (accept_word("true") || accept_word("false")) {
+			value.type = VALUE_BOOL;
+			value.integer = pos[-1] == 'e' && pos[-2] == 'u';
+			return true;
+		}
+		if (accept_word("null")) {
+			value.type = VALUE_NULL;
+			return true;
+		}
+
+		const char *start = pos;
+		while (pos < end && strchr("+-0123456789.eE", *pos))
+			pos++;
+		if (pos == start)
+			return false;
+		const std::string number(start, pos);
+		if (number.find_first_of(".eE") != std::string::npos) {
+			value.type = VALUE_DOUBLE;
+			value.number = strtod(number.c_str(), nullptr);
+		} else {
+			value.type = VALUE_INT;
+			value.integer = strtoll(number.c_str(), nullptr, 10);
+		}
+		return true;
+	}
+
+	obs_data_array_t *parse_array()
+	{
+		if (!accept('['))
+			return nullptr;
+		obs_data_array_t *array = obs_data_array_create();
+		if (accept(']'))
+			return array;
+		do {
+			data_value item;
+			if (!parse_value(item)) {
+				obs_data_array_release(array);
+				return nullptr;
+			}
+			if (item.type == VALUE_OBJECT)
+				obs_data_array_push_back(array, item.object);
+		} while (accept(','));
+		if (!accept(']')) {
+			obs_data_array_release(array);
+			return nullptr;
+		}
+		return array;
+	}
+
+	obs_data_t *parse_object()
+	{
+		if (!accept('{'))
+			return nullptr;
+		obs_data_t *data = obs_data_create();
+		if (accept('}'))
+			return data;
+		do {
+			std::string name;
+			data_value value;
+			if (!parse_string(name) || !accept(':') || !parse_value(value)) {
+				obs_data_release(data);
+				return nullptr;
+			}
+			data->values[name] = value;
+		} while (accept(','));
+		if (!accept('}')) {
+			obs_data_release(data);
+			return nullptr;
+		}
+		return data;
+	}
+};
+
+obs_data_t *obs_data_create_from_json(const char *json_string)
+{
+	if (!json_string)
+		return nullptr;
+
+	json_parser parser{json_string, json_string + strlen(json_string)};
+	obs_data_t *data = parser.parse_object();
+	if (!data)
+		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_json] Failed reading json string");
+	return data;
+}
+
+obs_data_t *obs_data_create_from_json_file(const char *json_file)
+{
+	FILE *file = json_file ? os_fopen(json_file, "rb") : nullptr;
+	if (!file)
+		return nullptr;
+
+	std::string json;
+	char buffer[65536];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		json.append(buffer, read);
+	fclose(file);
+
+	// Files saved by OBS on Windows may start with a UTF-8 BOM
+	if (json.compare(0, 3, "\xEF\xBB\xBF") == 0)
+		json.erase(0, 3);
+	return obs_data_create_from_json(json.c_str());
+}
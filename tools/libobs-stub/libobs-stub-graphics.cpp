@@ -0,0 +1,353 @@
+#include "libobs-stub.h"
+#include <graphics/graphics.h>
+#include <graphics/image-file.h>
+#include <util/platform.h>
+#include <cstring>
+
+// Graphics without a device. Objects are placeholders that remember what the
+// plugin needs to read back (vertex data, texture sizes); drawing does nothing.
+
+struct gs_texture {
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+struct gs_texture_render {
+	gs_texture texture;
+	bool rendered = false;
+};
+
+struct gs_effect_param {
+	int unused = 0;
+};
+
+struct gs_effect_technique {
+	int unused = 0;
+};
+
+struct gs_effect {
+	gs_effect_param param;
+	gs_effect_technique technique;
+	bool looping = false;
+};
+
+struct gs_vertex_buffer {
+	gs_vb_data *data = nullptr;
+};
+
+// Room for every obs_base_effect value
+static gs_effect base_effects[32];
+#define NUM_BASE_EFFECTS (sizeof(base_effects) / sizeof(base_effects[0]))
+
+void obs_enter_graphics(void) {}
+
+void obs_leave_graphics(void) {}
+
+gs_effect_t *obs_get_base_effect(enum obs_base_effect effect)
+{
+	if ((size_t)effect >= NUM_BASE_EFFECTS)
+		return nullptr;
+	return &base_effects[effect];
+}
+
+// Only files that exist load, so missing shaders fail as they would in OBS
+gs_effect_t *gs_effect_create_from_file(const char *file, char **error_string)
+{
+	if (error_string)
+		*error_string = nullptr;
+	if (!file || !os_file_exists(file)) {
+		if (error_string)
+			*error_string = bstrdup("file not found");
+		return nullptr;
+	}
+	return new gs_effect();
+}
+
+void gs_effect_destroy(gs_effect_t *effect)
+{
+	if (effect && (effect < base_effects || effect >= base_effects + NUM_BASE_EFFECTS))
+		delete effect;
+}
+
+gs_technique_t *gs_effect_get_technique(const gs_effect_t *effect, const char *name)
+{
+	UNUSED_PARAMETER(name);
+	return effect ? const_cast<gs_technique_t *>(&effect->technique) : nullptr;
+}
+
+gs_eparam_t *gs_effect_get_param_by_name(const gs_effect_t *effect, const char *name)
+{
+	UNUSED_PARAMETER(name);
+	return effect ? const_cast<gs_eparam_t *>(&effect->param) : nullptr;
+}
+
+// One pass per loop, as with the single-pass effects the plugin uses
+bool gs_effect_loop(gs_effect_t *effect, const char *name)
+{
+	UNUSED_PARAMETER(name);
+	if (!effect)
+		return false;
+	effect->looping = !effect->looping;
+	return effect->looping;
+}
+
+size_t gs_technique_begin(gs_technique_t *technique)
+{
+	return technique ? 1 : 0;
+}
+
+void gs_technique_end(gs_technique_t *technique)
+{
+	UNUSED_PARAMETER(technique);
+}
+
+bool gs_technique_begin_pass(gs_technique_t *technique, size_t pass)
+{
+	return technique && pass == 0;
+}
+
+void gs_technique_end_pass(gs_technique_t *technique)
+{
+	UNUSED_PARAMETER(technique);
+}
+
+void gs_effect_set_float(gs_eparam_t *param, float val)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_vec2(gs_eparam_t *param, const struct vec2 *val)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_vec4(gs_eparam_t *param, const struct vec4 *val)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_texture(gs_eparam_t *param, gs_texture_t *val)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_texture_srgb(gs_eparam_t *param, gs_texture_t *val)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(val);
+}
+
+gs_texture_t *gs_texture_create(uint32_t width, uint32_t height, enum gs_color_format color_format, uint32_t levels,
+				const uint8_t **data, uint32_t flags)
+{
+	UNUSED_PARAMETER(color_format);
+	UNUSED_PARAMETER(levels);
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(flags);
+	gs_texture_t *texture = new gs_texture();
+	texture->width = width;
+	texture->height = height;
+	return texture;
+}
+
+void gs_texture_destroy(gs_texture_t *tex)
+{
+	delete tex;
+}
+
+uint32_t gs_texture_get_width(const gs_texture_t *tex)
+{
+	return tex ? tex->width : 0;
+}
+
+uint32_t gs_texture_get_height(const gs_texture_t *tex)
+{
+	return tex ? tex->height : 0;
+}
+
+void gs_texture_set_image(gs_texture_t *tex, const uint8_t *data, uint32_t linesize, bool invert)
+{
+	UNUSED_PARAMETER(tex);
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(linesize);
+	UNUSED_PARAMETER(invert);
+}
+
+gs_texrender_t *gs_texrender_create(enum gs_color_format format, enum gs_zstencil_format zsformat)
+{
+	UNUSED_PARAMETER(format);
+	UNUSED_PARAMETER(zsformat);
+	return new gs_texture_render();
+}
+
+void gs_texrender_destroy(gs_texrender_t *texrender)
+{
+	delete texrender;
+}
+
+// Like libobs, a texrender is drawn to once until it is reset
+bool gs_texrender_begin(gs_texrender_t *texrender, uint32_t cx, uint32_t cy)
+{
+	if (!texrender || texrender->rendered || !cx || !cy)
+		return false;
+	texrender->texture.width = cx;
+	texrender->texture.height = cy;
+	return true;
+}
+
+void gs_texrender_end(gs_texrender_t *texrender)
+{
+	if (texrender)
+		texrender->rendered = true;
+}
+
+void gs_texrender_reset(gs_texrender_t *texrender)
+{
+	if (texrender)
+		texrender->rendered = false;
+}
+
+gs_texture_t *gs_texrender_get_texture(const gs_texrender_t *texrender)
+{
+	return texrender ? const_cast<gs_texture_t *>(&texrender->texture) : nullptr;
+}
+
+gs_vertbuffer_t *gs_vertexbuffer_create(struct gs_vb_data *data, uint32_t flags)
+{
+	UNUSED_PARAMETER(flags);
+	gs_vertbuffer_t *buffer = new gs_vertex_buffer();
+	buffer->data = data;
+	return buffer;
+}
+
+void gs_vertexbuffer_destroy(gs_vertbuffer_t *vertbuffer)
+{
+	if (!vertbuffer)
+		return;
+	gs_vbdata_destroy(vertbuffer->data);
+	delete vertbuffer;
+}
+
+void gs_vertexbuffer_flush(gs_vertbuffer_t *vertbuffer)
+{
+	UNUSED_PARAMETER(vertbuffer);
+}
+
+struct gs_vb_data *gs_vertexbuffer_get_data(const gs_vertbuffer_t *vertbuffer)
+{
+	return vertbuffer ? vertbuffer->data : nullptr;
+}
+
+void gs_load_vertexbuffer(gs_vertbuffer_t *vertbuffer)
+{
+	UNUSED_PARAMETER(vertbuffer);
+}
+
+void gs_load_indexbuffer(gs_indexbuffer_t *indexbuffer)
+{
+	UNUSED_PARAMETER(indexbuffer);
+}
+
+void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert, uint32_t num_verts)
+{
+	UNUSED_PARAMETER(draw_mode);
+	UNUSED_PARAMETER(start_vert);
+	UNUSED_PARAMETER(num_verts);
+}
+
+void gs_draw_sprite(gs_texture_t *tex, uint32_t flip, uint32_t width, uint32_t height)
+{
+	UNUSED_PARAMETER(tex);
+	UNUSED_PARAMETER(flip);
+	UNUSED_PARAMETER(width);
+	UNUSED_PARAMETER(height);
+}
+
+void gs_matrix_push(void) {}
+
+void gs_matrix_pop(void) {}
+
+void gs_matrix_translate3f(float x, float y, float z)
+{
+	UNUSED_PARAMETER(x);
+	UNUSED_PARAMETER(y);
+	UNUSED_PARAMETER(z);
+}
+
+void gs_matrix_scale3f(float x, float y, float z)
+{
+	UNUSED_PARAMETER(x);
+	UNUSED_PARAMETER(y);
+	UNUSED_PARAMETER(z);
+}
+
+void gs_ortho(float left, float right, float top, float bottom, float znear, float zfar)
+{
+	UNUSED_PARAMETER(left);
+	UNUSED_PARAMETER(right);
+	UNUSED_PARAMETER(top);
+	UNUSED_PARAMETER(bottom);
+	UNUSED_PARAMETER(znear);
+	UNUSED_PARAMETER(zfar);
+}
+
+void gs_clear(uint32_t clear_flags, const struct vec4 *color, float depth, uint8_t stencil)
+{
+	UNUSED_PARAMETER(clear_flags);
+	UNUSED_PARAMETER(color);
+	UNUSED_PARAMETER(depth);
+	UNUSED_PARAMETER(stencil);
+}
+
+void gs_blend_state_push(void) {}
+
+void gs_blend_state_pop(void) {}
+
+void gs_blend_function(enum gs_blend_type src, enum gs_blend_type dest)
+{
+	UNUSED_PARAMETER(src);
+	UNUSED_PARAMETER(dest);
+}
+
+void gs_blend_function_separate(enum gs_blend_type src_c, enum gs_blend_type dest_c, enum gs_blend_type src_a,
+				enum gs_blend_type dest_a)
+{
+	UNUSED_PARAMETER(src_c);
+	UNUSED_PARAMETER(dest_c);
+	UNUSED_PARAMETER(src_a);
+	UNUSED_PARAMETER(dest_a);
+}
+
+static bool framebuffer_srgb = false;
+
+bool gs_framebuffer_srgb_enabled(void)
+{
+	return framebuffer_srgb;
+}
+
+void gs_enable_framebuffer_srgb(bool enable)
+{
+	framebuffer_srgb = enable;
+}
+
+// Images are never decoded; the plugin sees them as failed to load
+void gs_image_file4_init(gs_image_file4_t *image, const char *file, enum gs_image_alpha_mode alpha_mode)
+{
+	UNUSED_PARAMETER(file);
+	UNUSED_PARAMETER(alpha_mode);
+	memset(image, 0, sizeof(*image));
+}
+
+void gs_image_file4_free(gs_image_file4_t *image)
+{
+	UNUSED_PARAMETER(image);
+}
+
+void gs_image_file4_init_texture(gs_image_file4_t *image)
+{
+	UNUSED_PARAMETER(image);
+}
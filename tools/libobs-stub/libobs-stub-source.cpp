@@ -0,0 +1,606 @@
+#include "libobs-stub.h"
+#include <callback/calldata.h>
+#include <callback/proc.h>
+#include <callback/signal.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Sources, calldata, signals and procs. Registered source types are run
+// through their obs_source_info callbacks; sources of any other type (the
+// text and media sources the plugin nests) exist but draw nothing.
+
+// Calldata, stored as libobs does: [name size][name][data size][data] entries
+// ending with a zero name size
+
+static bool calldata_find(const calldata_t *data, const char *name, uint8_t **pos)
+{
+	if (!data->stack || !data->size)
+		return false;
+
+	uint8_t *cur = data->stack;
+	size_t name_size;
+	while (memcpy(&name_size, cur, sizeof(size_t)), name_size != 0) {
+		const char *cur_name = (const char *)(cur + sizeof(size_t));
+		if (strcmp(cur_name, name) == 0) {
+			*pos = cur;
+			return true;
+		}
+		cur += sizeof(size_t) + name_size;
+		size_t data_size;
+		memcpy(&data_size, cur, sizeof(size_t));
+		cur += sizeof(size_t) + data_size;
+	}
+	*pos = cur;
+	return false;
+}
+
+static bool calldata_ensure(calldata_t *data, size_t size)
+{
+	if (size <= data->capacity)
+		return true;
+	if (data->fixed) {
+		blog(LOG_ERROR, "Tried to go above fixed calldata stack size!");
+		return false;
+	}
+
+	const size_t capacity = std::max(size, data->capacity * 2);
+	data->stack = (uint8_t *)brealloc(data->stack, capacity);
+	data->capacity = capacity;
+	return true;
+}
+
+bool calldata_get_data(const calldata_t *data, const char *name, void *out, size_t size)
+{
+	uint8_t *pos;
+	if (!data || !name || !calldata_find(data, name, &pos))
+		return false;
+
+	size_t name_size, data_size;
+	memcpy(&name_size, pos, sizeof(size_t));
+	pos += sizeof(size_t) + name_size;
+	memcpy(&data_size, pos, sizeof(size_t));
+	if (data_size != size)
+		return false;
+
+	memcpy(out, pos + sizeof(size_t), size);
+	return true;
+}
+
+bool calldata_get_string(const calldata_t *data, const char *name, const char **str)
+{
+	uint8_t *pos;
+	if (!data || !name || !calldata_find(data, name, &pos))
+		return false;
+
+	size_t name_size, data_size;
+	memcpy(&name_size, pos, sizeof(size_t));
+	pos += sizeof(size_t) + name_size;
+	memcpy(&data_size, pos, sizeof(size_t));
+	*str = data_size ? (const char *)(pos + sizeof(size_t)) : nullptr;
+	return true;
+}
+
+void calldata_set_data(calldata_t *data, const char *name, const void *in, size_t size)
+{
+	if (!data || !name || !*name)
+		return;
+
+	// calldata_t zeroed without calldata_init gets its stack on first use
+	if (!data->stack) {
+		if (!calldata_ensure(data, sizeof(size_t)))
+			return;
+		memset(data->stack, 0, sizeof(size_t));
+		data->size = sizeof(size_t);
+	}
+
+	uint8_t *pos;
+	if (calldata_find(data, name, &pos)) {
+		size_t name_size, old_size;
+		memcpy(&name_size, pos, sizeof(size_t));
+		uint8_t *size_pos = pos + sizeof(size_t) + name_size;
+		memcpy(&old_size, size_pos, sizeof(size_t));
+
+		const size_t offset = (size_t)(size_pos - data->stack);
+		const size_t tail = data->size - (offset + sizeof(size_t) + old_size);
+		if (!calldata_ensure(data, data->size - old_size + size))
+			return;
+
+		size_pos = data->stack + offset;
+		memmove(size_pos + sizeof(size_t) + size, size_pos + sizeof(size_t) + old_size, tail);
+		memcpy(size_pos, &size, sizeof(size_t));
+		if (size)
+			memcpy(size_pos + sizeof(size_t), in, size);
+		data->size = data->size - old_size + size;
+		return;
+	}
+
+	const size_t name_size = strlen(name) + 1;
+	const size_t offset = (size_t)(pos - data->stack);
+	if (!calldata_ensure(data, data->size + 2 * sizeof(size_t) + name_size + size))
+		return;
+
+	pos = data->stack + offset;
+	memcpy(pos, &name_size, sizeof(size_t));
+	pos += sizeof(size_t);
+	memcpy(pos, name, name_size);
+	pos += name_size;
+	memcpy(pos, &size, sizeof(size_t));
+	pos += sizeof(size_t);
+	if (size)
+		memcpy(pos, in, size);
+	pos += size;
+	memset(pos, 0, sizeof(size_t));
+	data->size += 2 * sizeof(size_t) + name_size + size;
+}
+
+// Declarations look like "void name(in int song, out string result)"; only
+// the name matters here
+static std::string decl_name(const char *decl)
+{
+	const char *paren = strchr(decl, '(');
+	const char *end = paren ? paren : decl + strlen(decl);
+	const char *start = end;
+	while (start > decl && start[-1] != ' ')
+		start--;
+	return std::string(start, end);
+}
+
+// Signal handlers
+
+struct signal_connection {
+	signal_callback_t callback;
+	void *data;
+};
+
+struct signal_handler {
+	std::mutex mutex;
+	std::map<std::string, std::vector<signal_connection>> signals;
+};
+
+bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
+{
+	const std::string name = decl_name(signal_decl);
+	std::lock_guard<std::mutex> lock(handler->mutex);
+	if (handler->signals.count(name)) {
+		blog(LOG_WARNING, "Signal declaration '%s' exists", name.c_str());
+		return false;
+	}
+	handler->signals[name];
+	return true;
+}
+
+void signal_handler_connect(signal_handler_t *handler, const char *signal, signal_callback_t callback, void *data)
+{
+	std::lock_guard<std::mutex> lock(handler->mutex);
+	auto it = handler->signals.find(signal);
+	if (it == handler->signals.end()) {
+		blog(LOG_WARNING, "signal_handler_connect: signal '%s' not found", signal);
+		return;
+	}
+	it->second.push_back({callback, data});
+}
+
+void signal_handler_disconnect(signal_handler_t *handler, const char *signal, signal_callback_t callback, void *data)
+{
+	std::lock_guard<std::mutex> lock(handler->mutex);
+	auto it = handler->signals.find(signal);
+	if (it == handler->signals.end())
+		return;
+
+	std::vector<signal_connection> &connections = it->second;
+	connections.erase(std::remove_if(connections.begin(), connections.end(),
+					 [&](const signal_connection &connection) {
+						 return connection.callback == callback && connection.data == data;
+					 }),
+			  connections.end());
+}
+
+void signal_handler_signal(signal_handler_t *handler, const char *signal, calldata_t *params)
+{
+	std::vector<signal_connection> connections;
+	{
+		std::lock_guard<std::mutex> lock(handler->mutex);
+		auto it = handler->signals.find(signal);
+		if (it == handler->signals.end())
+			return;
+		connections = it->second;
+	}
+
+	for (const signal_connection &connection : connections)
+		connection.callback(connection.data, params);
+}
+
+// Proc handlers
+
+struct proc_info {
+	proc_handler_proc_t proc;
+	void *data;
+};
+
+struct proc_handler {
+	std::mutex mutex;
+	std::map<std::string, proc_info> procs;
+};
+
+void proc_handler_add(proc_handler_t *handler, const char *decl_string, proc_handler_proc_t proc, void *data)
+{
+	std::lock_guard<std::mutex> lock(handler->mutex);
+	handler->procs[decl_name(decl_string)] = {proc, data};
+}
+
+bool proc_handler_call(proc_handler_t *handler, const char *name, calldata_t *params)
+{
+	proc_info info;
+	{
+		std::lock_guard<std::mutex> lock(handler->mutex);
+		auto it = handler->procs.find(name);
+		if (it == handler->procs.end())
+			return false;
+		info = it->second;
+	}
+
+	info.proc(info.data, params);
+	return true;
+}
+
+// Sources
+
+struct obs_source {
+	std::atomic<long> refs{1};
+	std::string id;
+	std::string name;
+	const obs_source_info *info = nullptr;
+	void *data = nullptr;
+	obs_data_t *settings = nullptr;
+	// Held while settings are applied or handed to update, which may happen
+	// on different threads
+	std::mutex settings_mutex;
+	signal_handler_t signals;
+	proc_handler_t procs;
+	std::atomic<long> deferred_updates{0};
+	int showing = 0;
+	bool muted = false;
+};
+
+static std::mutex registry_mutex;
+static std::map<std::string, obs_source_info> registry;
+static std::atomic<obs_hotkey_id> next_hotkey{1};
+
+void obs_register_source_s(const struct obs_source_info *info, size_t size)
+{
+	obs_source_info copy = {};
+	memcpy(&copy, info, std::min(size, sizeof(copy)));
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	registry[info->id] = copy;
+}
+
+static const obs_source_info *find_source_info(const char *id)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	auto it = registry.find(id);
+	return it != registry.end() ? &it->second : nullptr;
+}
+
+obs_source_t *obs_source_create_private(const char *id, const char *name, obs_data_t *settings)
+{
+	obs_source_t *source = new obs_source();
+	source->id = id;
+	source->name = name ? name : "";
+	source->info = find_source_info(id);
+	source->settings = obs_data_create();
+	if (source->info && source->info->get_defaults)
+		source->info->get_defaults(source->settings);
+	obs_data_apply(source->settings, settings);
+
+	signal_handler_add(&source->signals, "void destroy(ptr source)");
+	signal_handler_add(&source->signals, "void update(ptr source)");
+
+	if (source->info && source->info->create) {
+		source->data = source->info->create(source->settings, source);
+		if (!source->data)
+			blog(LOG_ERROR, "Failed to create source '%s'!", source->name.c_str());
+	}
+	return source;
+}
+
+obs_source_t *obs_source_get_ref(obs_source_t *source)
+{
+	if (source)
+		source->refs++;
+	return source;
+}
+
+void obs_source_release(obs_source_t *source)
+{
+	if (!source || --source->refs != 0)
+		return;
+
+	uint8_t stack[128];
+	calldata_t cd;
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_ptr(&cd, "source", source);
+	signal_handler_signal(&source->signals, "destroy", &cd);
+
+	if (source->data && source->info->destroy)
+		source->info->destroy(source->data);
+	obs_data_release(source->settings);
+	delete source;
+}
+
+void *obs_obj_get_data(void *obj)
+{
+	return obj ? ((obs_source_t *)obj)->data : nullptr;
+}
+
+static void call_update(obs_source_t *source)
+{
+	std::lock_guard<std::mutex> lock(source->settings_mutex);
+	if (source->data && source->info->update)
+		source->info->update(source->data, source->settings);
+}
+
+// Like libobs, video sources take updates at their next tick
+void obs_source_update(obs_source_t *source, obs_data_t *settings)
+{
+	if (!source)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(source->settings_mutex);
+		obs_data_apply(source->settings, settings);
+	}
+	if (source->info && (source->info->output_flags & OBS_SOURCE_VIDEO))
+		source->deferred_updates++;
+	else
+		call_update(source);
+}
+
+void obs_source_inc_showing(obs_source_t *source)
+{
+	if (source && source->showing++ == 0 && source->data && source->info->show)
+		source->info->show(source->data);
+}
+
+void obs_source_dec_showing(obs_source_t *source)
+{
+	if (source && source->showing > 0 && --source->showing == 0 && source->data && source->info->hide)
+		source->info->hide(source->data);
+}
+
+bool obs_source_showing(const obs_source_t *source)
+{
+	return source && source->showing > 0;
+}
+
+void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	if (source && source->deferred_updates.exchange(0) > 0)
+		call_update(source);
+	if (source && source->data && source->info->video_tick)
+		source->info->video_tick(source->data, seconds);
+}
+
+void obs_source_video_render(obs_source_t *source)
+{
+	if (source && source->data && source->info->video_render)
+		source->info->video_render(source->data, nullptr);
+}
+
+uint32_t obs_source_get_width(obs_source_t *source)
+{
+	if (source && source->data && source->info->get_width)
+		return source->info->get_width(source->data);
+	return 0;
+}
+
+uint32_t obs_source_get_height(obs_source_t *source)
+{
+	if (source && source->data && source->info->get_height)
+		return source->info->get_height(source->data);
+	return 0;
+}
+
+void obs_source_set_muted(obs_source_t *source, bool muted)
+{
+	if (source)
+		source->muted = muted;
+}
+
+obs_data_t *obs_source_get_settings(const obs_source_t *source)
+{
+	if (!source)
+		return nullptr;
+	obs_data_addref(source->settings);
+	return source->settings;
+}
+
+const char *obs_source_get_name(const obs_source_t *source)
+{
+	return source ? source->name.c_str() : nullptr;
+}
+
+proc_handler_t *obs_source_get_proc_handler(const obs_source_t *source)
+{
+	return source ? const_cast<proc_handler_t *>(&source->procs) : nullptr;
+}
+
+signal_handler_t *obs_source_get_signal_handler(const obs_source_t *source)
+{
+	return source ? const_cast<signal_handler_t *>(&source->signals) : nullptr;
+}
+
+// Hotkeys are registered but never pressed
+obs_hotkey_id obs_hotkey_register_source(obs_source_t *source, const char *name, const char *description,
+					 obs_hotkey_func func, void *data)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	UNUSED_PARAMETER(func);
+	UNUSED_PARAMETER(data);
+	return next_hotkey++;
+}
+
+// Properties only exist for the settings dialog, which the tools never show
+
+obs_properties_t *obs_properties_create(void)
+{
+	return nullptr;
+}
+
+void obs_properties_destroy(obs_properties_t *props)
+{
+	UNUSED_PARAMETER(props);
+}
+
+obs_property_t *obs_properties_get(obs_properties_t *props, const char *property)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(property);
+	return nullptr;
+}
+
+void obs_properties_apply_settings(obs_properties_t *props, obs_data_t *settings)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(settings);
+}
+
+obs_property_t *obs_properties_add_bool(obs_properties_t *props, const char *name, const char *description)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_int(obs_properties_t *props, const char *name, const char *description, int min,
+				       int max, int step)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	UNUSED_PARAMETER(min);
+	UNUSED_PARAMETER(max);
+	UNUSED_PARAMETER(step);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_text(obs_properties_t *props, const char *name, const char *description,
+					enum obs_text_type type)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	UNUSED_PARAMETER(type);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_path(obs_properties_t *props, const char *name, const char *description,
+					enum obs_path_type type, const char *filter, const char *default_path)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	UNUSED_PARAMETER(type);
+	UNUSED_PARAMETER(filter);
+	UNUSED_PARAMETER(default_path);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_list(obs_properties_t *props, const char *name, const char *description,
+					enum obs_combo_type type, enum obs_combo_format format)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	UNUSED_PARAMETER(type);
+	UNUSED_PARAMETER(format);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_color(obs_properties_t *props, const char *name, const char *description)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_color_alpha(obs_properties_t *props, const char *name, const char *description)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_font(obs_properties_t *props, const char *name, const char *description)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_editable_list(obs_properties_t *props, const char *name, const char *description,
+						 enum obs_editable_list_type type, const char *filter,
+						 const char *default_path)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	UNUSED_PARAMETER(type);
+	UNUSED_PARAMETER(filter);
+	UNUSED_PARAMETER(default_path);
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_group(obs_properties_t *props, const char *name, const char *description,
+					 enum obs_group_type type, obs_properties_t *group)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(description);
+	UNUSED_PARAMETER(type);
+	UNUSED_PARAMETER(group);
+	return nullptr;
+}
+
+void obs_property_set_visible(obs_property_t *p, bool visible)
+{
+	UNUSED_PARAMETER(p);
+	UNUSED_PARAMETER(visible);
+}
+
+void obs_property_set_modified_callback(obs_property_t *p, obs_property_modified_t modified)
+{
+	UNUSED_PARAMETER(p);
+	UNUSED_PARAMETER(modified);
+}
+
+void obs_property_int_set_suffix(obs_property_t *p, const char *suffix)
+{
+	UNUSED_PARAMETER(p);
+	UNUSED_PARAMETER(suffix);
+}
+
+void obs_property_set_long_description(obs_property_t *p, const char *long_description)
+{
+	UNUSED_PARAMETER(p);
+	UNUSED_PARAMETER(long_description);
+}
+
+size_t obs_property_list_add_int(obs_property_t *p, const char *name, long long val)
+{
+	UNUSED_PARAMETER(p);
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(val);
+	return 0;
+}
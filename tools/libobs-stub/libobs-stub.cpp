@@ -0,0 +1,302 @@
+#include "libobs-stub.h"
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/profiler.h>
+#include <util/threading.h>
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <pthread.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+static std::string data_path = ".";
+static std::string config_path = ".";
+static std::atomic<int> log_level{LOG_INFO};
+static std::mutex log_mutex;
+static std::atomic<long> allocations{0};
+static std::atomic<long> allocations_total{0};
+
+void obs_stub_init(const char *data, const char *config)
+{
+	data_path = data ? data : ".";
+	config_path = config ? config : ".";
+}
+
+void obs_stub_set_log_level(int level)
+{
+	log_level = level;
+}
+
+// Memory, counted like libobs so bnum_allocs shows leaks, plus a running
+// total of allocations for allocation rates
+
+void *bmalloc(size_t size)
+{
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr) {
+		fprintf(stderr, "Out of memory while allocating %zu bytes\n", size);
+		abort();
+	}
+	allocations++;
+	allocations_total++;
+	return ptr;
+}
+
+void *brealloc(void *ptr, size_t size)
+{
+	if (!ptr)
+		return bmalloc(size);
+
+	ptr = realloc(ptr, size ? size : 1);
+	if (!ptr) {
+		fprintf(stderr, "Out of memory while reallocating %zu bytes\n", size);
+		abort();
+	}
+	allocations_total++;
+	return ptr;
+}
+
+void bfree(void *ptr)
+{
+	if (!ptr)
+		return;
+	allocations--;
+	free(ptr);
+}
+
+int base_get_alignment(void)
+{
+	return (int)alignof(std::max_align_t);
+}
+
+long bnum_allocs(void)
+{
+	return allocations;
+}
+
+long obs_stub_total_allocs(void)
+{
+	return allocations_total;
+}
+
+void *bmemdup(const void *ptr, size_t size)
+{
+	void *out = bmalloc(size);
+	if (size)
+		memcpy(out, ptr, size);
+	return out;
+}
+
+// Logging, to stderr so reports on stdout stay machine-readable
+
+void blogva(int level, const char *format, va_list args)
+{
+	if (level > log_level)
+		return;
+
+	const char *name = level <= LOG_ERROR     ? "error"
+			   : level <= LOG_WARNING ? "warning"
+			   : level <= LOG_INFO    ? "info"
+						  : "debug";
+
+	std::lock_guard<std::mutex> lock(log_mutex);
+	fprintf(stderr, "%s: ", name);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+}
+
+void blog(int level, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	blogva(level, format, args);
+	va_end(args);
+}
+
+// Platform helpers. Paths are UTF-8 like everywhere in libobs.
+
+static std::filesystem::path to_path(const char *path)
+{
+	return std::filesystem::u8path(path);
+}
+
+uint64_t os_gettime_ns(void)
+{
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+void os_sleep_ms(uint32_t duration)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(duration));
+}
+
+bool os_sleepto_ns(uint64_t time_target)
+{
+	const uint64_t now = os_gettime_ns();
+	if (time_target <= now)
+		return false;
+
+	std::this_thread::sleep_for(std::chrono::nanoseconds(time_target - now));
+	return true;
+}
+
+FILE *os_fopen(const char *path, const char *mode)
+{
+#ifdef _WIN32
+	const std::wstring wide_mode(mode, mode + strlen(mode));
+	return _wfopen(to_path(path).c_str(), wide_mode.c_str());
+#else
+	return fopen(path, mode);
+#endif
+}
+
+int os_mkdirs(const char *path)
+{
+	std::error_code error;
+	if (std::filesystem::is_directory(to_path(path), error))
+		return MKDIR_EXISTS;
+	return std::filesystem::create_directories(to_path(path), error) ? MKDIR_SUCCESS : MKDIR_ERROR;
+}
+
+bool os_file_exists(const char *path)
+{
+	std::error_code error;
+	return std::filesystem::exists(to_path(path), error);
+}
+
+int os_unlink(const char *path)
+{
+	std::error_code error;
+	return std::filesystem::remove(to_path(path), error) ? 0 : -1;
+}
+
+int os_rename(const char *old_path, const char *new_path)
+{
+	std::error_code error;
+	std::filesystem::rename(to_path(old_path), to_path(new_path), error);
+	return error ? -1 : 0;
+}
+
+int os_get_logical_cores(void)
+{
+	const unsigned int cores = std::thread::hardware_concurrency();
+	return cores ? (int)cores : 1;
+}
+
+uint64_t os_get_proc_resident_size(void)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return (uint64_t)pmc.WorkingSetSize;
+#elif defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+		return 0;
+	return (uint64_t)info.resident_size;
+#else
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+	unsigned long long size = 0, resident = 0;
+	const int fields = fscanf(file, "%llu %llu", &size, &resident);
+	fclose(file);
+	return fields == 2 ? (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+void os_set_thread_name(const char *name)
+{
+#if defined(__APPLE__)
+	pthread_setname_np(name);
+#elif !defined(_WIN32)
+	// Linux limits thread names to 15 characters
+	char truncated[16];
+	snprintf(truncated, sizeof(truncated), "%s", name);
+	pthread_setname_np(pthread_self(), truncated);
+#else
+	UNUSED_PARAMETER(name);
+#endif
+}
+
+int astrcmpi(const char *str1, const char *str2)
+{
+	if (!str1)
+		str1 = "";
+	if (!str2)
+		str2 = "";
+
+	for (;; str1++, str2++) {
+		const int c1 = tolower((unsigned char)*str1);
+		const int c2 = tolower((unsigned char)*str2);
+		if (c1 != c2 || !c1)
+			return c1 - c2;
+	}
+}
+
+// The profiler only matters inside OBS; tools time what they measure themselves
+
+void profile_start(const char *name)
+{
+	UNUSED_PARAMETER(name);
+}
+
+void profile_end(const char *name)
+{
+	UNUSED_PARAMETER(name);
+}
+
+// Module
+
+obs_module_t *obs_current_module(void)
+{
+	return nullptr;
+}
+
+const char *obs_module_text(const char *lookup_string)
+{
+	return lookup_string;
+}
+
+char *obs_find_module_file(obs_module_t *module, const char *file)
+{
+	UNUSED_PARAMETER(module);
+	const std::string path = data_path + "/" + file;
+	return os_file_exists(path.c_str()) ? bstrdup(path.c_str()) : nullptr;
+}
+
+char *obs_module_get_config_path(obs_module_t *module, const char *file)
+{
+	UNUSED_PARAMETER(module);
+	return bstrdup((config_path + "/" + file).c_str());
+}
+
+// There is no UI thread to queue tasks for, so they run on the calling thread
+void obs_queue_task(enum obs_task_type type, obs_task_t task, void *param, bool wait)
+{
+	UNUSED_PARAMETER(type);
+	UNUSED_PARAMETER(wait);
+	task(param);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <obs-module.h>
+
+// A stand-in for the parts of libobs the plugin calls, so its code runs in a
+// plain executable. Data, sources with their signal and proc handlers,
+// memory, logging and the platform helpers work like the real ones; graphics
+// calls do nothing but hand out placeholder objects, so render paths run
+// their CPU side only.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Module files (effects) are looked up in data_path, and config files such
+// as the parse cache are written under config_path
+void obs_stub_init(const char *data_path, const char *config_path);
+// Messages above this level are dropped; LOG_INFO by default
+void obs_stub_set_log_level(int level);
+// Every bmalloc and brealloc so far. Unlike bnum_allocs, which is the number
+// of live blocks, this never goes down, so the difference between two calls
+// is the number of allocations made in between.
+long obs_stub_total_allocs(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,512 @@
+#include "lyrics-tools.h"
+#include "lyrics-source.h"
+#include "lyrics-library.h"
+#include "lyrics-encoding.h"
+#include "lyrics-search.h"
+#include "lyrics-stats.h"
+#include <libobs-stub.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <QGuiApplication>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Library sizes (in songs) the benchmark generates and measures
+static const size_t library_sizes[] = {100, 1000, 5000, 20000};
+
+#define NAVIGATION_OPS 20000
+#define TEXT_UPDATE_OPS 2000
+#define SOURCE_NAVIGATION_OPS 2000
+#define SEARCH_OPS 500
+#define DECODE_BYTES (64u * 1024 * 1024)
+#define DECODE_RUNS 5
+// Frame interval passed to video_tick
+#define FRAME_SECONDS (1.0f / 60.0f)
+
+struct rng {
+	uint64_t state;
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return (uint32_t)state;
+	}
+	uint32_t range(uint32_t lo, uint32_t hi) { return lo + next() % (hi - lo + 1); }
+};
+
+// The first 20 are ASCII and the first LATIN_WORDS fit Windows-1252
+static const char *const words[] = {
+	"grace", "amazing", "how", "sweet", "the", "sound", "that", "saved", "a", "wretch",
+	"like", "me", "once", "was", "lost", "but", "now", "am", "found", "blind",
+	"Hallelujah", "glory", "Holy", "forever", "grâce", "Gnade", "gloria", "santo", "благодать", "恩典",
+};
+#define LATIN_WORDS 28
+
+enum song_encoding {
+	SONG_UTF8,
+	SONG_UTF8_BOM,
+	SONG_UTF16LE,
+	SONG_UTF16BE,
+	SONG_WINDOWS_1252,
+	SONG_ENCODINGS,
+};
+
+static const char *const encoding_names[] = {"utf8", "utf8_bom", "utf16le", "utf16be", "windows_1252"};
+
+// Code points of UTF-8 text we generated ourselves, so it is known to be valid
+static std::vector<char32_t> code_points(const std::string &text)
+{
+	std::vector<char32_t> out;
+	out.reserve(text.size());
+	for (size_t i = 0; i < text.size();) {
+		const uint8_t c = (uint8_t)text[i];
+		const size_t length = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+		char32_t cp = length == 1 ? c : length == 2 ? c & 0x1F : length == 3 ? c & 0x0F : c & 0x07;
+		for (size_t j = 1; j < length; j++)
+			cp = (cp << 6) | ((uint8_t)text[i + j] & 0x3F);
+		out.push_back(cp);
+		i += length;
+	}
+	return out;
+}
+
+// UTF-8 text in the given encoding, with a BOM where the encoding has one.
+// Windows-1252 text must only hold Latin-1 characters.
+static std::string encode(const std::string &text, song_encoding encoding)
+{
+	std::string out;
+	switch (encoding) {
+	case SONG_UTF8:
+		return text;
+	case SONG_UTF8_BOM:
+		return "\xEF\xBB\xBF" + text;
+	case SONG_UTF16LE:
+	case SONG_UTF16BE: {
+		const bool big_endian = encoding == SONG_UTF16BE;
+		auto put = [&out, big_endian](uint16_t unit) {
+			out += (char)(big_endian ? unit >> 8 : unit & 0xFF);
+			out += (char)(big_endian ? unit & 0xFF : unit >> 8);
+		};
+		put(0xFEFF);
+		for (char32_t cp : code_points(text)) {
+			if (cp >= 0x10000) {
+				put((uint16_t)(0xD800 + ((cp - 0x10000) >> 10)));
+				put((uint16_t)(0xDC00 + ((cp - 0x10000) & 0x3FF)));
+			} else {
+				put((uint16_t)cp);
+			}
+		}
+		return out;
+	}
+	case SONG_WINDOWS_1252:
+		for (char32_t cp : code_points(text))
+			out += (char)(cp < 0x100 ? cp : '?');
+		return out;
+	default:
+		return text;
+	}
+}
+
+// Writes one synthetic song. Files vary in encoding, line length, line
+// endings, padding and non-ASCII content so every parser branch is exercised.
+static void write_song(const std::string &path, size_t index, uint64_t nonce, rng &r)
+{
+	const song_encoding encoding = (song_encoding)(index % SONG_ENCODINGS);
+	const size_t word_count = encoding == SONG_WINDOWS_1252 ? LATIN_WORDS : sizeof(words) / sizeof(words[0]);
+	const char *eol = index % 3 == 0 ? "\r\n" : "\n";
+	const bool padded = index % 7 == 0;
+
+	// Unique per run so the parse cache cannot serve the cold load
+	std::string text = "Song " + std::to_string(index) + " run " + std::to_string(nonce) + eol;
+
+	const uint32_t line_count = r.range(8, 60);
+	for (uint32_t i = 0; i < line_count; i++) {
+		if (padded)
+			text += "   \t";
+
+		const uint32_t target = r.range(5, 120);
+		size_t written = 0;
+		while (written < target) {
+			const char *word = words[r.next() % word_count];
+			if (written)
+				text += ' ';
+			text += word;
+			written += strlen(word) + 1;
+		}
+
+		if (padded)
+			text += "  ";
+		text += eol;
+		if (padded && i % 4 == 3)
+			text += eol;
+	}
+
+	FILE *file = os_fopen(path.c_str(), "wb");
+	if (!file)
+		return;
+	const std::string bytes = encode(text, encoding);
+	fwrite(bytes.data(), 1, bytes.size(), file);
+	fclose(file);
+}
+
+// C++ allocations, from the plugin code and Qt alike, counted next to the
+// stand-in's bmalloc count. operator new[] and the nothrow forms end up here
+// too; aligned new is left alone, nothing on the measured paths uses it.
+static std::atomic<long> new_allocs{0};
+
+void *operator new(std::size_t size)
+{
+	new_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr = malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size) noexcept
+{
+	UNUSED_PARAMETER(size);
+	free(ptr);
+}
+
+// Allocations of either kind so far
+static long total_allocs()
+{
+	return obs_stub_total_allocs() + new_allocs.load(std::memory_order_relaxed);
+}
+
+static uint64_t peak_rss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return (uint64_t)pmc.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return (uint64_t)usage.ru_maxrss;
+#else
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static obs_data_t *bench_library(const std::string &folder, size_t song_count, uint64_t nonce)
+{
+	obs_data_t *result = obs_data_create();
+	obs_data_set_int(result, "songs", (long long)song_count);
+
+	os_mkdirs(folder.c_str());
+	rng r{0x9E3779B97F4A7C15ull ^ song_count};
+	for (size_t i = 0; i < song_count; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "/song-%06zu.txt", i);
+		write_song(folder + name, i, nonce, r);
+	}
+
+	lyrics_library_spec spec;
+	spec.use_folder = true;
+	spec.folder = folder;
+
+	// Cold load parses every file, warm load is served by the parse cache
+	const uint64_t rss_before = os_get_proc_resident_size();
+	uint64_t start = os_gettime_ns();
+	std::shared_ptr<const lyrics_library> library = lyrics_library_load(spec, nullptr);
+	obs_data_set_int(result, "cold_load_ns", (long long)(os_gettime_ns() - start));
+	obs_data_set_int(result, "resident_delta_bytes", (long long)(os_get_proc_resident_size() - rss_before));
+
+	start = os_gettime_ns();
+	std::shared_ptr<const lyrics_library> warm = lyrics_library_load(spec, nullptr);
+	obs_data_set_int(result, "warm_load_ns", (long long)(os_gettime_ns() - start));
+	warm.reset();
+
+	obs_data_set_int(result, "lines", (long long)library->lines.size());
+	obs_data_set_int(result, "arena_bytes", (long long)library->arena.size());
+	obs_data_set_int(result, "peak_rss_bytes", (long long)peak_rss());
+
+	// Library stepping, the pure part of lyrics_source_next()/previous()
+	std::vector<uint64_t> samples;
+	samples.reserve(NAVIGATION_OPS);
+	int song = 0, line = 0;
+	for (int i = 0; i < NAVIGATION_OPS; i++) {
+		const uint64_t t = os_gettime_ns();
+		if (i % 3 == 2)
+			lyrics_library_previous(*library, song, line);
+		else
+			lyrics_library_next(*library, song, line);
+		samples.push_back(os_gettime_ns() - t);
+	}
+	obs_data_t *nav = obs_data_create();
+	lyrics_stats_set_percentiles(nav, samples);
+	obs_data_set_obj(result, "library_step", nav);
+	obs_data_release(nav);
+
+	// Search over random two-word phrases
+	samples.clear();
+	for (int i = 0; i < SEARCH_OPS; i++) {
+		std::string query = words[r.next() % 20];
+		query += " ";
+		query += words[r.next() % 20];
+		const uint64_t t = os_gettime_ns();
+		lyrics_search_find(*library, query.c_str(), 20);
+		samples.push_back(os_gettime_ns() - t);
+	}
+	obs_data_t *search = obs_data_create();
+	lyrics_stats_set_percentiles(search, samples);
+	obs_data_set_obj(result, "search", search);
+	obs_data_release(search);
+
+	return result;
+}
+
+// Best of DECODE_RUNS, in bytes of input per second
+static double decode_rate(const std::string &input, std::string &scratch)
+{
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < DECODE_RUNS; i++) {
+		size_t size;
+		const uint64_t t = os_gettime_ns();
+		lyrics_encoding_decode(input.data(), input.size(), scratch, &size);
+		best = std::min(best, os_gettime_ns() - t);
+	}
+	return (double)input.size() * 1e9 / (double)std::max<uint64_t>(best, 1);
+}
+
+// Encoding detection and normalization over large buffers of each kind of
+// file, next to memcpy of the same size as the memory bandwidth reference
+static obs_data_t *bench_decode()
+{
+	rng r{0xDEC0DE};
+	std::string utf8, ascii, latin;
+	while (utf8.size() < DECODE_BYTES) {
+		const char *word = words[r.next() % (sizeof(words) / sizeof(words[0]))];
+		utf8 += word;
+		utf8 += r.next() % 8 ? ' ' : '\n';
+	}
+	while (ascii.size() < DECODE_BYTES) {
+		ascii += words[r.next() % 20];
+		ascii += r.next() % 8 ? ' ' : '\n';
+	}
+	while (latin.size() < DECODE_BYTES) {
+		latin += words[r.next() % LATIN_WORDS];
+		latin += r.next() % 8 ? ' ' : '\n';
+	}
+
+	// The mixed text as UTF-16 both ways, and Latin text as Windows-1252 with
+	// é for every 'e' so high bytes are common
+	const std::string utf16le = encode(utf8, SONG_UTF16LE);
+	const std::string utf16be = encode(utf8, SONG_UTF16BE);
+	std::string cp1252 = encode(latin, SONG_WINDOWS_1252);
+	std::replace(cp1252.begin(), cp1252.end(), 'e', '\xE9');
+
+	obs_data_t *result = obs_data_create();
+	std::string scratch;
+
+	std::string copy(utf8.size(), '\0');
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < DECODE_RUNS; i++) {
+		const uint64_t t = os_gettime_ns();
+		memcpy(&copy[0], utf8.data(), utf8.size());
+		best = std::min(best, os_gettime_ns() - t);
+	}
+	const double memcpy_rate = (double)utf8.size() * 1e9 / (double)std::max<uint64_t>(best, 1);
+	obs_data_set_double(result, "memcpy_mb_s", memcpy_rate / 1e6);
+
+	const struct {
+		const char *name;
+		const std::string &input;
+	} inputs[] = {{"ascii", ascii},
+		      {"utf8", utf8},
+		      {"utf16le", utf16le},
+		      {"utf16be", utf16be},
+		      {"windows_1252", cp1252}};
+	for (const auto &input : inputs) {
+		const double rate = decode_rate(input.input, scratch);
+		obs_data_t *item = obs_data_create();
+		obs_data_set_double(item, "mb_s", rate / 1e6);
+		obs_data_set_double(item, "of_memcpy", rate / memcpy_rate);
+		obs_data_set_obj(result, input.name, item);
+		obs_data_release(item);
+	}
+
+	return result;
+}
+
+static void tick(obs_source_t *source)
+{
+	obs_source_video_tick(source, FRAME_SECONDS);
+}
+
+// Drives a real lyrics source the way OBS does, minus the wait for the next
+// frame: hotkey navigation through the command queue until the video_tick
+// that applies it, plus settings updates
+static obs_data_t *bench_source(const std::string &folder)
+{
+	obs_data_t *settings = obs_data_create();
+	obs_data_set_bool(settings, USE_FOLDER, true);
+	obs_data_set_string(settings, LYRICS_FOLDER, folder.c_str());
+	obs_data_set_int(settings, LINE_CACHE_BUDGET, 0);
+
+	obs_source_t *source = obs_source_create_private("lyrics_source", "lyrics_benchmark", settings);
+	obs_data_release(settings);
+	void *data = obs_obj_get_data(source);
+	if (!data) {
+		obs_source_release(source);
+		return nullptr;
+	}
+
+	// Songs are only loaded once the source is shown, from video_tick, and
+	// parsed in the background
+	obs_source_inc_showing(source);
+	for (int i = 0; i < 1000 && lyrics_source_get_song_count(data) == 0; i++) {
+		tick(source);
+		os_sleep_ms(10);
+	}
+	if (lyrics_source_get_song_count(data) == 0) {
+		plugin_log(LOG_WARNING, "Benchmark source loaded no songs from %s", folder.c_str());
+		obs_source_dec_showing(source);
+		obs_source_release(source);
+		return nullptr;
+	}
+
+	obs_data_t *result = obs_data_create();
+	std::vector<uint64_t> samples;
+	samples.reserve(SOURCE_NAVIGATION_OPS);
+
+	const long bmem_before = obs_stub_total_allocs();
+	const long allocs_before = total_allocs();
+	for (int i = 0; i < SOURCE_NAVIGATION_OPS; i++) {
+		const uint64_t t = os_gettime_ns();
+		if (i % 3 == 2)
+			lyrics_source_previous(data);
+		else
+			lyrics_source_next(data);
+		tick(source);
+		samples.push_back(os_gettime_ns() - t);
+	}
+	const long bmem_allocs = obs_stub_total_allocs() - bmem_before;
+	const long allocs = total_allocs() - allocs_before;
+
+	obs_data_t *nav = obs_data_create();
+	lyrics_stats_set_percentiles(nav, samples);
+	obs_data_set_double(nav, "allocs_per_op", (double)allocs / SOURCE_NAVIGATION_OPS);
+	obs_data_set_double(nav, "bmem_allocs_per_op", (double)bmem_allocs / SOURCE_NAVIGATION_OPS);
+	obs_data_set_obj(result, "step_and_tick", nav);
+	obs_data_release(nav);
+
+	// Style changes rebuild the text source settings; the text source itself
+	// is updated on the next frame
+	samples.clear();
+	obs_data_t *style = obs_source_get_settings(source);
+	for (int i = 0; i < TEXT_UPDATE_OPS / 10; i++) {
+		obs_data_set_int(style, TEXT_SHADOW_OFFSET_X, i % 20);
+		const uint64_t t = os_gettime_ns();
+		lyrics_source_update(data, style);
+		samples.push_back(os_gettime_ns() - t);
+	}
+	obs_data_release(style);
+
+	obs_data_t *update = obs_data_create();
+	lyrics_stats_set_percentiles(update, samples);
+	obs_data_set_obj(result, "style_update", update);
+	obs_data_release(update);
+
+	obs_source_dec_showing(source);
+	obs_source_release(source);
+	return result;
+}
+
+static obs_data_t *run_benchmark(const std::string &root)
+{
+	const uint64_t nonce = os_gettime_ns();
+
+	obs_data_t *report = obs_data_create();
+	obs_data_set_string(report, "plugin_version", PLUGIN_VERSION);
+	obs_data_array_t *libraries = obs_data_array_create();
+
+	// The source benchmark runs against the 1000-song library
+	std::string source_folder;
+	for (size_t song_count : library_sizes) {
+		plugin_log(LOG_INFO, "Benchmarking a library of %zu songs", song_count);
+		const std::string folder = root + "/library-" + std::to_string(song_count);
+		obs_data_t *result = bench_library(folder, song_count, nonce);
+		obs_data_array_push_back(libraries, result);
+		obs_data_release(result);
+		if (song_count <= 1000)
+			source_folder = folder;
+	}
+	obs_data_set_array(report, "libraries", libraries);
+	obs_data_array_release(libraries);
+
+	plugin_log(LOG_INFO, "Benchmarking decoding");
+	obs_data_t *decode = bench_decode();
+	obs_data_set_obj(report, "decode", decode);
+	obs_data_release(decode);
+
+	plugin_log(LOG_INFO, "Benchmarking a lyrics source");
+	obs_data_t *source = bench_source(source_folder);
+	if (source) {
+		obs_data_set_obj(report, "source", source);
+		obs_data_release(source);
+	}
+
+	return report;
+}
+
+// Usage: lyrics-benchmark [report.json]
+// Libraries are generated in a temporary directory that also holds the parse
+// cache, so runs neither touch nor depend on the user's OBS configuration.
+// The report goes to the given file, or to stdout.
+int main(int argc, char **argv)
+{
+	// Qt fonts need a QGuiApplication, not a display
+	if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QGuiApplication app(argc, argv);
+
+	const std::string root = lyrics_tools_temp_dir("lyrics-benchmark");
+	if (root.empty()) {
+		fprintf(stderr, "Could not create a temporary directory\n");
+		return 1;
+	}
+	lyrics_tools_init(root + "/config");
+
+	obs_data_t *report = run_benchmark(root);
+	lyrics_source_free_loaders();
+
+	bool written;
+	if (argc > 1) {
+		written = obs_data_save_json(report, argv[1]);
+		if (!written)
+			fprintf(stderr, "Could not write %s\n", argv[1]);
+	} else {
+		written = fputs(obs_data_get_json_pretty(report), stdout) >= 0 && fputc('\n', stdout) != EOF;
+	}
+	obs_data_release(report);
+
+	lyrics_tools_remove_dir(root);
+	return written ? 0 : 1;
+}
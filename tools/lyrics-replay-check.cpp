@@ -0,0 +1,332 @@
+#include "lyrics-tools.h"
+#include "lyrics-replay-events.h"
+#include "lyrics-source.h"
+#include "lyrics-stats.h"
+#include <libobs-stub.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <graphics/vec4.h>
+#include <QGuiApplication>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Plays timelines recorded with "Lyrics Replay: Start/Stop Recording" (see
+// src/lyrics-replay.cpp for the format) against lyrics sources outside OBS,
+// as a repeatable regression test. Frames run at a fixed rate: every frame
+// ticks and renders each source, and events are applied between the frames
+// their recorded times fall between, the way OBS would have seen them. With
+// --fast the frames run back to back instead of waiting for the clock, so a
+// timeline plays in the order it would in real time, only faster.
+
+#define FRAME_NS (1000000000ull / 60)
+#define LOAD_TIMEOUT_MS 10000
+#define SETTLE_FRAMES 30
+
+struct check_options {
+	bool fast = false;
+	double max_latency_ms = 0.0; // worst source latency p95, 0 for no limit
+	double max_frame_ms = 0.0;   // frame p95, 0 for no limit
+	const char *folder = nullptr;
+	const char *report = nullptr;
+	std::vector<const char *> timelines;
+};
+
+struct replay_frames {
+	std::vector<obs_source_t *> sources;
+	gs_texrender_t *target = nullptr;
+	std::vector<uint64_t> frame_ns;
+	std::vector<uint64_t> render_ns;
+};
+
+// One output frame: video_tick for every source, then each one drawn
+// off-screen and timed
+static void run_frame(replay_frames &frames)
+{
+	const uint64_t frame_start = os_gettime_ns();
+	for (obs_source_t *source : frames.sources)
+		obs_source_video_tick(source, (float)FRAME_NS / 1e9f);
+
+	obs_enter_graphics();
+	if (!frames.target)
+		frames.target = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	gs_texrender_reset(frames.target);
+	if (gs_texrender_begin(frames.target, 640, 360)) {
+		struct vec4 clear_color;
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+		gs_ortho(0.0f, 1920.0f, 0.0f, 1080.0f, -100.0f, 100.0f);
+		for (obs_source_t *source : frames.sources) {
+			const uint64_t start = os_gettime_ns();
+			obs_source_video_render(source);
+			frames.render_ns.push_back(os_gettime_ns() - start);
+		}
+		gs_texrender_end(frames.target);
+	}
+	obs_leave_graphics();
+
+	frames.frame_ns.push_back(os_gettime_ns() - frame_start);
+}
+
+// Runs frames up to the given time since start_ns, which is either the
+// wall clock or, with --fast, a counter advanced one frame at a time
+static void run_frames_until(replay_frames &frames, const check_options &options, uint64_t start_ns,
+			     uint64_t &frame_count, uint64_t until_ns)
+{
+	while (frame_count * FRAME_NS <= until_ns) {
+		if (!options.fast)
+			os_sleepto_ns(start_ns + frame_count * FRAME_NS);
+		run_frame(frames);
+		frame_count++;
+	}
+}
+
+// Points recorded settings at --folder, so timelines recorded on another
+// machine play against local songs. Updates are only redirected when they
+// change where songs come from.
+static void apply_overrides(obs_data_t *settings, const check_options &options, bool always)
+{
+	if (!settings || !options.folder)
+		return;
+	if (always || obs_data_has_user_value(settings, LYRICS_FOLDER) ||
+	    obs_data_has_user_value(settings, USE_FOLDER)) {
+		obs_data_set_bool(settings, USE_FOLDER, true);
+		obs_data_set_string(settings, LYRICS_FOLDER, options.folder);
+	}
+}
+
+// Replays one timeline and adds its results to report; returns false if it
+// could not be played or broke a limit
+static bool check_timeline(const char *path, const check_options &options, obs_data_array_t *report)
+{
+	obs_data_t *timeline = obs_data_create_from_json_file(path);
+	if (!timeline) {
+		fprintf(stderr, "%s is not a timeline\n", path);
+		return false;
+	}
+
+	obs_data_array_t *sources = obs_data_get_array(timeline, "sources");
+	obs_data_array_t *events = obs_data_get_array(timeline, "events");
+	const size_t source_count = sources ? obs_data_array_count(sources) : 0;
+	const size_t event_count = events ? obs_data_array_count(events) : 0;
+	bool passed = source_count > 0;
+
+	// Shown so they load like they would on air
+	replay_frames frames;
+	for (size_t i = 0; i < source_count; i++) {
+		obs_data_t *entry = obs_data_array_item(sources, i);
+		obs_data_t *settings = obs_data_get_obj(entry, "settings");
+		apply_overrides(settings, options, true);
+		const std::string name = "lyrics_replay_" + std::to_string(i);
+		obs_source_t *source = obs_source_create_private("lyrics_source", name.c_str(), settings);
+		obs_source_inc_showing(source);
+		frames.sources.push_back(source);
+		obs_data_release(settings);
+		obs_data_release(entry);
+	}
+
+	// Songs are loaded from video_tick and parsed in the background, so tick
+	// until every source has some, in real time whatever the mode
+	const uint64_t load_start_ns = os_gettime_ns();
+	auto loaded = [&frames]() {
+		for (obs_source_t *source : frames.sources)
+			if (lyrics_source_get_song_count(obs_obj_get_data(source)) == 0)
+				return false;
+		return true;
+	};
+	while (!loaded() && os_gettime_ns() - load_start_ns < LOAD_TIMEOUT_MS * 1000000ull) {
+		for (obs_source_t *source : frames.sources)
+			obs_source_video_tick(source, (float)FRAME_NS / 1e9f);
+		os_sleep_ms(10);
+	}
+	for (obs_source_t *source : frames.sources) {
+		if (lyrics_source_get_song_count(obs_obj_get_data(source)) == 0) {
+			fprintf(stderr, "%s: %s has no songs on this machine\n", path, obs_source_get_name(source));
+			passed = false;
+		}
+	}
+
+	uint64_t frame_count = 0;
+	const uint64_t start_ns = os_gettime_ns();
+	uint64_t end_us = 0;
+	for (size_t i = 0; passed && i < event_count; i++) {
+		obs_data_t *event = obs_data_array_item(events, i);
+		const size_t index = (size_t)obs_data_get_int(event, "source");
+		const uint64_t t_us = (uint64_t)obs_data_get_int(event, "t_us");
+		obs_data_t *args = obs_data_get_obj(event, "args");
+
+		run_frames_until(frames, options, start_ns, frame_count, t_us * 1000);
+		const char *op = obs_data_get_string(event, "op");
+		if (strcmp(op, "update") == 0)
+			apply_overrides(args, options, false);
+		if (index < frames.sources.size() && !lyrics_replay_play_event(frames.sources[index], op, args))
+			plugin_log(LOG_WARNING, "Replay check: unknown operation '%s'", op);
+		end_us = std::max(end_us, t_us);
+
+		obs_data_release(args);
+		obs_data_release(event);
+	}
+	// Frames after the last event, so whatever it queued gets applied
+	if (passed)
+		run_frames_until(frames, options, start_ns, frame_count, end_us * 1000 + SETTLE_FRAMES * FRAME_NS);
+	const uint64_t duration_ns = os_gettime_ns() - start_ns;
+
+	obs_data_t *result = obs_data_create();
+	obs_data_set_string(result, "timeline", path);
+	obs_data_set_int(result, "events", (long long)event_count);
+	obs_data_set_int(result, "frames", (long long)frame_count);
+	obs_data_set_int(result, "duration_ns", (long long)duration_ns);
+
+	obs_data_t *frame_result = obs_data_create();
+	lyrics_stats_set_percentiles(frame_result, frames.frame_ns);
+	const double frame_p95_ms = obs_data_get_int(frame_result, "p95_ns") / 1e6;
+	obs_data_set_obj(result, "frame", frame_result);
+	obs_data_release(frame_result);
+
+	obs_data_t *render_result = obs_data_create();
+	lyrics_stats_set_percentiles(render_result, frames.render_ns);
+	obs_data_set_obj(result, "render", render_result);
+	obs_data_release(render_result);
+
+	// Latency from each source's own statistics, and where it ended up
+	double worst_p95_ms = 0.0;
+	obs_data_array_t *source_results = obs_data_array_create();
+	for (obs_source_t *source : frames.sources) {
+		calldata_t cd = {0};
+		proc_handler_call(obs_source_get_proc_handler(source), "get_stats", &cd);
+		obs_data_t *stats = obs_data_create_from_json(calldata_string(&cd, "stats"));
+		calldata_free(&cd);
+		if (!stats)
+			continue;
+
+		obs_data_t *latency = obs_data_get_obj(stats, "latency_ms");
+		worst_p95_ms = std::max(worst_p95_ms, obs_data_get_double(latency, "p95"));
+		obs_data_release(latency);
+
+		int song, line;
+		lyrics_source_get_position(obs_obj_get_data(source), &song, &line);
+		obs_data_set_int(stats, "final_song", song);
+		obs_data_set_int(stats, "final_line", line);
+
+		obs_data_array_push_back(source_results, stats);
+		obs_data_release(stats);
+	}
+	obs_data_set_array(result, "sources", source_results);
+	obs_data_array_release(source_results);
+
+	if (options.max_latency_ms > 0.0 && worst_p95_ms > options.max_latency_ms) {
+		fprintf(stderr, "%s: latency p95 %.2f ms is over the %.2f ms limit\n", path, worst_p95_ms,
+			options.max_latency_ms);
+		passed = false;
+	}
+	if (options.max_frame_ms > 0.0 && frame_p95_ms > options.max_frame_ms) {
+		fprintf(stderr, "%s: frame p95 %.2f ms is over the %.2f ms limit\n", path, frame_p95_ms,
+			options.max_frame_ms);
+		passed = false;
+	}
+	obs_data_set_bool(result, "passed", passed);
+
+	plugin_log(LOG_INFO, "Replay check: %s, %zu events, %llu frames: latency p95 %.2f ms, frame p95 %.2f ms, %s",
+		   path, event_count, (unsigned long long)frame_count, worst_p95_ms, frame_p95_ms,
+		   passed ? "passed" : "FAILED");
+	obs_data_array_push_back(report, result);
+	obs_data_release(result);
+
+	obs_enter_graphics();
+	gs_texrender_destroy(frames.target);
+	obs_leave_graphics();
+
+	for (obs_source_t *source : frames.sources) {
+		obs_source_dec_showing(source);
+		obs_source_release(source);
+	}
+
+	obs_data_array_release(events);
+	obs_data_array_release(sources);
+	obs_data_release(timeline);
+	return passed;
+}
+
+static void usage()
+{
+	fprintf(stderr, "Usage: lyrics-replay-check [options] timeline.json...\n"
+			"  --fast                run frames back to back instead of in real time\n"
+			"  --folder DIR          play against the songs in DIR instead of the recorded folder\n"
+			"  --max-latency-ms MS   fail when a source's navigation latency p95 is above MS\n"
+			"  --max-frame-ms MS     fail when the p95 time to tick and render a frame is above MS\n"
+			"  --report FILE         write the results as JSON to FILE\n");
+}
+
+static bool parse_options(int argc, char **argv, check_options &options)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (strcmp(arg, "--fast") == 0)
+			options.fast = true;
+		else if (strcmp(arg, "--folder") == 0 && has_value)
+			options.folder = argv[++i];
+		else if (strcmp(arg, "--max-latency-ms") == 0 && has_value)
+			options.max_latency_ms = atof(argv[++i]);
+		else if (strcmp(arg, "--max-frame-ms") == 0 && has_value)
+			options.max_frame_ms = atof(argv[++i]);
+		else if (strcmp(arg, "--report") == 0 && has_value)
+			options.report = argv[++i];
+		else if (strncmp(arg, "--", 2) == 0)
+			return false;
+		else
+			options.timelines.push_back(arg);
+	}
+	return !options.timelines.empty();
+}
+
+// Exit code 0 when every timeline played and stayed within the limits, 1 when
+// one did not, 2 for bad arguments
+int main(int argc, char **argv)
+{
+	check_options options;
+	if (!parse_options(argc, argv, options)) {
+		usage();
+		return 2;
+	}
+
+	// Qt fonts need a QGuiApplication, not a display
+	if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QGuiApplication app(argc, argv);
+
+	// A private parse cache, so results do not depend on earlier runs
+	const std::string root = lyrics_tools_temp_dir("lyrics-replay-check");
+	if (root.empty()) {
+		fprintf(stderr, "Could not create a temporary directory\n");
+		return 1;
+	}
+	lyrics_tools_init(root + "/config");
+
+	bool passed = true;
+	obs_data_array_t *results = obs_data_array_create();
+	for (const char *timeline : options.timelines)
+		passed = check_timeline(timeline, options, results) && passed;
+	lyrics_source_free_loaders();
+
+	if (options.report) {
+		obs_data_t *report = obs_data_create();
+		obs_data_set_string(report, "plugin_version", PLUGIN_VERSION);
+		obs_data_set_bool(report, "fast", options.fast);
+		obs_data_set_bool(report, "passed", passed);
+		obs_data_set_array(report, "timelines", results);
+		if (!obs_data_save_json(report, options.report)) {
+			fprintf(stderr, "Could not write %s\n", options.report);
+			passed = false;
+		}
+		obs_data_release(report);
+	}
+	obs_data_array_release(results);
+
+	lyrics_tools_remove_dir(root);
+	return passed ? 0 : 1;
+}
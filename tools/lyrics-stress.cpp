@@ -0,0 +1,319 @@
+#include "lyrics-tools.h"
+#include "lyrics-source.h"
+#include <libobs-stub.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <graphics/vec4.h>
+#include <QGuiApplication>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hammers the three paths that touch a lyrics source concurrently: hotkey and
+// controller navigation, settings updates with folder changes underneath the
+// watcher, and video_tick/render on a graphics thread of its own. Meant to be
+// built with ENABLE_TSAN, which instruments the plugin code, the libobs
+// stand-in and this tool alike; without it it still catches crashes and
+// deadlocks.
+
+#define DEFAULT_SECONDS 30
+#define STRESS_SONGS 40
+#define NAVIGATION_THREADS 3
+// Frame interval of the graphics thread
+#define FRAME_NS 16666667ull
+
+static std::atomic<bool> stopping{false};
+
+struct stress_counters {
+	std::atomic<uint64_t> navigations{0};
+	std::atomic<uint64_t> updates{0};
+	std::atomic<uint64_t> file_changes{0};
+	std::atomic<uint64_t> frames{0};
+};
+
+struct rng {
+	uint64_t state;
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return (uint32_t)state;
+	}
+};
+
+static void write_song(const std::string &folder, size_t index, uint32_t variant)
+{
+	char name[32];
+	const bool timed = index % 4 == 0;
+	snprintf(name, sizeof(name), "/song-%03zu.%s", index, timed ? "lrc" : "txt");
+
+	FILE *file = os_fopen((folder + name).c_str(), "wb");
+	if (!file)
+		return;
+
+	const uint32_t line_count = 4 + (index + variant) % 20;
+	for (uint32_t i = 0; i < line_count; i++) {
+		if (timed)
+			fprintf(file, "[00:%02u.00]", i * 2 % 60);
+		fprintf(file, "Song %zu line %u variant %u\n", index, i, variant);
+	}
+	fclose(file);
+}
+
+// Stands in for OBS's graphics thread: video_tick for both sources, then both
+// drawn off-screen, at 60 frames per second
+static void graphics_thread(obs_source_t *const *sources, stress_counters *counters)
+{
+	os_set_thread_name("lyrics-stress: graphics");
+
+	obs_enter_graphics();
+	gs_texrender_t *target = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+	obs_leave_graphics();
+
+	const uint64_t start_ns = os_gettime_ns();
+	for (uint64_t frame = 0; !stopping; frame++) {
+		os_sleepto_ns(start_ns + frame * FRAME_NS);
+		for (int i = 0; i < 2; i++)
+			obs_source_video_tick(sources[i], (float)FRAME_NS / 1e9f);
+
+		obs_enter_graphics();
+		gs_texrender_reset(target);
+		if (gs_texrender_begin(target, 640, 360)) {
+			struct vec4 clear_color;
+			vec4_zero(&clear_color);
+			gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+			gs_ortho(0.0f, 1920.0f, 0.0f, 1080.0f, -100.0f, 100.0f);
+			for (int i = 0; i < 2; i++)
+				obs_source_video_render(sources[i]);
+			gs_texrender_end(target);
+		}
+		obs_leave_graphics();
+
+		counters->frames++;
+	}
+
+	obs_enter_graphics();
+	gs_texrender_destroy(target);
+	obs_leave_graphics();
+}
+
+static void navigation_thread(obs_source_t *source, uint64_t seed, stress_counters *counters)
+{
+	void *data = obs_obj_get_data(source);
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	rng r{seed};
+
+	while (!stopping) {
+		switch (r.next() % 10) {
+		case 0:
+		case 1:
+		case 2:
+			lyrics_source_next(data);
+			break;
+		case 3:
+			lyrics_source_previous(data);
+			break;
+		case 4:
+			lyrics_source_toggle_text(data);
+			break;
+		case 5: {
+			calldata_t cd = {0};
+			calldata_set_int(&cd, "song", r.next() % (STRESS_SONGS + 5));
+			calldata_set_int(&cd, "line", r.next() % 30);
+			proc_handler_call(ph, "goto", &cd);
+			calldata_free(&cd);
+			break;
+		}
+		case 6: {
+			calldata_t cd = {0};
+			calldata_set_string(&cd, "query", "line variant");
+			calldata_set_int(&cd, "max_results", 5);
+			proc_handler_call(ph, "search", &cd);
+			calldata_free(&cd);
+			break;
+		}
+		case 7:
+			lyrics_source_media_play_pause(data, r.next() % 2 == 0);
+			break;
+		case 8:
+			lyrics_source_media_set_time(data, r.next() % 60000);
+			lyrics_source_media_get_duration(data);
+			lyrics_source_media_get_state(data);
+			break;
+		default:
+			if (r.next() % 2)
+				lyrics_source_media_restart(data);
+			else
+				lyrics_source_media_stop(data);
+			break;
+		}
+
+		counters->navigations++;
+		if (r.next() % 64 == 0)
+			os_sleep_ms(1);
+	}
+}
+
+// Settings changes from the "UI": setlists, patterns and style, each of which
+// may swap the library or the text style under the other two paths
+static void update_thread(obs_source_t *source, stress_counters *counters)
+{
+	rng r{0x5EED};
+
+	while (!stopping) {
+		obs_data_t *settings = obs_data_create();
+		obs_data_array_t *setlist = obs_data_array_create();
+		const uint32_t setlist_size = r.next() % 2 ? r.next() % 8 : 0;
+		for (uint32_t i = 0; i < setlist_size; i++) {
+			char id[32];
+			snprintf(id, sizeof(id), "song-%03u", r.next() % STRESS_SONGS);
+			obs_data_t *item = obs_data_create();
+			obs_data_set_string(item, "value", id);
+			obs_data_array_push_back(setlist, item);
+			obs_data_release(item);
+		}
+		obs_data_set_array(settings, SETLIST, setlist);
+		obs_data_array_release(setlist);
+
+		obs_data_set_string(settings, LYRICS_PATTERNS, r.next() % 3 ? "*.txt;*.lrc" : "*.txt");
+		obs_data_set_int(settings, TEXT_SHADOW_OFFSET_X, r.next() % 10);
+		obs_data_set_int(settings, TRANSITION_MODE, r.next() % 4);
+		obs_source_update(source, settings);
+		obs_data_release(settings);
+
+		counters->updates++;
+		os_sleep_ms(2 + r.next() % 10);
+	}
+}
+
+// Edits, removes and re-adds song files so the watcher publishes reloads
+static void file_thread(const std::string &folder, stress_counters *counters)
+{
+	rng r{0xF11E};
+	uint32_t variant = 1;
+
+	while (!stopping) {
+		const size_t index = r.next() % STRESS_SONGS;
+		if (r.next() % 4 == 0) {
+			char name[32];
+			snprintf(name, sizeof(name), "/song-%03zu.%s", index, index % 4 == 0 ? "lrc" : "txt");
+			os_unlink((folder + name).c_str());
+		} else {
+			write_song(folder, index, variant++);
+		}
+
+		counters->file_changes++;
+		os_sleep_ms(5 + r.next() % 20);
+	}
+}
+
+static obs_source_t *create_source(const std::string &folder, const char *name)
+{
+	obs_data_t *settings = obs_data_create();
+	obs_data_set_bool(settings, USE_FOLDER, true);
+	obs_data_set_string(settings, LYRICS_FOLDER, folder.c_str());
+	obs_data_set_string(settings, LINK_GROUP, "lyrics-stress");
+	obs_data_set_int(settings, TRANSITION_MODE, 2);
+
+	// Shown like a source in a visible scene, or it would never load its songs
+	obs_source_t *source = obs_source_create_private("lyrics_source", name, settings);
+	obs_data_release(settings);
+	if (source)
+		obs_source_inc_showing(source);
+	return source;
+}
+
+static void release_source(obs_source_t *source)
+{
+	if (!source)
+		return;
+	obs_source_dec_showing(source);
+	obs_source_release(source);
+}
+
+static void usage()
+{
+	fprintf(stderr, "Usage: lyrics-stress [options]\n"
+			"  --seconds N   run for N seconds instead of %d\n",
+		DEFAULT_SECONDS);
+}
+
+// Exit code 0 when the run finished, 1 when it could not start, 2 for bad
+// arguments. ThreadSanitizer reports make it exit with its own nonzero code.
+int main(int argc, char **argv)
+{
+	int seconds = DEFAULT_SECONDS;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+			seconds = atoi(argv[++i]);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+
+	// Qt fonts need a QGuiApplication, not a display
+	if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QGuiApplication app(argc, argv);
+
+	// The songs and a private parse cache, removed again afterwards
+	const std::string root = lyrics_tools_temp_dir("lyrics-stress");
+	if (root.empty()) {
+		fprintf(stderr, "Could not create a temporary directory\n");
+		return 1;
+	}
+	lyrics_tools_init(root + "/config");
+
+	const std::string folder = root + "/songs";
+	os_mkdirs(folder.c_str());
+	for (size_t i = 0; i < STRESS_SONGS; i++)
+		write_song(folder, i, 0);
+
+	obs_source_t *sources[2] = {
+		create_source(folder, "lyrics_stress_a"),
+		create_source(folder, "lyrics_stress_b"),
+	};
+	if (!sources[0] || !sources[1]) {
+		fprintf(stderr, "Could not create the lyrics sources\n");
+		release_source(sources[0]);
+		release_source(sources[1]);
+		lyrics_tools_remove_dir(root);
+		return 1;
+	}
+
+	plugin_log(LOG_INFO, "Lyrics stress test started (%d s)", seconds);
+
+	stress_counters counters;
+	std::vector<std::thread> threads;
+	threads.emplace_back(graphics_thread, sources, &counters);
+	for (int i = 0; i < NAVIGATION_THREADS; i++)
+		threads.emplace_back(navigation_thread, sources[i % 2], 0x9E3779B97F4A7C15ull + i, &counters);
+	threads.emplace_back(update_thread, sources[0], &counters);
+	threads.emplace_back(file_thread, folder, &counters);
+
+	os_sleep_ms((uint32_t)seconds * 1000);
+	stopping = true;
+	for (std::thread &worker : threads)
+		worker.join();
+
+	release_source(sources[0]);
+	release_source(sources[1]);
+	lyrics_source_free_loaders();
+
+	plugin_log(LOG_INFO,
+		   "Lyrics stress test finished: %llu navigations, %llu settings updates, %llu file changes, "
+		   "%llu frames",
+		   (unsigned long long)counters.navigations.load(), (unsigned long long)counters.updates.load(),
+		   (unsigned long long)counters.file_changes.load(), (unsigned long long)counters.frames.load());
+
+	lyrics_tools_remove_dir(root);
+	return 0;
+}
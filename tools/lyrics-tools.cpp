@@ -0,0 +1,38 @@
+#include "lyrics-tools.h"
+#include "lyrics-source.h"
+#include <libobs-stub.h>
+#include <util/platform.h>
+#include <filesystem>
+#include <system_error>
+
+void lyrics_tools_init(const std::string &config_path)
+{
+	obs_stub_init(DATA_DIR, config_path.c_str());
+	lyrics_source_register();
+}
+
+std::string lyrics_tools_temp_dir(const char *prefix)
+{
+	std::error_code error;
+	const std::filesystem::path base = std::filesystem::temp_directory_path(error);
+	if (error)
+		return "";
+
+	// Unique enough for tools that may run side by side
+	for (int attempt = 0; attempt < 100; attempt++) {
+		const std::filesystem::path path =
+			base / (std::string(prefix) + "-" + std::to_string(os_gettime_ns() % 1000000000ull));
+		if (std::filesystem::create_directory(path, error))
+			return path.u8string();
+	}
+	return "";
+}
+
+void lyrics_tools_remove_dir(const std::string &path)
+{
+	if (path.empty())
+		return;
+
+	std::error_code error;
+	std::filesystem::remove_all(std::filesystem::u8path(path), error);
+}
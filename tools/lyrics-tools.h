@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+// Setup shared by the command line tools, which run the plugin code against
+// the libobs stand-in in tools/libobs-stub
+
+// Points the stand-in at the plugin's data folder and at config_path for
+// module config files (the parse cache), and registers "lyrics_source" as
+// the plugin does, so obs_source_create_private() creates one
+void lyrics_tools_init(const std::string &config_path);
+
+// A new empty directory under the system temp directory, or "" on failure
+std::string lyrics_tools_temp_dir(const char *prefix);
+// Removes it again, with everything in it
+void lyrics_tools_remove_dir(const std::string &path);